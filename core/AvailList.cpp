@@ -3,47 +3,114 @@
 
 namespace ma {
 
-void AvailList::clear() { freelist_.clear(); }
+void AvailList::clear() {
+    slots_.clear();
+    live_.clear();
+    tree_.clear();
+    bySize_.clear();
+    byRef_.clear();
+    next_ = 0;
+}
 
 void AvailList::add(FreeSlotRef r) {
-    for (auto& x : freelist_) {
-        if (x.pageId == r.pageId && x.slotId == r.slotId) {
-            x.size = std::max<uint16_t>(x.size, r.size);
-            return;
-        }
+    auto it = byRef_.find(keyOf(r.pageId, r.slotId));
+    if (it != byRef_.end()) {
+        const uint32_t pos = it->second;
+        FreeSlotRef& cur = slots_[pos];
+        if (r.size <= cur.size) return;
+        bySize_.erase({cur.size, pos});
+        cur.size = r.size;
+        bySize_.insert({cur.size, pos});
+        setLeaf(pos, uint32_t(cur.size) + 1);
+        return;
     }
-    freelist_.push_back(r);
+    if (next_ == leaves()) relayout(std::max<size_t>(16, byRef_.size() * 2 + 1));
+    place(next_++, r);
 }
 
 std::optional<FreeSlotRef> AvailList::acquire(uint16_t needed, FitStrategy strat) {
-    if (freelist_.empty()) return std::nullopt;
-    size_t idx = SIZE_MAX;
+    if (byRef_.empty()) return std::nullopt;
+    std::optional<uint32_t> pos;
     if (strat == FitStrategy::FirstFit) {
-        for (size_t i = 0; i < freelist_.size(); ++i)
-            if (freelist_[i].size >= needed) { idx = i; break; }
+        pos = firstAtLeast(uint32_t(needed) + 1);
     } else if (strat == FitStrategy::BestFit) {
-        uint16_t best = UINT16_MAX;
-        for (size_t i = 0; i < freelist_.size(); ++i) {
-            auto s = freelist_[i].size;
-            if (s >= needed && s < best) { best = s; idx = i; }
-        }
+        auto it = bySize_.lower_bound({needed, 0});
+        if (it != bySize_.end()) pos = it->second;
     } else {
-        uint16_t worst = 0;
-        for (size_t i = 0; i < freelist_.size(); ++i) {
-            auto s = freelist_[i].size;
-            if (s >= needed && s > worst) { worst = s; idx = i; }
-        }
+        // Largest size, oldest among equals; a zero-size slot is never chosen.
+        const uint16_t largest = bySize_.rbegin()->first;
+        if (largest >= needed && largest > 0) pos = bySize_.lower_bound({largest, 0})->second;
     }
-    if (idx == SIZE_MAX) return std::nullopt;
-    auto r = freelist_[idx];
-    freelist_.erase(freelist_.begin() + idx);
+    if (!pos) return std::nullopt;
+    FreeSlotRef r = slots_[*pos];
+    take(*pos);
     return r;
 }
 
 void AvailList::remove(uint32_t pageId, uint16_t slotId) {
-    freelist_.erase(std::remove_if(freelist_.begin(), freelist_.end(),
-                                   [&](const FreeSlotRef& x){ return x.pageId==pageId && x.slotId==slotId; }),
-                    freelist_.end());
+    auto it = byRef_.find(keyOf(pageId, slotId));
+    if (it != byRef_.end()) take(it->second);
+}
+
+std::vector<FreeSlotRef> AvailList::entries() const {
+    std::vector<FreeSlotRef> out;
+    out.reserve(byRef_.size());
+    for (uint32_t i = 0; i < next_; ++i)
+        if (live_[i]) out.push_back(slots_[i]);
+    return out;
+}
+
+void AvailList::assign(const std::vector<FreeSlotRef>& refs) {
+    clear();
+    relayout(std::max<size_t>(16, refs.size() * 2));
+    for (const auto& r : refs) place(next_++, r);
+}
+
+void AvailList::place(uint32_t pos, const FreeSlotRef& r) {
+    slots_[pos] = r;
+    live_[pos] = 1;
+    bySize_.insert({r.size, pos});
+    byRef_[keyOf(r.pageId, r.slotId)] = pos;
+    setLeaf(pos, uint32_t(r.size) + 1);
+}
+
+void AvailList::take(uint32_t pos) {
+    const FreeSlotRef& r = slots_[pos];
+    bySize_.erase({r.size, pos});
+    byRef_.erase(keyOf(r.pageId, r.slotId));
+    live_[pos] = 0;
+    setLeaf(pos, 0);
+}
+
+void AvailList::setLeaf(uint32_t pos, uint32_t v) {
+    size_t i = leaves() + pos;
+    tree_[i] = v;
+    for (i /= 2; i >= 1; i /= 2) tree_[i] = std::max(tree_[2 * i], tree_[2 * i + 1]);
+}
+
+// Leftmost position whose leaf is >= v.
+std::optional<uint32_t> AvailList::firstAtLeast(uint32_t v) const {
+    if (tree_.empty() || tree_[1] < v) return std::nullopt;
+    size_t i = 1;
+    while (i < leaves()) i = (tree_[2 * i] >= v) ? 2 * i : 2 * i + 1;
+    return static_cast<uint32_t>(i - leaves());
+}
+
+// Moves the live entries to positions 0..n-1, keeping their order, in a tree
+// with room for at least `capacity` positions.
+void AvailList::relayout(size_t capacity) {
+    std::vector<FreeSlotRef> keep = entries();
+    size_t n = 1;
+    while (n < capacity) n *= 2;
+
+    slots_.assign(n, FreeSlotRef{});
+    live_.assign(n, 0);
+    tree_.assign(2 * n, 0);
+    bySize_.clear();
+    byRef_.clear();
+    byRef_.reserve(keep.size());
+    next_ = 0;
+    for (const auto& r : keep) place(next_++, r);
 }
 
 }
@@ -2,6 +2,9 @@
 #include <vector>
 #include <cstdint>
 #include <optional>
+#include <set>
+#include <unordered_map>
+#include <utility>
 #include "Page.h"
 
 namespace ma {
@@ -14,16 +17,41 @@ struct FreeSlotRef {
     uint16_t size;
 };
 
+// Free slots in the order they were added. FirstFit takes the oldest slot
+// that fits, BestFit the smallest and WorstFit the largest; ties go to the
+// oldest. Entries live at increasing positions, with a max-size segment tree
+// over the positions for FirstFit, a (size, position) set for Best/WorstFit
+// and a (page, slot) map for add/remove, so every operation is O(log n).
 class AvailList {
 public:
     void clear();
     void add(FreeSlotRef r);
     std::optional<FreeSlotRef> acquire(uint16_t needed, FitStrategy strat);
     void remove(uint32_t pageId, uint16_t slotId);
-    size_t size() const { return freelist_.size(); }
+    size_t size() const { return byRef_.size(); }
+
+    // Whole-list copy in and out, for checkpointing; assign() expects no duplicates.
+    std::vector<FreeSlotRef> entries() const;
+    void assign(const std::vector<FreeSlotRef>& refs);
 
 private:
-    std::vector<FreeSlotRef> freelist_;
+    std::vector<FreeSlotRef> slots_;           // by position; dead ones have live_ == 0
+    std::vector<uint8_t> live_;
+    std::vector<uint32_t> tree_;               // size + 1 of live entries, 0 for dead
+    std::set<std::pair<uint16_t, uint32_t>> bySize_;
+    std::unordered_map<uint64_t, uint32_t> byRef_;
+    uint32_t next_ = 0;
+
+    static uint64_t keyOf(uint32_t pageId, uint16_t slotId) {
+        return (static_cast<uint64_t>(pageId) << 16) | slotId;
+    }
+    size_t leaves() const { return tree_.size() / 2; }
+
+    void place(uint32_t pos, const FreeSlotRef& r);
+    void take(uint32_t pos);
+    void setLeaf(uint32_t pos, uint32_t v);
+    std::optional<uint32_t> firstAtLeast(uint32_t v) const;
+    void relayout(size_t capacity);
 };
 
 }
@@ -0,0 +1,377 @@
+#include "BufferPool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+namespace ma {
+
+BufferPool::BufferPool(size_t frames, EvictionPolicy policy)
+    : capacity_(std::max<size_t>(frames, 8)), policy_(policy) {}
+
+BufferPool::~BufferPool() {
+    std::lock_guard<std::mutex> lk(mu_);
+    for (auto& f : frames_) {
+        if (f->fileId != 0 && f->dirty) {
+            try { writeBack(f.get()); } catch (...) {}
+        }
+    }
+}
+
+BufferPool& BufferPool::shared() {
+    static BufferPool pool;
+    return pool;
+}
+
+void BufferPool::setCapacity(size_t frames) {
+    std::lock_guard<std::mutex> lk(mu_);
+    capacity_ = std::max<size_t>(frames, 8);
+    shrinkToCapacity();
+}
+
+size_t BufferPool::capacity() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return capacity_;
+}
+
+void BufferPool::setPolicy(EvictionPolicy p) {
+    std::lock_guard<std::mutex> lk(mu_);
+    policy_ = p;
+}
+
+EvictionPolicy BufferPool::policy() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return policy_;
+}
+
+uint32_t BufferPool::attach(const std::string& path, PageFile* io, uint32_t pageSize) {
+    std::string key;
+    try {
+        key = std::filesystem::weakly_canonical(std::filesystem::path(path)).string();
+    } catch (...) {
+        key = path;
+    }
+
+    std::lock_guard<std::mutex> lk(mu_);
+    for (auto& [id, fe] : files_) {
+        if (fe.key == key) {
+            if (fe.pageSize != pageSize) throw std::runtime_error("BufferPool: page size differs for " + path);
+            fe.handles.push_back(io);
+            return id;
+        }
+    }
+    uint32_t id = nextFileId_++;
+    if (nextFileId_ == 0) nextFileId_ = 1;
+    FileEntry fe;
+    fe.key = key;
+    fe.handles.push_back(io);
+    fe.pageSize = pageSize;
+    files_.emplace(id, std::move(fe));
+    return id;
+}
+
+void BufferPool::detach(uint32_t fileId, PageFile* io) {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = files_.find(fileId);
+    if (it == files_.end()) return;
+    auto& hs = it->second.handles;
+    if (hs.size() == 1 && hs.front() == io) {
+        dropFrames(fileId, true);
+        files_.erase(it);
+        return;
+    }
+    hs.erase(std::remove(hs.begin(), hs.end(), io), hs.end());
+    if (hs.empty()) {
+        dropFrames(fileId, false);
+        files_.erase(it);
+    }
+}
+
+void BufferPool::discard(uint32_t fileId) {
+    std::lock_guard<std::mutex> lk(mu_);
+    dropFrames(fileId, false);
+}
+
+BufferPool::Frame* BufferPool::pin(uint32_t fileId, uint32_t pageId) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (Frame* f = lookup(fileId, pageId)) {
+        stats_.hits++;
+        lruErase(f);
+        f->pins++;
+        f->ref = true;
+        return f;
+    }
+
+    auto fit = files_.find(fileId);
+    if (fit == files_.end() || fit->second.handles.empty())
+        throw std::runtime_error("BufferPool: file not attached");
+
+    stats_.misses++;
+    Frame* f = grabFrame(fileId);
+    try {
+        load(fit->second, f, pageId);
+    } catch (...) {
+        release(f);
+        throw;
+    }
+    f->fileId = fileId;
+    f->pageId = pageId;
+    f->pins = 1;
+    f->dirty = false;
+    f->ref = true;
+    table_[keyOf(fileId, pageId)] = f;
+    return f;
+}
+
+BufferPool::Frame* BufferPool::pinNew(uint32_t fileId, uint32_t pageId) {
+    std::lock_guard<std::mutex> lk(mu_);
+    Frame* f = lookup(fileId, pageId);
+    if (f) {
+        lruErase(f);
+    } else {
+        f = grabFrame(fileId);
+        f->fileId = fileId;
+        f->pageId = pageId;
+        f->pins = 0;
+        table_[keyOf(fileId, pageId)] = f;
+    }
+    std::memset(f->data, 0, f->size);
+    f->pins++;
+    f->dirty = true;
+    f->ref = true;
+    return f;
+}
+
+void BufferPool::unpin(Frame* f, bool dirty) {
+    if (!f) return;
+    std::lock_guard<std::mutex> lk(mu_);
+    if (dirty) f->dirty = true;
+    if (f->pins > 0) f->pins--;
+    if (f->pins > 0) return;
+
+    if (f->fileId == 0) {
+        release(f);
+        return;
+    }
+    lruPush(f);
+    if (frames_.size() > capacity_) shrinkToCapacity();
+}
+
+void BufferPool::setDirty(Frame* f, bool dirty) {
+    if (!f) return;
+    std::lock_guard<std::mutex> lk(mu_);
+    f->dirty = dirty;
+}
+
+void BufferPool::store(uint32_t fileId, uint32_t pageId, const uint8_t* src, bool dirty) {
+    std::lock_guard<std::mutex> lk(mu_);
+    Frame* f = lookup(fileId, pageId);
+    if (!f) {
+        f = grabFrame(fileId);
+        f->fileId = fileId;
+        f->pageId = pageId;
+        f->pins = 0;
+        table_[keyOf(fileId, pageId)] = f;
+        lruPush(f);
+    } else {
+        touch(f);
+    }
+    std::memcpy(f->data, src, f->size);
+    f->dirty = dirty;
+    f->ref = true;
+}
+
+// Updates a resident copy after the page was written behind the pool's back
+// (e.g. through a mapping). Non-resident pages are left alone.
+void BufferPool::refresh(uint32_t fileId, uint32_t pageId, const uint8_t* src) {
+    std::lock_guard<std::mutex> lk(mu_);
+    Frame* f = lookup(fileId, pageId);
+    if (!f) return;
+    std::memcpy(f->data, src, f->size);
+    f->dirty = false;
+}
+
+void BufferPool::flushFile(uint32_t fileId) {
+    std::lock_guard<std::mutex> lk(mu_);
+    std::vector<Frame*> dirty;
+    for (auto& [k, f] : table_) {
+        if (f->fileId == fileId && f->dirty) dirty.push_back(f);
+    }
+    std::sort(dirty.begin(), dirty.end(), [](const Frame* a, const Frame* b){ return a->pageId < b->pageId; });
+    for (Frame* f : dirty) writeBack(f);
+}
+
+size_t BufferPool::residentFrames() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return table_.size();
+}
+
+BufferPool::Stats BufferPool::stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+void BufferPool::resetStats() {
+    std::lock_guard<std::mutex> lk(mu_);
+    stats_ = Stats{};
+}
+
+BufferPool::Frame* BufferPool::lookup(uint32_t fileId, uint32_t pageId) {
+    auto it = table_.find(keyOf(fileId, pageId));
+    return it == table_.end() ? nullptr : it->second;
+}
+
+// A free, reused or new frame whose buffer fits fileId's page size.
+BufferPool::Frame* BufferPool::grabFrame(uint32_t fileId) {
+    Frame* f = grabAnyFrame();
+    auto it = files_.find(fileId);
+    const uint32_t want = it == files_.end() ? PAGE_SIZE : it->second.pageSize;
+    if (f->size != want) {
+        uint8_t* buf = acquirePageBuffer(want);
+        releasePageBuffer(f->data, f->size);
+        f->data = buf;
+        f->size = want;
+    }
+    return f;
+}
+
+BufferPool::Frame* BufferPool::grabAnyFrame() {
+    if (!free_.empty()) {
+        Frame* f = free_.back();
+        free_.pop_back();
+        return f;
+    }
+    if (frames_.size() < capacity_) {
+        auto f = std::make_unique<Frame>();
+        frames_.push_back(std::move(f));
+        return frames_.back().get();
+    }
+    if (Frame* v = pickVictim()) {
+        if (v->dirty) writeBack(v);
+        lruErase(v);
+        table_.erase(keyOf(v->fileId, v->pageId));
+        v->fileId = 0;
+        v->dirty = false;
+        v->ref = false;
+        stats_.evictions++;
+        return v;
+    }
+    auto f = std::make_unique<Frame>();
+    frames_.push_back(std::move(f));
+    return frames_.back().get();
+}
+
+BufferPool::Frame* BufferPool::pickVictim() {
+    if (!lruHead_) return nullptr;
+    if (policy_ == EvictionPolicy::LRU) return lruHead_;
+
+    const size_t n = frames_.size();
+    for (size_t step = 0; step < 2 * n; ++step) {
+        Frame* f = frames_[clockHand_ % n].get();
+        clockHand_ = (clockHand_ + 1) % n;
+        if (f->fileId == 0 || f->pins > 0) continue;
+        if (f->ref) { f->ref = false; continue; }
+        return f;
+    }
+    return lruHead_;
+}
+
+std::fstream& BufferPool::streamOf(FileEntry& fe) {
+    if (!fe.file.is_open()) {
+        fe.file.open(fe.key, std::ios::binary | std::ios::in | std::ios::out);
+        if (!fe.file) throw std::runtime_error("BufferPool: cannot open " + fe.key);
+    }
+    fe.file.clear();
+    return fe.file;
+}
+
+void BufferPool::load(FileEntry& fe, Frame* f, uint32_t pageId) {
+    std::fstream& io = streamOf(fe);
+    io.seekg(static_cast<std::streamoff>(pageId) * fe.pageSize, std::ios::beg);
+    io.read(reinterpret_cast<char*>(f->data), fe.pageSize);
+    if (!io) throw std::runtime_error("Failed to read page");
+}
+
+// Each write is flushed so handles reading the file directly see it.
+void BufferPool::writeBack(Frame* f) {
+    auto it = files_.find(f->fileId);
+    if (it == files_.end() || it->second.handles.empty())
+        throw std::runtime_error("BufferPool: no writer for dirty frame");
+    std::fstream& io = streamOf(it->second);
+    io.seekp(static_cast<std::streamoff>(f->pageId) * it->second.pageSize, std::ios::beg);
+    io.write(reinterpret_cast<const char*>(f->data), it->second.pageSize);
+    io.flush();
+    if (!io) throw std::runtime_error("Failed to write page");
+    f->dirty = false;
+    stats_.writebacks++;
+}
+
+void BufferPool::release(Frame* f) {
+    f->fileId = 0;
+    f->pins = 0;
+    f->dirty = false;
+    f->ref = false;
+    free_.push_back(f);
+}
+
+void BufferPool::touch(Frame* f) {
+    f->ref = true;
+    if (!f->inLru || f == lruTail_) return;
+    lruErase(f);
+    lruPush(f);
+}
+
+void BufferPool::lruPush(Frame* f) {
+    f->lruPrev = lruTail_;
+    f->lruNext = nullptr;
+    if (lruTail_) lruTail_->lruNext = f;
+    else lruHead_ = f;
+    lruTail_ = f;
+    f->inLru = true;
+}
+
+void BufferPool::lruErase(Frame* f) {
+    if (!f->inLru) return;
+    if (f->lruPrev) f->lruPrev->lruNext = f->lruNext;
+    else lruHead_ = f->lruNext;
+    if (f->lruNext) f->lruNext->lruPrev = f->lruPrev;
+    else lruTail_ = f->lruPrev;
+    f->lruPrev = f->lruNext = nullptr;
+    f->inLru = false;
+}
+
+void BufferPool::dropFrames(uint32_t fileId, bool writeDirty) {
+    for (auto it = table_.begin(); it != table_.end(); ) {
+        Frame* f = it->second;
+        if (f->fileId != fileId) { ++it; continue; }
+        if (writeDirty && f->dirty) writeBack(f);
+        lruErase(f);
+        f->fileId = 0;
+        f->dirty = false;
+        f->ref = false;
+        if (f->pins == 0) free_.push_back(f);
+        it = table_.erase(it);
+    }
+}
+
+void BufferPool::shrinkToCapacity() {
+    if (frames_.size() <= capacity_) return;
+    for (auto it = frames_.begin(); it != frames_.end() && frames_.size() > capacity_; ) {
+        Frame* f = it->get();
+        if (f->pins > 0) { ++it; continue; }
+        if (f->fileId != 0) {
+            if (f->dirty) writeBack(f);
+            lruErase(f);
+            table_.erase(keyOf(f->fileId, f->pageId));
+            stats_.evictions++;
+        }
+        it = frames_.erase(it);
+    }
+    free_.clear();
+    for (auto& f : frames_) {
+        if (f->fileId == 0 && f->pins == 0) free_.push_back(f.get());
+    }
+    clockHand_ = 0;
+}
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "Page.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace ma {
+
+enum class EvictionPolicy { LRU, Clock };
+
+// FlushEveryOp writes and flushes each page as it changes; FlushOnCommit keeps
+// dirty pages in the pool until flush()/close() writes them in page-id order.
+enum class Durability { FlushEveryOp, FlushOnCommit };
+
+// A storage handle attached to a pool file. The pool loads and writes back
+// frames through its own stream on the file, never through a handle: a dirty
+// frame can outlive the handle that dirtied it, other handles may map the file
+// with a different extent, and a handle is not safe to use from another thread.
+class PageFile {
+public:
+    virtual ~PageFile() = default;
+};
+
+// One PAGE_SIZE-aligned cached page. Unpinned frames sit on an intrusive LRU
+// list, so pin/unpin never allocate unless a frame is reused for a file with a
+// different page size. Capacity counts frames, whatever their size.
+struct PoolFrame {
+    uint32_t fileId{};
+    uint32_t pageId{};
+    uint8_t* data{nullptr};
+    uint32_t size{PAGE_SIZE};
+    int  pins{0};
+    bool dirty{false};
+    bool ref{false};
+    bool inLru{false};
+    PoolFrame* lruPrev{nullptr};
+    PoolFrame* lruNext{nullptr};
+
+    PoolFrame() : data(acquirePageBuffer()) {}
+    ~PoolFrame() { releasePageBuffer(data, size); }
+    PoolFrame(const PoolFrame&) = delete;
+    PoolFrame& operator=(const PoolFrame&) = delete;
+};
+
+class BufferPool {
+public:
+    using Frame = PoolFrame;
+
+    struct Stats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t evictions{0};
+        uint64_t writebacks{0};
+    };
+
+    static constexpr size_t DEFAULT_FRAMES = 2048;
+
+    explicit BufferPool(size_t frames = DEFAULT_FRAMES, EvictionPolicy policy = EvictionPolicy::LRU);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    static BufferPool& shared();
+
+    void setCapacity(size_t frames);
+    size_t capacity() const;
+    void setPolicy(EvictionPolicy p);
+    EvictionPolicy policy() const;
+
+    // All handles attached to one file must agree on its page size.
+    uint32_t attach(const std::string& path, PageFile* io, uint32_t pageSize = PAGE_SIZE);
+    void detach(uint32_t fileId, PageFile* io);
+    void discard(uint32_t fileId);
+
+    Frame* pin(uint32_t fileId, uint32_t pageId);
+    Frame* pinNew(uint32_t fileId, uint32_t pageId);
+    void unpin(Frame* f, bool dirty);
+    void setDirty(Frame* f, bool dirty);
+
+    void store(uint32_t fileId, uint32_t pageId, const uint8_t* src, bool dirty);
+    void refresh(uint32_t fileId, uint32_t pageId, const uint8_t* src);
+    void flushFile(uint32_t fileId);
+
+    size_t residentFrames() const;
+    Stats stats() const;
+    void resetStats();
+
+private:
+    struct FileEntry {
+        std::string key;    // canonical path; also what the pool's stream opens
+        std::vector<PageFile*> handles;
+        uint32_t pageSize = PAGE_SIZE;
+        std::fstream file;  // opened on first load or write-back
+    };
+
+    mutable std::mutex mu_;
+    size_t capacity_;
+    EvictionPolicy policy_;
+    std::vector<std::unique_ptr<Frame>> frames_;
+    std::unordered_map<uint64_t, Frame*> table_;
+    Frame* lruHead_{nullptr};
+    Frame* lruTail_{nullptr};
+    std::vector<Frame*> free_;
+    size_t clockHand_{0};
+    std::unordered_map<uint32_t, FileEntry> files_;
+    uint32_t nextFileId_{1};
+    Stats stats_;
+
+    static uint64_t keyOf(uint32_t fileId, uint32_t pageId) {
+        return (static_cast<uint64_t>(fileId) << 32) | pageId;
+    }
+
+    Frame* lookup(uint32_t fileId, uint32_t pageId);
+    Frame* grabFrame(uint32_t fileId);
+    Frame* grabAnyFrame();
+    Frame* pickVictim();
+    std::fstream& streamOf(FileEntry& fe);
+    void load(FileEntry& fe, Frame* f, uint32_t pageId);
+    void writeBack(Frame* f);
+    void release(Frame* f);
+    void touch(Frame* f);
+    void lruPush(Frame* f);
+    void lruErase(Frame* f);
+    void dropFrames(uint32_t fileId, bool writeDirty);
+    void shrinkToCapacity();
+};
+
+}
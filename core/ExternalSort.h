@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ma {
+
+// Sorts fixed-size records that may not fit in memory. Records are buffered up
+// to memoryBytes, each full buffer is sorted and spilled to a run file next to
+// runBase, and next() merges the runs. Nothing touches disk if everything fits.
+template <class T, class Less>
+class ExternalSorter {
+    static_assert(std::is_trivially_copyable<T>::value, "ExternalSorter needs trivially copyable records");
+public:
+    ExternalSorter(std::string runBase, Less less = Less(), size_t memoryBytes = 64u << 20)
+        : runBase_(std::move(runBase)), less_(less),
+          maxBuffered_(std::max<size_t>(1, memoryBytes / sizeof(T))) {}
+
+    ~ExternalSorter() { removeRuns(); }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(const T& v) {
+        if (finished_) throw std::runtime_error("ExternalSorter: add after finish");
+        buf_.push_back(v);
+        ++count_;
+        if (buf_.size() >= maxBuffered_) spill();
+    }
+
+    uint64_t count() const { return count_; }
+
+    void finish() {
+        if (finished_) return;
+        finished_ = true;
+        if (runs_.empty()) {
+            std::sort(buf_.begin(), buf_.end(), less_);
+            return;
+        }
+        spill();
+        std::vector<T>().swap(buf_);
+        for (size_t i = 0; i < runs_.size(); ++i) {
+            auto& r = runs_[i];
+            r.in = std::make_unique<std::ifstream>(r.path, std::ios::binary);
+            if (!*r.in) throw std::runtime_error("ExternalSorter: cannot read run " + r.path);
+            if (readOne(r)) heap_.push(i);
+        }
+    }
+
+    // Next record in sorted order; false once all records have been returned.
+    bool next(T& out) {
+        if (!finished_) finish();
+        if (runs_.empty()) {
+            if (pos_ >= buf_.size()) return false;
+            out = buf_[pos_++];
+            return true;
+        }
+        if (heap_.empty()) return false;
+        size_t i = heap_.top();
+        heap_.pop();
+        out = runs_[i].head;
+        if (readOne(runs_[i])) heap_.push(i);
+        return true;
+    }
+
+private:
+    struct Run {
+        std::string path;
+        std::unique_ptr<std::ifstream> in;
+        T head{};
+    };
+    struct HeapLess {
+        const ExternalSorter* s;
+        bool operator()(size_t a, size_t b) const { return s->less_(s->runs_[b].head, s->runs_[a].head); }
+    };
+
+    std::string runBase_;
+    Less less_;
+    size_t maxBuffered_;
+    std::vector<T> buf_;
+    size_t pos_ = 0;
+    uint64_t count_ = 0;
+    bool finished_ = false;
+    std::vector<Run> runs_;
+    std::priority_queue<size_t, std::vector<size_t>, HeapLess> heap_{HeapLess{this}};
+
+    void spill() {
+        if (buf_.empty()) return;
+        std::sort(buf_.begin(), buf_.end(), less_);
+        Run r;
+        r.path = runBase_ + ".run" + std::to_string(runs_.size());
+        std::ofstream out(r.path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("ExternalSorter: cannot write run " + r.path);
+        out.write(reinterpret_cast<const char*>(buf_.data()), static_cast<std::streamsize>(buf_.size() * sizeof(T)));
+        if (!out) throw std::runtime_error("ExternalSorter: write failed " + r.path);
+        runs_.push_back(std::move(r));
+        buf_.clear();
+    }
+
+    bool readOne(Run& r) {
+        r.in->read(reinterpret_cast<char*>(&r.head), sizeof(T));
+        return r.in->gcount() == static_cast<std::streamsize>(sizeof(T));
+    }
+
+    void removeRuns() {
+        for (auto& r : runs_) {
+            r.in.reset();
+            std::remove(r.path.c_str());
+        }
+        runs_.clear();
+    }
+};
+
+}
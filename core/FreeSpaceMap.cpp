@@ -0,0 +1,77 @@
+#include "FreeSpaceMap.h"
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+namespace ma {
+
+uint8_t FreeSpaceMap::categoryOf(size_t freeBytes) const {
+    return static_cast<uint8_t>(std::min<size_t>(freeBytes / unit_, 255));
+}
+
+void FreeSpaceMap::clear() {
+    cat_.clear();
+    groupMax_.clear();
+}
+
+void FreeSpaceMap::resize(uint32_t pageCount) {
+    if (pageCount == cat_.size()) return;
+    cat_.resize(pageCount, 0);
+    groupMax_.resize((pageCount + GROUP_PAGES - 1) / GROUP_PAGES, 0);
+    if (!groupMax_.empty()) refreshGroup(groupMax_.size() - 1);
+}
+
+void FreeSpaceMap::set(uint32_t pageId, size_t freeBytes) {
+    if (pageId >= cat_.size()) resize(pageId + 1);
+    const uint8_t c = categoryOf(freeBytes);
+    const uint8_t old = cat_[pageId];
+    if (c == old) return;
+    cat_[pageId] = c;
+    const size_t g = pageId / GROUP_PAGES;
+    if (c > groupMax_[g]) groupMax_[g] = c;
+    else if (old == groupMax_[g]) refreshGroup(g);
+}
+
+void FreeSpaceMap::refreshGroup(size_t g) {
+    const size_t b = g * GROUP_PAGES;
+    const size_t e = std::min(cat_.size(), b + GROUP_PAGES);
+    uint8_t m = 0;
+    for (size_t i = b; i < e; ++i) m = std::max(m, cat_[i]);
+    groupMax_[g] = m;
+}
+
+std::optional<uint32_t> FreeSpaceMap::find(size_t need) const {
+    const size_t want = (need + unit_ - 1) / unit_;
+    if (want > 255) return std::nullopt;
+    const uint8_t c = static_cast<uint8_t>(std::max<size_t>(want, 1));
+    for (size_t g = 0; g < groupMax_.size(); ++g) {
+        if (groupMax_[g] < c) continue;
+        const size_t b = std::max<size_t>(g * GROUP_PAGES, 1);
+        const size_t e = std::min(cat_.size(), g * GROUP_PAGES + GROUP_PAGES);
+        for (size_t i = b; i < e; ++i)
+            if (cat_[i] >= c) return static_cast<uint32_t>(i);
+    }
+    return std::nullopt;
+}
+
+void FreeSpaceMap::write(std::ostream& out) const {
+    uint32_t n = static_cast<uint32_t>(cat_.size());
+    out.write(reinterpret_cast<const char*>(&n), 4);
+    out.write(reinterpret_cast<const char*>(cat_.data()), n);
+}
+
+bool FreeSpaceMap::read(std::istream& in) {
+    uint32_t n = 0;
+    in.read(reinterpret_cast<char*>(&n), 4);
+    if (!in) return false;
+    std::vector<uint8_t> cat(n);
+    in.read(reinterpret_cast<char*>(cat.data()), n);
+    if (!in) return false;
+
+    cat_ = std::move(cat);
+    groupMax_.assign((cat_.size() + GROUP_PAGES - 1) / GROUP_PAGES, 0);
+    for (size_t g = 0; g < groupMax_.size(); ++g) refreshGroup(g);
+    return true;
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <vector>
+
+namespace ma {
+
+// One byte per data page holding its contiguous free space in units of
+// pageSize / 256 (at least UNIT bytes), rounded down, plus the largest entry of every group of pages so a lookup
+// skips full stretches of the file. Entries are hints: callers re-check the
+// page and correct the entry when it was stale.
+class FreeSpaceMap {
+public:
+    static constexpr uint32_t GROUP_PAGES = 256;
+    static constexpr uint32_t UNIT = 16;
+
+    // Sets the unit; call before any entries are recorded.
+    void setPageSize(uint32_t pageSize) { unit_ = std::max<uint32_t>(UNIT, pageSize / 256); }
+
+    void clear();
+    void resize(uint32_t pageCount);
+    uint32_t pageCount() const { return static_cast<uint32_t>(cat_.size()); }
+
+    void set(uint32_t pageId, size_t freeBytes);
+    // Lowest data page (id >= 1) recorded with at least `need` free bytes.
+    std::optional<uint32_t> find(size_t need) const;
+
+    // Entry count followed by the entries; read() fails on a short stream.
+    void write(std::ostream& out) const;
+    bool read(std::istream& in);
+
+private:
+    std::vector<uint8_t> cat_;
+    std::vector<uint8_t> groupMax_;
+    uint32_t unit_ = UNIT;
+
+    uint8_t categoryOf(size_t freeBytes) const;
+
+    void refreshGroup(size_t g);
+};
+
+}
@@ -0,0 +1,195 @@
+#include "MappedFile.h"
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace ma {
+
+MappedFile::~MappedFile() {
+    try { close(pages()); } catch (...) {}
+}
+
+bool MappedFile::isOpen() const {
+#ifdef _WIN32
+    return handle_ != nullptr;
+#else
+    return fd_ >= 0;
+#endif
+}
+
+void MappedFile::open(const std::string& path, uint32_t pageSize, bool readOnly) {
+    if (isOpen()) close(pages());
+    path_ = path;
+    pageSize_ = pageSize;
+    readOnly_ = readOnly;
+#ifdef _WIN32
+    HANDLE h = CreateFileW(std::filesystem::path(path_).c_str(),
+                           readOnly_ ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot open file for mapping: " + path_);
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(h, &sz)) { CloseHandle(h); throw std::runtime_error("Cannot stat file: " + path_); }
+    handle_ = h;
+    fileBytes_ = static_cast<uint64_t>(sz.QuadPart);
+#else
+    fd_ = ::open(path_.c_str(), readOnly_ ? O_RDONLY : O_RDWR);
+    if (fd_ < 0) throw std::runtime_error("Cannot open file for mapping: " + path_);
+    struct stat st{};
+    if (fstat(fd_, &st) != 0) { ::close(fd_); fd_ = -1; throw std::runtime_error("Cannot stat file: " + path_); }
+    fileBytes_ = static_cast<uint64_t>(st.st_size);
+#endif
+    fileBytes_ -= fileBytes_ % pageSize_;
+    openBytes_ = fileBytes_;
+    grown_ = false;
+    mapRange();
+}
+
+void MappedFile::close(uint32_t keepPages) {
+    if (!isOpen()) return;
+    const uint64_t bytes = trimTarget(static_cast<uint64_t>(keepPages) * pageSize_);
+    const bool trim = bytes < fileBytes_;
+    unmapAll();
+    fileBytes_ = 0;
+    openBytes_ = 0;
+    grown_ = false;
+#ifdef _WIN32
+    if (trim) {
+        LARGE_INTEGER pos;
+        pos.QuadPart = static_cast<LONGLONG>(bytes);
+        if (SetFilePointerEx(handle_, pos, nullptr, FILE_BEGIN)) SetEndOfFile(handle_);
+    }
+    CloseHandle(handle_);
+    handle_ = nullptr;
+#else
+    const bool ok = !trim || ftruncate(fd_, static_cast<off_t>(bytes)) == 0;
+    ::close(fd_);
+    fd_ = -1;
+    if (!ok) throw std::runtime_error("Failed to trim mapped file: " + path_);
+#endif
+}
+
+// Where close() may cut the file: past keepBytes and the size at open, and
+// past the last page holding anything. Returns fileBytes_ for no trim.
+uint64_t MappedFile::trimTarget(uint64_t keepBytes) const {
+    if (!grown_) return fileBytes_;
+#ifdef _WIN32
+    LARGE_INTEGER sz;
+    if (!GetFileSizeEx(handle_, &sz) || static_cast<uint64_t>(sz.QuadPart) != fileBytes_) return fileBytes_;
+#else
+    struct stat st{};
+    if (fstat(fd_, &st) != 0 || static_cast<uint64_t>(st.st_size) != fileBytes_) return fileBytes_;
+#endif
+    const uint64_t lowest = std::max(keepBytes, openBytes_);
+    uint64_t end = fileBytes_;
+    while (end > lowest) {
+        const auto* w = reinterpret_cast<const uint64_t*>(page(static_cast<uint32_t>(end / pageSize_ - 1)));
+        if (std::any_of(w, w + pageSize_ / sizeof(uint64_t), [](uint64_t x) { return x != 0; })) break;
+        end -= pageSize_;
+    }
+    return end;
+}
+
+void MappedFile::ensurePages(uint32_t pages) {
+    const uint64_t need = static_cast<uint64_t>(pages) * pageSize_;
+    if (need <= fileBytes_) return;
+    if (readOnly_) throw std::runtime_error("Mapped file is read-only: " + path_);
+    const uint64_t grownTo = (need + extentBytes() - 1) / extentBytes() * extentBytes();
+#ifndef _WIN32
+    if (ftruncate(fd_, static_cast<off_t>(grownTo)) != 0)
+        throw std::runtime_error("Failed to grow mapped file: " + path_);
+#endif
+    fileBytes_ = grownTo;
+    grown_ = true;
+    mapRange();
+}
+
+// Maps every extent that overlaps the file. On POSIX a view may run past EOF,
+// so extents are always mapped whole. Windows cannot map past EOF, so a
+// partial tail extent is remapped once the file grows; the old view is kept
+// until close so pointers into it stay valid.
+void MappedFile::mapRange() {
+    const uint32_t count = static_cast<uint32_t>((fileBytes_ + extentBytes() - 1) / extentBytes());
+    for (uint32_t i = 0; i < count; ++i) {
+#ifdef _WIN32
+        const uint64_t want = std::min<uint64_t>(extentBytes(), fileBytes_ - static_cast<uint64_t>(i) * extentBytes());
+#else
+        const uint64_t want = extentBytes();
+#endif
+        if (i < extents_.size()) {
+            if (extents_[i].bytes >= want) continue;
+            retired_.push_back(extents_[i]);
+            extents_[i] = mapExtent(i, want);
+        } else {
+            extents_.push_back(mapExtent(i, want));
+        }
+    }
+}
+
+MappedFile::Extent MappedFile::mapExtent(uint32_t index, uint64_t bytes) {
+    const uint64_t offset = static_cast<uint64_t>(index) * extentBytes();
+    Extent e;
+    e.bytes = bytes;
+#ifdef _WIN32
+    const uint64_t end = offset + bytes;
+    HANDLE m = CreateFileMappingW(handle_, nullptr, readOnly_ ? PAGE_READONLY : PAGE_READWRITE,
+                                  static_cast<DWORD>(end >> 32), static_cast<DWORD>(end), nullptr);
+    if (!m) throw std::runtime_error("Failed to map file: " + path_);
+    void* base = MapViewOfFile(m, readOnly_ ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS,
+                               static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset),
+                               static_cast<SIZE_T>(bytes));
+    if (!base) { CloseHandle(m); throw std::runtime_error("Failed to map file: " + path_); }
+    e.mapping = m;
+    e.base = static_cast<uint8_t*>(base);
+#else
+    const int prot = readOnly_ ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* base = mmap(nullptr, bytes, prot, MAP_SHARED, fd_, static_cast<off_t>(offset));
+    if (base == MAP_FAILED) throw std::runtime_error("Failed to map file: " + path_);
+    e.base = static_cast<uint8_t*>(base);
+#endif
+    return e;
+}
+
+void MappedFile::unmapExtent(Extent& e) {
+#ifdef _WIN32
+    UnmapViewOfFile(e.base);
+    CloseHandle(static_cast<HANDLE>(e.mapping));
+#else
+    munmap(e.base, e.bytes);
+#endif
+    e.base = nullptr;
+}
+
+void MappedFile::unmapAll() {
+    for (auto& e : extents_) unmapExtent(e);
+    for (auto& e : retired_) unmapExtent(e);
+    extents_.clear();
+    retired_.clear();
+}
+
+void MappedFile::sync() {
+    for (auto& e : extents_) {
+#ifdef _WIN32
+        if (!FlushViewOfFile(e.base, static_cast<SIZE_T>(e.bytes))) throw std::runtime_error("Failed to sync mapped file: " + path_);
+#else
+        if (msync(e.base, e.bytes, MS_SYNC) != 0) throw std::runtime_error("Failed to sync mapped file: " + path_);
+#endif
+    }
+#ifdef _WIN32
+    FlushFileBuffers(handle_);
+#endif
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Page.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ma {
+
+enum class StorageBackend { Stream, Mapped };
+
+// Maps a page file in fixed-size extents. Each extent is a separate view, so
+// growing the file never moves pages that are already mapped. The file is only
+// extended when a page past its end is requested, one extent at a time, and
+// on close the slack is trimmed again down to keepPages. Other handles may
+// write the same file, so only pages this handle added and nobody has written
+// since (still all zero) are cut, and nothing if the file changed size.
+// A read-only map never grows, trims or writes the file.
+class MappedFile {
+public:
+    static constexpr uint32_t EXTENT_PAGES = 256;
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void open(const std::string& path, uint32_t pageSize, bool readOnly = false);
+    void close(uint32_t keepPages);
+    bool isOpen() const;
+
+    void ensurePages(uint32_t pages);
+    uint32_t pages() const { return static_cast<uint32_t>(fileBytes_ / pageSize_); }
+    uint32_t pageSize() const { return pageSize_; }
+
+    uint8_t* page(uint32_t pageId) {
+        return extents_[pageId / EXTENT_PAGES].base + static_cast<size_t>(pageId % EXTENT_PAGES) * pageSize_;
+    }
+    const uint8_t* page(uint32_t pageId) const {
+        return extents_[pageId / EXTENT_PAGES].base + static_cast<size_t>(pageId % EXTENT_PAGES) * pageSize_;
+    }
+
+    void sync();
+
+private:
+    struct Extent {
+        uint8_t* base = nullptr;
+        void* mapping = nullptr;
+        uint64_t bytes = 0;
+    };
+
+    std::string path_;
+    std::vector<Extent> extents_;
+    std::vector<Extent> retired_;
+    uint64_t fileBytes_ = 0;
+    uint64_t openBytes_ = 0;   // size when opened; close() never trims below it
+    uint32_t pageSize_ = PAGE_SIZE;
+    bool grown_ = false;
+    bool readOnly_ = false;
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+    uint64_t extentBytes() const { return static_cast<uint64_t>(EXTENT_PAGES) * pageSize_; }
+    void mapRange();
+    Extent mapExtent(uint32_t index, uint64_t bytes);
+    void unmapExtent(Extent& e);
+    void unmapAll();
+    uint64_t trimTarget(uint64_t keepBytes) const;
+};
+
+}
@@ -1,37 +1,123 @@
 #include "Page.h"
+#include "BufferPool.h"
 #include <cstring>
+#include <mutex>
+#include <new>
 
 namespace ma {
 
-Page::Page() {
-    bytes.resize(PAGE_SIZE, 0);
-    hdr.pageId = 0;
-    hdr.slotCount = 0;
-    hdr.freeStart = sizeof(PageHeader);
-    hdr.freeEnd = PAGE_SIZE;
-    hdr.flags = 0;
-    std::memcpy(bytes.data(), &hdr, sizeof(PageHeader));
+namespace {
+constexpr size_t MAX_FREE_BUFS = 64;
+
+struct FreeBuffers {
+    std::mutex mu;
+    std::vector<uint8_t*> bufs;
+    bool alive = true;
+    ~FreeBuffers() {
+        std::lock_guard<std::mutex> lk(mu);
+        for (uint8_t* b : bufs) ::operator delete(b, std::align_val_t(PAGE_SIZE));
+        bufs.clear();
+        alive = false;
+    }
+};
+FreeBuffers g_free;
+}
+
+uint8_t* acquirePageBuffer(uint32_t bytes) {
+    if (bytes != PAGE_SIZE) return static_cast<uint8_t*>(::operator new(bytes, std::align_val_t(PAGE_SIZE)));
+    {
+        std::lock_guard<std::mutex> lk(g_free.mu);
+        if (!g_free.bufs.empty()) {
+            uint8_t* b = g_free.bufs.back();
+            g_free.bufs.pop_back();
+            return b;
+        }
+    }
+    return static_cast<uint8_t*>(::operator new(PAGE_SIZE, std::align_val_t(PAGE_SIZE)));
+}
+
+void releasePageBuffer(uint8_t* buf, uint32_t bytes) {
+    if (!buf) return;
+    if (bytes == PAGE_SIZE) {
+        std::lock_guard<std::mutex> lk(g_free.mu);
+        if (g_free.alive && g_free.bufs.size() < MAX_FREE_BUFS) {
+            g_free.bufs.push_back(buf);
+            return;
+        }
+    }
+    ::operator delete(buf, std::align_val_t(PAGE_SIZE));
+}
+
+Page::Page() : data_(acquirePageBuffer()), owned_(true) {
+    std::memset(data_, 0, PAGE_SIZE);
+    PageHeader& h = hdr();
+    h.pageId = 0;
+    h.slotCount = 0;
+    h.freeStart = sizeof(PageHeader);
+    h.freeEnd = PAGE_SIZE;
+    h.flags = 0;
+}
+
+Page::Page(uint32_t pageId, uint8_t* data, uint32_t size, BufferPool* pool, PoolFrame* frame)
+    : data_(data), pageId_(pageId), size_(size), pool_(pool), frame_(frame) {}
+
+Page::~Page() {
+    release();
+}
+
+Page::Page(Page&& o) noexcept
+    : data_(o.data_), pageId_(o.pageId_), size_(o.size_), pool_(o.pool_), frame_(o.frame_), owned_(o.owned_) {
+    o.data_ = nullptr;
+    o.pool_ = nullptr;
+    o.frame_ = nullptr;
+    o.owned_ = false;
+}
+
+Page& Page::operator=(Page&& o) noexcept {
+    if (this == &o) return *this;
+    release();
+    data_ = o.data_;
+    pageId_ = o.pageId_;
+    size_ = o.size_;
+    pool_ = o.pool_;
+    frame_ = o.frame_;
+    owned_ = o.owned_;
+    o.data_ = nullptr;
+    o.pool_ = nullptr;
+    o.frame_ = nullptr;
+    o.owned_ = false;
+    return *this;
+}
+
+void Page::release() {
+    if (frame_) pool_->unpin(frame_, false);
+    else if (owned_) releasePageBuffer(data_);
+    data_ = nullptr;
+    pool_ = nullptr;
+    frame_ = nullptr;
+    owned_ = false;
 }
 
 size_t Page::freeSpace() const {
-    if (hdr.freeEnd < hdr.freeStart) return 0;
-    size_t cfree = static_cast<size_t>(hdr.freeEnd) - static_cast<size_t>(hdr.freeStart);
+    const PageHeader& h = hdr();
+    if (h.freeEnd < h.freeStart) return 0;
+    size_t cfree = static_cast<size_t>(h.freeEnd) - static_cast<size_t>(h.freeStart);
     if (cfree < sizeof(Slot)) return 0;
     return cfree - sizeof(Slot);
 }
 
 Slot Page::getSlot(uint16_t idx) const {
-    if (idx >= hdr.slotCount) throw std::runtime_error("Slot index out of range");
-    size_t pos = PAGE_SIZE - sizeof(Slot) * (static_cast<size_t>(idx) + 1);
+    if (idx >= hdr().slotCount) throw std::runtime_error("Slot index out of range");
+    size_t pos = pageEnd(size_) - sizeof(Slot) * (static_cast<size_t>(idx) + 1);
     Slot s{};
-    std::memcpy(&s, bytes.data() + pos, sizeof(Slot));
+    std::memcpy(&s, data_ + pos, sizeof(Slot));
     return s;
 }
 
 void Page::setSlot(uint16_t idx, const Slot& s) {
-    if (idx > hdr.slotCount) throw std::runtime_error("Slot set: out of range");
-    size_t pos = PAGE_SIZE - sizeof(Slot) * (static_cast<size_t>(idx) + 1);
-    std::memcpy(bytes.data() + pos, &s, sizeof(Slot));
+    if (idx > hdr().slotCount) throw std::runtime_error("Slot set: out of range");
+    size_t pos = pageEnd(size_) - sizeof(Slot) * (static_cast<size_t>(idx) + 1);
+    std::memcpy(data_ + pos, &s, sizeof(Slot));
 }
 
 }
@@ -2,10 +2,18 @@
 #include <cstdint>
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
 
 namespace ma {
 
+// Page size is a property of each file, chosen when it is created: a power of
+// two from PAGE_SIZE (the default) up to MAX_PAGE_SIZE.
 constexpr uint32_t PAGE_SIZE = 4096;
+constexpr uint32_t MAX_PAGE_SIZE = 65536;
+inline bool validPageSize(uint32_t s) { return s >= PAGE_SIZE && s <= MAX_PAGE_SIZE && (s & (s - 1)) == 0; }
+// In-page offsets are 16 bits, so a 64 KB page ends its slot directory four
+// bytes short of the page end.
+inline uint32_t pageEnd(uint32_t pageSize) { return std::min<uint32_t>(pageSize, 0xFFFC); }
 
 #pragma pack(push,1)
 struct PageHeader {
@@ -22,19 +30,96 @@ struct Slot {
 };
 #pragma pack(pop)
 
+// PageHeader::flags
+constexpr uint8_t PAGE_FREE  = 0x01; // on the storage free-page chain
+constexpr uint8_t PAGE_HOLES = 0x02; // has free zero-length slots left by compaction
+constexpr uint8_t PAGE_MOVED = 0x04; // holds only rows relocated out of their home page
+constexpr uint8_t PAGE_OVERFLOW = 0x08; // one link of a spilled String value's chain
+
+// A free page never holds slots; a set flag with slots means an older build
+// wrote rows into it, and it is treated as a data page.
+inline bool pageIsFree(const PageHeader& h) { return (h.flags & PAGE_FREE) != 0 && h.slotCount == 0; }
+
 inline bool slotIsFree(const Slot& s) { return (s.length & 0x8000u) != 0; }
 inline uint16_t slotLen(const Slot& s) { return (s.length & 0x7FFFu); }
 inline void markSlotFree(Slot& s) { s.length = s.length | 0x8000u; }
 inline void markSlotUsed(Slot& s) { s.length = s.length & 0x7FFFu; }
 
-struct Page {
-    PageHeader hdr;
-    std::vector<uint8_t> bytes;
+// A row that outgrows its page moves to a PAGE_MOVED page, prefixed with its
+// home RID, and its home slot becomes a forwarding stub: a live zero-length
+// slot whose STUB_BYTES at offset hold the RID of the moved copy. The home
+// RID stays the row's identity.
+constexpr uint16_t STUB_BYTES = 6;
+constexpr uint16_t MOVED_PREFIX = 6;
+inline bool slotIsStub(const Slot& s) { return !slotIsFree(s) && slotLen(s) == 0 && s.offset != 0; }
+inline bool slotIsLive(const Slot& s) { return !slotIsFree(s) && (slotLen(s) > 0 || s.offset != 0); }
+inline uint16_t slotBytes(const Slot& s) { return slotIsStub(s) ? STUB_BYTES : slotLen(s); }
+
+// Rows whose serialized form would pass ROW_INLINE_LIMIT spill their longest
+// String values to chains of overflow pages in a file of their own. An
+// overflow page has no slots; an OverflowHeader follows the page header and
+// the value's bytes follow it.
+#pragma pack(push,1)
+struct OverflowHeader {
+    uint32_t next;   // next page of the chain, 0 at the end
+    uint16_t used;   // value bytes on this page
+};
+#pragma pack(pop)
+inline uint32_t overflowCapacity(uint32_t pageSize) {
+    return pageEnd(pageSize) - sizeof(PageHeader) - sizeof(OverflowHeader);
+}
+inline uint32_t rowInlineLimit(uint32_t pageSize) { return pageSize / 4; }
+
+// PAGE_SIZE-aligned page buffers of the given size. Released default-size
+// buffers are kept on a free list so short-lived pages do not hit the
+// allocator.
+uint8_t* acquirePageBuffer(uint32_t bytes = PAGE_SIZE);
+void releasePageBuffer(uint8_t* buf, uint32_t bytes = PAGE_SIZE);
+
+class BufferPool;
+struct PoolFrame;
 
+// Handle to one page's bytes. A page read from storage is a view onto a pinned
+// buffer pool frame or onto the mapped file; edits are made in place and become
+// durable once passed to writePage(). hdr() is a view over the first bytes.
+// Move-only; the frame is unpinned when the handle goes away.
+class Page {
+public:
     Page();
+    ~Page();
+
+    Page(Page&& o) noexcept;
+    Page& operator=(Page&& o) noexcept;
+    Page(const Page&) = delete;
+    Page& operator=(const Page&) = delete;
+
+    uint32_t pageId() const { return pageId_; }
+    uint32_t size() const { return size_; }
+
+    PageHeader& hdr() { return *reinterpret_cast<PageHeader*>(data_); }
+    const PageHeader& hdr() const { return *reinterpret_cast<const PageHeader*>(data_); }
+
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+
     size_t freeSpace() const;
     Slot getSlot(uint16_t idx) const;
     void setSlot(uint16_t idx, const Slot& s);
+
+private:
+    friend class Storage;
+    friend class IndexStorage;
+
+    Page(uint32_t pageId, uint8_t* data, uint32_t size, BufferPool* pool, PoolFrame* frame);
+
+    uint8_t* data_ = nullptr;
+    uint32_t pageId_ = 0;
+    uint32_t size_ = PAGE_SIZE;
+    BufferPool* pool_ = nullptr;
+    PoolFrame* frame_ = nullptr;
+    bool owned_ = false;
+
+    void release();
 };
 
 }
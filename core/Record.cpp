@@ -1,5 +1,6 @@
 #include "Record.h"
 #include <stdexcept>
+#include <algorithm>
 
 namespace ma {
 
@@ -10,9 +11,7 @@ static inline bool getBit(const uint8_t* buf, size_t bitIndex) {
     return (buf[bitIndex / 8] >> (bitIndex % 8)) & 1u;
 }
 
-std::vector<uint8_t> Serializer::serialize(const Schema& schema, const Record& rec) {
-    if (rec.values.size() != schema.fields.size())
-        throw std::runtime_error("Record field count mismatch");
+static std::vector<uint8_t> serializePacked(const Schema& schema, const Record& rec) {
     std::vector<uint8_t> out;
     size_t n = schema.fields.size();
     size_t nb = schema.nullBitmapBytes();
@@ -87,76 +86,403 @@ std::vector<uint8_t> Serializer::serialize(const Schema& schema, const Record& r
     return out;
 }
 
-Record Serializer::deserialize(const Schema& schema, const uint8_t* data, size_t len) {
-    size_t n = schema.fields.size();
-    size_t nb = schema.nullBitmapBytes();
-    if (len < nb) throw std::runtime_error("Corrupt record (null-bitmap too short)");
-    Record r = Record::withFieldCount(n);
-    const uint8_t* p = data;
-    const uint8_t* pend = data + len;
+// Width of a field's slot in a format-2 record.
+static size_t slotWidth(const Field& fld) {
+    switch (fld.type) {
+    case FieldType::Int32:
+    case FieldType::Date:     return 4;
+    case FieldType::Double:
+    case FieldType::Currency: return 8;
+    case FieldType::Bool:     return 1;
+    case FieldType::CharN:    return fld.size;
+    case FieldType::String:   return 4;
+    }
+    throw std::runtime_error("Unknown field type");
+}
 
-    for (size_t i = 0; i < n; ++i) {
-        bool isNull = getBit(p, i);
-        if (isNull) r.values[i] = std::nullopt;
+RecordLayout RecordLayout::of(const Schema& schema) {
+    RecordLayout l;
+    l.nullBytes = schema.nullBitmapBytes();
+    l.offsets.reserve(schema.fields.size());
+    size_t off = l.nullBytes;
+    for (const auto& f : schema.fields) {
+        l.offsets.push_back(static_cast<uint32_t>(off));
+        off += slotWidth(f);
+    }
+    l.fixedBytes = off;
+    return l;
+}
+
+template<class T>
+static const T& typed(const Value& v, const char* what) {
+    if (!std::holds_alternative<T>(v)) throw std::runtime_error(what);
+    return std::get<T>(v);
+}
+
+// Writes a fixed-width value into its slot at dst (slotWidth(fld) bytes).
+static void encodeFixed(const Field& fld, const Value& v, uint8_t* dst) {
+    switch (fld.type) {
+    case FieldType::Int32: {
+        int32_t x = typed<int32_t>(v, "Type mismatch Int32");
+        std::memcpy(dst, &x, 4);
+        break;
+    }
+    case FieldType::Double: {
+        double x = typed<double>(v, "Type mismatch Double");
+        std::memcpy(dst, &x, 8);
+        break;
     }
-    p += nb;
+    case FieldType::Bool:
+        *dst = typed<bool>(v, "Type mismatch Bool") ? 1 : 0;
+        break;
+    case FieldType::CharN: {
+        const std::string& s = typed<std::string>(v, "Type mismatch CharN");
+        if (s.size() > fld.size) throw std::runtime_error("CharN overflow");
+        std::memcpy(dst, s.data(), s.size());
+        std::memset(dst + s.size(), 0, fld.size - s.size());
+        break;
+    }
+    case FieldType::Date: {
+        int32_t x = typed<int32_t>(v, "Type mismatch Date (int32 yyyymmdd)");
+        std::memcpy(dst, &x, 4);
+        break;
+    }
+    case FieldType::Currency: {
+        int64_t x = typed<int64_t>(v, "Type mismatch Currency (int64 minor units)");
+        std::memcpy(dst, &x, 8);
+        break;
+    }
+    case FieldType::String:
+        throw std::runtime_error("String is not fixed-width");
+    }
+}
 
+// High bit of a String slot's offset: the value was spilled.
+constexpr uint16_t SPILLED = 0x8000;
+
+static std::vector<uint8_t> serializeSlotted(const Schema& schema, const Record& rec,
+                                             size_t inlineLimit, const OverflowWriter* spill) {
+    const RecordLayout l = RecordLayout::of(schema);
+    const size_t n = schema.fields.size();
+    std::vector<uint8_t> out(l.fixedBytes, 0);
+    std::vector<const std::string*> strs(n, nullptr);
+    size_t total = l.fixedBytes;
     for (size_t i = 0; i < n; ++i) {
-        if (getBit(data, i)) { // null
-            r.values[i] = std::nullopt;
-            continue;
-        }
+        if (!rec.values[i].has_value()) { setBit(out.data(), i); continue; }
         const auto& fld = schema.fields[i];
-        switch (fld.type) {
-        case FieldType::Int32: {
-            if (p + 4 > pend) throw std::runtime_error("Corrupt record (Int32)");
-            int32_t x; std::memcpy(&x, p, 4); p += 4;
-            r.values[i] = x;
-            break;
-        }
-        case FieldType::Double: {
-            if (p + 8 > pend) throw std::runtime_error("Corrupt record (Double)");
-            double x; std::memcpy(&x, p, 8); p += 8;
-            r.values[i] = x;
-            break;
-        }
-        case FieldType::Bool: {
-            if (p + 1 > pend) throw std::runtime_error("Corrupt record (Bool)");
-            bool x = (*p != 0); p += 1;
-            r.values[i] = x;
-            break;
-        }
-        case FieldType::CharN: {
-            if (p + fld.size > pend) throw std::runtime_error("Corrupt record (CharN)");
-            std::string s(reinterpret_cast<const char*>(p), reinterpret_cast<const char*>(p + fld.size));
-            while (!s.empty() && s.back() == '\0') s.pop_back();
-            p += fld.size;
-            r.values[i] = s;
-            break;
-        }
-        case FieldType::String: {
-            if (p + 2 > pend) throw std::runtime_error("Corrupt record (String len)");
-            uint16_t L; std::memcpy(&L, p, 2); p += 2;
-            if (p + L > pend) throw std::runtime_error("Corrupt record (String data)");
-            std::string s(reinterpret_cast<const char*>(p), reinterpret_cast<const char*>(p + L)); p += L;
-            r.values[i] = s;
-            break;
+        const Value& v = rec.values[i].value();
+        if (fld.type != FieldType::String) {
+            encodeFixed(fld, v, out.data() + l.offsets[i]);
+            continue;
         }
-        case FieldType::Date: {
-            if (p + 4 > pend) throw std::runtime_error("Corrupt record (Date)");
-            int32_t x; std::memcpy(&x, p, 4); p += 4;
-            r.values[i] = x;
-            break;
+        const std::string& s = typed<std::string>(v, "Type mismatch String");
+        if (s.size() > 65535) throw std::runtime_error("String too long");
+        strs[i] = &s;
+        total += s.size();
+    }
+
+    // Longest values go first; spilling one shorter than its reference
+    // would not save anything.
+    std::vector<bool> spilled(n, false);
+    while (spill && total > inlineLimit) {
+        size_t pick = n;
+        for (size_t i = 0; i < n; ++i) {
+            if (!strs[i] || spilled[i] || strs[i]->size() <= OVERFLOW_PREFIX + sizeof(OverflowRef)) continue;
+            if (pick == n || strs[i]->size() > strs[pick]->size()) pick = i;
         }
-        case FieldType::Currency: {
-            if (p + 8 > pend) throw std::runtime_error("Corrupt record (Currency)");
-            int64_t x; std::memcpy(&x, p, 8); p += 8;
-            r.values[i] = x;
-            break;
+        if (pick == n) break;
+        spilled[pick] = true;
+        total -= strs[pick]->size() - OVERFLOW_PREFIX - sizeof(OverflowRef);
+    }
+    if (total >= SPILLED) throw std::runtime_error("Record too large");
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!strs[i]) continue;
+        const std::string& s = *strs[i];
+        const auto* bytes = reinterpret_cast<const uint8_t*>(s.data());
+        if (!spilled[i]) {
+            uint16_t ref[2] = { static_cast<uint16_t>(out.size()), static_cast<uint16_t>(s.size()) };
+            std::memcpy(out.data() + l.offsets[i], ref, 4);
+            out.insert(out.end(), bytes, bytes + s.size());
+            continue;
         }
+        OverflowRef o{ (*spill)(bytes + OVERFLOW_PREFIX, s.size() - OVERFLOW_PREFIX), static_cast<uint32_t>(s.size()) };
+        uint16_t ref[2] = { static_cast<uint16_t>(out.size() | SPILLED), static_cast<uint16_t>(OVERFLOW_PREFIX) };
+        std::memcpy(out.data() + l.offsets[i], ref, 4);
+        const auto* ob = reinterpret_cast<const uint8_t*>(&o);
+        out.insert(out.end(), ob, ob + sizeof(o));
+        out.insert(out.end(), bytes, bytes + OVERFLOW_PREFIX);
+    }
+    return out;
+}
+
+std::vector<uint8_t> Serializer::serialize(const Schema& schema, const Record& rec) {
+    if (rec.values.size() != schema.fields.size())
+        throw std::runtime_error("Record field count mismatch");
+    return schema.recordFormat >= 2 ? serializeSlotted(schema, rec, 0, nullptr) : serializePacked(schema, rec);
+}
+
+std::vector<uint8_t> Serializer::serialize(const Schema& schema, const Record& rec,
+                                           size_t inlineLimit, const OverflowWriter& spill) {
+    if (rec.values.size() != schema.fields.size())
+        throw std::runtime_error("Record field count mismatch");
+    return schema.recordFormat >= 2 ? serializeSlotted(schema, rec, inlineLimit, &spill)
+                                    : serializePacked(schema, rec);
+}
+
+// Decodes one non-NULL field at p and advances p past it.
+static Value decodeField(const Field& fld, const uint8_t*& p, const uint8_t* pend) {
+    switch (fld.type) {
+    case FieldType::Int32: {
+        if (p + 4 > pend) throw std::runtime_error("Corrupt record (Int32)");
+        int32_t x; std::memcpy(&x, p, 4); p += 4;
+        return x;
+    }
+    case FieldType::Double: {
+        if (p + 8 > pend) throw std::runtime_error("Corrupt record (Double)");
+        double x; std::memcpy(&x, p, 8); p += 8;
+        return x;
+    }
+    case FieldType::Bool: {
+        if (p + 1 > pend) throw std::runtime_error("Corrupt record (Bool)");
+        bool x = (*p != 0); p += 1;
+        return x;
+    }
+    case FieldType::CharN: {
+        if (p + fld.size > pend) throw std::runtime_error("Corrupt record (CharN)");
+        size_t n = fld.size;
+        while (n > 0 && p[n - 1] == 0) --n;
+        std::string s(reinterpret_cast<const char*>(p), n);
+        p += fld.size;
+        return s;
+    }
+    case FieldType::String: {
+        if (p + 2 > pend) throw std::runtime_error("Corrupt record (String len)");
+        uint16_t L; std::memcpy(&L, p, 2); p += 2;
+        if (p + L > pend) throw std::runtime_error("Corrupt record (String data)");
+        std::string s(reinterpret_cast<const char*>(p), reinterpret_cast<const char*>(p + L)); p += L;
+        return s;
+    }
+    case FieldType::Date: {
+        if (p + 4 > pend) throw std::runtime_error("Corrupt record (Date)");
+        int32_t x; std::memcpy(&x, p, 4); p += 4;
+        return x;
+    }
+    case FieldType::Currency: {
+        if (p + 8 > pend) throw std::runtime_error("Corrupt record (Currency)");
+        int64_t x; std::memcpy(&x, p, 8); p += 8;
+        return x;
+    }
+    }
+    throw std::runtime_error("Corrupt record (field type)");
+}
+
+// Advances p past one non-NULL field without decoding it; strings are
+// stepped over by their length prefix.
+static void skipField(const Field& fld, const uint8_t*& p, const uint8_t* pend) {
+    size_t w = 0;
+    switch (fld.type) {
+    case FieldType::Int32:
+    case FieldType::Date:     w = 4; break;
+    case FieldType::Double:
+    case FieldType::Currency: w = 8; break;
+    case FieldType::Bool:     w = 1; break;
+    case FieldType::CharN:    w = fld.size; break;
+    case FieldType::String: {
+        if (p + 2 > pend) throw std::runtime_error("Corrupt record (String len)");
+        uint16_t L; std::memcpy(&L, p, 2);
+        w = 2 + size_t(L);
+        break;
+    }
+    }
+    if (p + w > pend) throw std::runtime_error("Corrupt record (field data)");
+    p += w;
+}
+
+// Joins a spilled value's inline prefix with the rest read through overflow.
+static std::string decodeSpilled(const uint8_t* data, size_t len, const uint16_t ref[2], size_t fixedBytes,
+                                 const OverflowReader& overflow) {
+    const size_t at = ref[0] & ~SPILLED;
+    if (at < fixedBytes || at + sizeof(OverflowRef) + ref[1] > len) throw std::runtime_error("Corrupt record (String overflow)");
+    OverflowRef o; std::memcpy(&o, data + at, sizeof(o));
+    if (o.length < ref[1]) throw std::runtime_error("Corrupt record (String overflow)");
+    if (!overflow) throw std::runtime_error("Spilled String value needs an overflow reader");
+    std::string s(o.length, '\0');
+    std::memcpy(&s[0], data + at + sizeof(o), ref[1]);
+    overflow(o.firstPage, reinterpret_cast<uint8_t*>(&s[0]) + ref[1], o.length - ref[1]);
+    return s;
+}
+
+// Decodes a non-NULL field of a format-2 record from its slot at off.
+static Value decodeSlot(const Field& fld, const uint8_t* data, size_t len, size_t off, size_t fixedBytes,
+                        const OverflowReader& overflow) {
+    const uint8_t* p = data + off;
+    const uint8_t* pend = data + len;
+    if (fld.type != FieldType::String) return decodeField(fld, p, pend);
+    if (p + 4 > pend) throw std::runtime_error("Corrupt record (String slot)");
+    uint16_t ref[2]; std::memcpy(ref, p, 4);
+    if (ref[0] & SPILLED) return decodeSpilled(data, len, ref, fixedBytes, overflow);
+    if (ref[0] < fixedBytes || size_t(ref[0]) + ref[1] > len) throw std::runtime_error("Corrupt record (String data)");
+    return std::string(reinterpret_cast<const char*>(data + ref[0]), ref[1]);
+}
+
+static size_t fixedBytesOf(const Schema& schema) {
+    size_t sz = schema.nullBitmapBytes();
+    for (const auto& f : schema.fields) sz += slotWidth(f);
+    return sz;
+}
+
+static void checkSlotted(size_t fixedBytes, size_t len) {
+    if (len < fixedBytes) throw std::runtime_error("Corrupt record (fixed area too short)");
+}
+
+Record Serializer::deserialize(const Schema& schema, const uint8_t* data, size_t len,
+                               const OverflowReader& overflow) {
+    size_t n = schema.fields.size();
+    size_t nb = schema.nullBitmapBytes();
+    if (len < nb) throw std::runtime_error("Corrupt record (null-bitmap too short)");
+    Record r = Record::withFieldCount(n);
+
+    if (schema.recordFormat >= 2) {
+        const size_t fixedBytes = fixedBytesOf(schema);
+        checkSlotted(fixedBytes, len);
+        const uint8_t* p = data + nb;
+        for (size_t i = 0; i < n; ++i) {
+            const auto& fld = schema.fields[i];
+            if (getBit(data, i)) { p += slotWidth(fld); continue; }
+            if (fld.type != FieldType::String) { r.values[i] = decodeField(fld, p, data + len); continue; }
+            uint16_t ref[2]; std::memcpy(ref, p, 4); p += 4;
+            if (ref[0] & SPILLED) { r.values[i] = decodeSpilled(data, len, ref, fixedBytes, overflow); continue; }
+            if (ref[0] < fixedBytes || size_t(ref[0]) + ref[1] > len) throw std::runtime_error("Corrupt record (String data)");
+            r.values[i] = std::string(reinterpret_cast<const char*>(data + ref[0]), ref[1]);
         }
+        return r;
+    }
+
+    const uint8_t* p = data + nb;
+    const uint8_t* pend = data + len;
+    for (size_t i = 0; i < n; ++i) {
+        if (getBit(data, i)) continue; // null
+        r.values[i] = decodeField(schema.fields[i], p, pend);
     }
     return r;
 }
 
+Record Serializer::deserialize(const Schema& schema, const uint8_t* data, size_t len,
+                               const std::vector<bool>& columns) {
+    if (schema.recordFormat >= 2) return deserialize(schema, RecordLayout::of(schema), data, len, columns);
+    return deserialize(schema, RecordLayout{}, data, len, columns);
+}
+
+Record Serializer::deserialize(const Schema& schema, const RecordLayout& layout, const uint8_t* data, size_t len,
+                               const std::vector<bool>& columns, const OverflowReader& overflow) {
+    size_t n = schema.fields.size();
+    size_t nb = schema.nullBitmapBytes();
+    if (len < nb) throw std::runtime_error("Corrupt record (null-bitmap too short)");
+    Record r = Record::withFieldCount(n);
+    size_t last = std::min(n, columns.size());
+    while (last > 0 && !columns[last - 1]) --last;
+
+    if (schema.recordFormat >= 2) {
+        checkSlotted(layout.fixedBytes, len);
+        for (size_t i = 0; i < last; ++i)
+            if (columns[i] && !getBit(data, i))
+                r.values[i] = decodeSlot(schema.fields[i], data, len, layout.offsets[i], layout.fixedBytes, overflow);
+        return r;
+    }
+
+    const uint8_t* p = data + nb;
+    const uint8_t* pend = data + len;
+    for (size_t i = 0; i < last; ++i) {
+        if (getBit(data, i)) continue;
+        if (columns[i]) r.values[i] = decodeField(schema.fields[i], p, pend);
+        else skipField(schema.fields[i], p, pend);
+    }
+    return r;
+}
+
+std::optional<Value> Serializer::readField(const Schema& schema, const uint8_t* data, size_t len, size_t field) {
+    if (schema.recordFormat >= 2) {
+        if (len < schema.nullBitmapBytes()) throw std::runtime_error("Corrupt record (null-bitmap too short)");
+        if (field >= schema.fields.size()) throw std::runtime_error("Field index out of range");
+        if (getBit(data, field)) return std::nullopt;
+        const size_t fixedBytes = fixedBytesOf(schema);
+        checkSlotted(fixedBytes, len);
+        size_t off = schema.nullBitmapBytes();
+        for (size_t i = 0; i < field; ++i) off += slotWidth(schema.fields[i]);
+        return decodeSlot(schema.fields[field], data, len, off, fixedBytes, {});
+    }
+    return readField(schema, RecordLayout{}, data, len, field);
+}
+
+std::optional<Value> Serializer::readField(const Schema& schema, const RecordLayout& layout,
+                                           const uint8_t* data, size_t len, size_t field,
+                                           const OverflowReader& overflow) {
+    size_t nb = schema.nullBitmapBytes();
+    if (len < nb) throw std::runtime_error("Corrupt record (null-bitmap too short)");
+    if (field >= schema.fields.size()) throw std::runtime_error("Field index out of range");
+    if (getBit(data, field)) return std::nullopt;
+
+    if (schema.recordFormat >= 2) {
+        checkSlotted(layout.fixedBytes, len);
+        return decodeSlot(schema.fields[field], data, len, layout.offsets[field], layout.fixedBytes, overflow);
+    }
+
+    const uint8_t* p = data + nb;
+    const uint8_t* pend = data + len;
+    for (size_t i = 0; i < field; ++i)
+        if (!getBit(data, i)) skipField(schema.fields[i], p, pend);
+    return decodeField(schema.fields[field], p, pend);
+}
+
+bool Serializer::patchField(const Schema& schema, const RecordLayout& layout, uint8_t* data, size_t len,
+                            size_t field, const std::optional<Value>& v) {
+    size_t nb = schema.nullBitmapBytes();
+    if (len < nb) throw std::runtime_error("Corrupt record (null-bitmap too short)");
+    if (field >= schema.fields.size()) throw std::runtime_error("Field index out of range");
+    const auto& fld = schema.fields[field];
+    if (fld.type == FieldType::String) return false;
+
+    if (schema.recordFormat >= 2) {
+        checkSlotted(layout.fixedBytes, len);
+        uint8_t* slot = data + layout.offsets[field];
+        if (v) {
+            encodeFixed(fld, *v, slot);
+            data[field / 8] &= uint8_t(~(1u << (field % 8)));
+        } else {
+            std::memset(slot, 0, slotWidth(fld));
+            setBit(data, field);
+        }
+        return true;
+    }
+
+    // Format 1 packs values, so only a value replacing a value keeps the
+    // bytes after it in place.
+    if (!v || getBit(data, field)) return false;
+    const uint8_t* p = data + nb;
+    const uint8_t* pend = data + len;
+    for (size_t i = 0; i < field; ++i)
+        if (!getBit(data, i)) skipField(schema.fields[i], p, pend);
+    if (p + slotWidth(fld) > pend) throw std::runtime_error("Corrupt record (field data)");
+    encodeFixed(fld, *v, data + (p - data));
+    return true;
+}
+
+std::vector<OverflowRef> Serializer::overflowRefs(const Schema& schema, const RecordLayout& layout,
+                                                  const uint8_t* data, size_t len) {
+    std::vector<OverflowRef> refs;
+    if (schema.recordFormat < 2) return refs;
+    checkSlotted(layout.fixedBytes, len);
+    for (size_t i = 0; i < schema.fields.size(); ++i) {
+        if (schema.fields[i].type != FieldType::String || getBit(data, i)) continue;
+        uint16_t ref[2]; std::memcpy(ref, data + layout.offsets[i], 4);
+        if (!(ref[0] & SPILLED)) continue;
+        const size_t at = ref[0] & ~SPILLED;
+        if (at < layout.fixedBytes || at + sizeof(OverflowRef) > len) throw std::runtime_error("Corrupt record (String overflow)");
+        OverflowRef o; std::memcpy(&o, data + at, sizeof(o));
+        refs.push_back(o);
+    }
+    return refs;
+}
+
 }
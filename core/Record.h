@@ -3,6 +3,7 @@
 #include <variant>
 #include <optional>
 #include <cstring>
+#include <functional>
 
 namespace ma {
 
@@ -19,10 +20,72 @@ struct RID {
     uint16_t slotId{};
 };
 
+// Field positions of a format-2 record. The null bitmap is followed by one
+// fixed-width slot per field in schema order (a String slot holds a uint16
+// offset and length into the tail), then the string bytes. Any field is at
+// a constant offset from the start of the record; NULL fields keep their
+// slot, zero-filled.
+struct RecordLayout {
+    size_t nullBytes = 0;
+    size_t fixedBytes = 0;           // bitmap plus all fixed slots
+    std::vector<uint32_t> offsets;   // per field, from the start of the record
+
+    static RecordLayout of(const Schema& schema);
+};
+
+// Large String values in format 2. When a row would exceed the caller's
+// inline limit, its longest strings are handed to an OverflowWriter, largest
+// first, until it fits. A spilled value's slot offset has the high bit set and
+// points at an OverflowRef followed by the first OVERFLOW_PREFIX bytes of the
+// value; the slot length is that prefix's length. The writer stores the rest
+// of the value and returns where it went; an OverflowReader reads it back.
+#pragma pack(push,1)
+struct OverflowRef {
+    uint32_t firstPage;
+    uint32_t length;   // of the whole value
+};
+#pragma pack(pop)
+
+constexpr size_t OVERFLOW_PREFIX = 64;
+using OverflowWriter = std::function<uint32_t(const uint8_t* bytes, size_t len)>;
+using OverflowReader = std::function<void(uint32_t firstPage, uint8_t* out, size_t len)>;
+
 class Serializer {
 public:
     static std::vector<uint8_t> serialize(const Schema& schema, const Record& rec);
-    static Record deserialize(const Schema& schema, const uint8_t* data, size_t len);
+    // Spills String values through spill while the row is longer than
+    // inlineLimit bytes. Format 1 rows are never spilled. spill is called
+    // only once every value has been checked.
+    static std::vector<uint8_t> serialize(const Schema& schema, const Record& rec,
+                                          size_t inlineLimit, const OverflowWriter& spill);
+    // Decoding a spilled value calls overflow; without one it throws.
+    static Record deserialize(const Schema& schema, const uint8_t* data, size_t len,
+                              const OverflowReader& overflow = {});
+    // Decodes only the fields set in columns; the others come back NULL.
+    // Fields after the last requested one are not looked at.
+    static Record deserialize(const Schema& schema, const uint8_t* data, size_t len,
+                              const std::vector<bool>& columns);
+    // Decodes a single field. Format 1 steps over the fields before it;
+    // format 2 goes straight to its slot. A NULL field gives nullopt.
+    static std::optional<Value> readField(const Schema& schema, const uint8_t* data, size_t len, size_t field);
+
+    // Same as above with the layout precomputed, for callers that decode
+    // many rows of one table. layout is ignored for format-1 schemas.
+    static Record deserialize(const Schema& schema, const RecordLayout& layout, const uint8_t* data, size_t len,
+                              const std::vector<bool>& columns, const OverflowReader& overflow = {});
+    static std::optional<Value> readField(const Schema& schema, const RecordLayout& layout,
+                                          const uint8_t* data, size_t len, size_t field,
+                                          const OverflowReader& overflow = {});
+
+    // The spilled values of a serialized record, for freeing their storage.
+    static std::vector<OverflowRef> overflowRefs(const Schema& schema, const RecordLayout& layout,
+                                                 const uint8_t* data, size_t len);
+
+    // Overwrites one field of a serialized record where no other bytes have
+    // to move: any non-String field in format 2, a fixed-width value
+    // replacing a value in format 1. Returns false when it cannot.
+    static bool patchField(const Schema& schema, const RecordLayout& layout, uint8_t* data, size_t len,
+                           size_t field, const std::optional<Value>& v);
 };
 
 }
@@ -15,7 +15,7 @@ size_t Schema::maxSerializedSize() const {
         case FieldType::Double:    sz += 8; break;
         case FieldType::Bool:      sz += 1; break;
         case FieldType::CharN:     sz += f.size; break;
-        case FieldType::String:    sz += 2 + 65535; break;
+        case FieldType::String:    sz += (recordFormat >= 2 ? 4 : 2) + 65535; break;
         case FieldType::Date:      sz += 4; break;
         case FieldType::Currency:  sz += 8; break;
         }
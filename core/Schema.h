@@ -25,6 +25,10 @@ struct Field {
 struct Schema {
     std::string tableName;
     std::vector<Field> fields;
+    // Row encoding, kept in .meta: 1 packs the values after the null bitmap,
+    // 2 gives every field a fixed-width slot and puts string bytes in a tail
+    // (see RecordLayout). New tables get 2; older files read as 1.
+    uint8_t recordFormat = 2;
 
     size_t nullBitmapBytes() const;
     size_t maxSerializedSize() const;
@@ -2,6 +2,7 @@
 #include <stdexcept>
 #include <cstring>
 #include <filesystem>
+#include <vector>
 
 namespace ma {
 
@@ -11,97 +12,303 @@ Storage::~Storage() {
     close();
 }
 
-void Storage::create(const std::string& path) {
+void Storage::create(const std::string& path, uint32_t pageSize) {
+    if (!validPageSize(pageSize)) throw std::runtime_error("Unsupported page size");
     close();
+    if (readOnly_) throw std::runtime_error("File is open read-only: " + path);
     path_ = path;
     file_.open(path_, std::ios::binary | std::ios::out | std::ios::trunc);
     if (!file_) throw std::runtime_error("Cannot create file: " + path_);
     header_.magic = MAD_MAGIC;
-    header_.version = 1;
+    // Builds that predate the pageSize field only read version 1 files, all
+    // of them PAGE_SIZE.
+    header_.version = pageSize == PAGE_SIZE ? 1 : 2;
     header_.pageCount = 1;
+    header_.freeHead = 0;
+    header_.freeCount = 0;
+    header_.pageSize = pageSize;
     std::memset(header_.reserved, 0, sizeof(header_.reserved));
 
-    Page p0;
-    p0.hdr.pageId = 0;
-    std::memcpy(p0.bytes.data(), &header_, sizeof(MadHeader));
-    file_.write(reinterpret_cast<const char*>(p0.bytes.data()), PAGE_SIZE);
-    file_.flush();
+    writeHeaderPage();
     file_.close();
 
-    file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
-    if (!file_) throw std::runtime_error("Cannot reopen created file");
+    if (backend_ == StorageBackend::Mapped) {
+        map_.open(path_, pageSize);
+    } else {
+        file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file_) throw std::runtime_error("Cannot reopen created file");
+    }
+    fileId_ = pool_->attach(path_, this, pageSize);
+    pool_->discard(fileId_);
 }
 
 void Storage::open(const std::string& path) {
     close();
     path_ = path;
-    file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
-    if (!file_) throw std::runtime_error("Cannot open file: " + path_);
     readHeader();
+    if (backend_ == StorageBackend::Mapped) {
+        map_.open(path_, header_.pageSize, readOnly_);
+    } else {
+        file_.open(path_, readOnly_ ? std::ios::binary | std::ios::in : std::ios::binary | std::ios::in | std::ios::out);
+        if (!file_) throw std::runtime_error("Cannot open file: " + path_);
+    }
+    fileId_ = pool_->attach(path_, this, header_.pageSize);
 }
 
 void Storage::close() {
+    if (fileId_ != 0) {
+        if (!readOnly_) pool_->flushFile(fileId_);
+        pool_->detach(fileId_, this);
+        fileId_ = 0;
+    }
+    // A mapped header is written as it changes; copying it again here would
+    // undo changes other handles made to the file since.
+    if (map_.isOpen()) {
+        if (headerDirty_) std::memcpy(map_.page(0), &header_, sizeof(MadHeader));
+        map_.close(header_.pageCount);
+    }
+    headerDirty_ = false;
     if (file_.is_open()) {
-        file_.seekp(0, std::ios::beg);
-        Page p0;
-        p0.hdr.pageId = 0;
-        std::memcpy(p0.bytes.data(), &header_, sizeof(MadHeader));
-        file_.write(reinterpret_cast<const char*>(p0.bytes.data()), PAGE_SIZE);
-        file_.flush();
+        if (!readOnly_) writeHeaderPage();
         file_.close();
     }
 }
 
+void Storage::flush() {
+    if (readOnly_) return;
+    if (map_.isOpen()) {
+        pool_->flushFile(fileId_);
+        writeHeader();
+        map_.sync();
+        return;
+    }
+    if (!file_.is_open()) return;
+    pool_->flushFile(fileId_);
+    if (headerDirty_) writeHeader();
+    file_.flush();
+    if (!file_) throw std::runtime_error("Failed to flush " + path_);
+}
+
+void Storage::setDurability(Durability d) {
+    if (d == durability_) return;
+    durability_ = d;
+    if (d == Durability::FlushEveryOp) flush();
+}
+
 void Storage::writeHeader() {
+    if (map_.isOpen()) {
+        std::memcpy(map_.page(0), &header_, sizeof(MadHeader));
+        headerDirty_ = false;
+        return;
+    }
+    writeHeaderPage();
+    headerDirty_ = false;
+}
+
+// Writes page 0, the header padded to a full page, through the stream.
+void Storage::writeHeaderPage() {
+    std::vector<uint8_t> p0(header_.pageSize, 0);
+    std::memcpy(p0.data(), &header_, sizeof(MadHeader));
     file_.seekp(0, std::ios::beg);
-    Page p0;
-    p0.hdr.pageId = 0;
-    std::memcpy(p0.bytes.data(), &header_, sizeof(MadHeader));
-    file_.write(reinterpret_cast<const char*>(p0.bytes.data()), PAGE_SIZE);
+    file_.write(reinterpret_cast<const char*>(p0.data()), p0.size());
     file_.flush();
 }
 
+void Storage::headerChanged() {
+    if (map_.isOpen() || durability_ == Durability::FlushEveryOp) writeHeader();
+    else headerDirty_ = true;
+}
+
+// Read before the file is opened for paging, since the backends need the
+// page size.
 void Storage::readHeader() {
-    file_.seekg(0, std::ios::beg);
-    Page p0;
-    file_.read(reinterpret_cast<char*>(p0.bytes.data()), PAGE_SIZE);
-    if (!file_) throw std::runtime_error("Failed to read MAD header page");
-    std::memcpy(&header_, p0.bytes.data(), sizeof(MadHeader));
-    if (header_.magic != MAD_MAGIC || header_.version != 1)
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open file: " + path_);
+    in.read(reinterpret_cast<char*>(&header_), sizeof(MadHeader));
+    if (!in) throw std::runtime_error("Failed to read MAD header page");
+    if (header_.magic != MAD_MAGIC || (header_.version != 1 && header_.version != 2))
         throw std::runtime_error("Invalid MAD file header");
+    if (header_.pageSize == 0) header_.pageSize = PAGE_SIZE;
+    if (!validPageSize(header_.pageSize)) throw std::runtime_error("Invalid MAD file header");
+}
+
+static void initDataPage(uint8_t* d, uint32_t pageId, uint32_t pageSize) {
+    std::memset(d, 0, pageSize);
+    PageHeader h{};
+    h.pageId = pageId;
+    h.slotCount = 0;
+    h.freeStart = sizeof(PageHeader);
+    h.freeEnd = static_cast<uint16_t>(pageEnd(pageSize));
+    h.flags = 0;
+    std::memcpy(d, &h, sizeof(PageHeader));
+}
+
+void Storage::requireWritable() const {
+    if (readOnly_) throw std::runtime_error("File is open read-only: " + path_);
 }
 
 uint32_t Storage::allocatePage() {
-    Page p;
-    p.hdr.pageId = header_.pageCount;
-    std::memcpy(p.bytes.data(), &p.hdr, sizeof(PageHeader));
-    file_.seekp(static_cast<std::streamoff>(header_.pageCount) * PAGE_SIZE, std::ios::beg);
-    file_.write(reinterpret_cast<const char*>(p.bytes.data()), PAGE_SIZE);
-    file_.flush();
-    if (!file_) throw std::runtime_error("Failed to allocate page");
+    requireWritable();
+    while (header_.freeHead != 0) {
+        const uint32_t pid = header_.freeHead;
+        Page p = readPage(pid);
+        if (!pageIsFree(p.hdr())) {
+            // Chain overwritten by a build that did not know about it; drop it.
+            header_.freeHead = 0;
+            header_.freeCount = 0;
+            headerChanged();
+            break;
+        }
+        header_.freeHead = nextFree(p);
+        header_.freeCount = header_.freeCount ? header_.freeCount - 1 : 0;
+        initDataPage(p.data(), pid, header_.pageSize);
+        writePage(p);
+        headerChanged();
+        return pid;
+    }
+
+    const uint32_t pid = header_.pageCount;
+    if (map_.isOpen()) {
+        map_.ensurePages(pid + 1);
+        initDataPage(map_.page(pid), pid, header_.pageSize);
+        pool_->refresh(fileId_, pid, map_.page(pid));
+        header_.pageCount++;
+        writeHeader();
+        return pid;
+    }
+    BufferPool::Frame* f = pool_->pinNew(fileId_, pid);
+    initDataPage(f->data, pid, header_.pageSize);
+    if (durability_ == Durability::FlushOnCommit) {
+        pool_->unpin(f, true);
+        header_.pageCount++;
+        headerDirty_ = true;
+        return pid;
+    }
+    try {
+        writeFrame(pid, f->data);
+    } catch (...) {
+        pool_->unpin(f, false);
+        throw std::runtime_error("Failed to allocate page");
+    }
+    pool_->setDirty(f, false);
+    pool_->unpin(f, false);
     header_.pageCount++;
     writeHeader();
-    return p.hdr.pageId;
+    return pid;
+}
+
+// The chain link is kept just past the page header.
+uint32_t Storage::nextFree(const Page& p) const {
+    uint32_t next = 0;
+    std::memcpy(&next, p.data() + sizeof(PageHeader), sizeof(next));
+    return next < header_.pageCount ? next : 0;
+}
+
+void Storage::setNextFree(Page& p, uint32_t next) {
+    std::memcpy(p.data() + sizeof(PageHeader), &next, sizeof(next));
+}
+
+void Storage::freePage(uint32_t pageId) {
+    requireWritable();
+    if (pageId == 0 || pageId >= header_.pageCount) throw std::runtime_error("freePage: out of range");
+    Page p = readPage(pageId);
+    if (pageIsFree(p.hdr())) return;
+    initDataPage(p.data(), pageId, header_.pageSize);
+    p.hdr().flags = PAGE_FREE;
+    setNextFree(p, header_.freeHead);
+    writePage(p);
+    header_.freeHead = pageId;
+    header_.freeCount++;
+    headerChanged();
+}
+
+uint32_t Storage::truncateFreeTail() {
+    requireWritable();
+    uint32_t end = header_.pageCount;
+    while (end > 1 && pageIsFree(readPage(end - 1).hdr())) --end;
+    if (end == header_.pageCount) return 0;
+
+    // Unlink the dropped pages from the chain.
+    uint32_t prev = 0;
+    uint32_t cur = header_.freeHead;
+    uint32_t kept = 0;
+    for (uint32_t steps = 0; cur != 0 && steps < header_.pageCount; ++steps) {
+        Page p = readPage(cur);
+        const uint32_t next = pageIsFree(p.hdr()) ? nextFree(p) : 0;
+        if (cur < end) {
+            prev = cur;
+            ++kept;
+        } else if (prev == 0) {
+            header_.freeHead = next;
+        } else {
+            Page pp = readPage(prev);
+            setNextFree(pp, next);
+            writePage(pp);
+        }
+        cur = next;
+    }
+    header_.freeCount = kept;
+
+    const uint32_t dropped = header_.pageCount - end;
+    pool_->flushFile(fileId_);
+    pool_->discard(fileId_);
+    header_.pageCount = end;
+    headerDirty_ = true;
+
+    const uint64_t bytes = static_cast<uint64_t>(end) * header_.pageSize;
+    if (map_.isOpen()) {
+        std::memcpy(map_.page(0), &header_, sizeof(MadHeader));
+        map_.close(end);
+        std::filesystem::resize_file(path_, bytes);
+        map_.open(path_, header_.pageSize);
+        if (map_.pages() != end) throw std::runtime_error("Remap after truncate failed: " + path_);
+    } else {
+        writeHeader();
+        file_.close();
+        std::filesystem::resize_file(path_, bytes);
+        file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file_) throw std::runtime_error("Cannot reopen file: " + path_);
+    }
+    headerDirty_ = false;
+    return dropped;
 }
 
 Page Storage::readPage(uint32_t pageId) {
     if (pageId >= header_.pageCount) throw std::runtime_error("readPage: out of range");
-    Page p;
-    file_.seekg(static_cast<std::streamoff>(pageId) * PAGE_SIZE, std::ios::beg);
-    file_.read(reinterpret_cast<char*>(p.bytes.data()), PAGE_SIZE);
-    if (!file_) throw std::runtime_error("Failed to read page");
-    std::memcpy(&p.hdr, p.bytes.data(), sizeof(PageHeader));
-    p.hdr.pageId = pageId;
-    return p;
+    if (map_.isOpen()) return Page(pageId, map_.page(pageId), header_.pageSize, nullptr, nullptr);
+    BufferPool::Frame* f = pool_->pin(fileId_, pageId);
+    return Page(pageId, f->data, header_.pageSize, pool_, f);
 }
 
 void Storage::writePage(const Page& page) {
-    if (page.hdr.pageId >= header_.pageCount) throw std::runtime_error("writePage: out of range");
-    Page p = page;
-    std::memcpy(p.bytes.data(), &p.hdr, sizeof(PageHeader)); // sync header en bytes
-    file_.seekp(static_cast<std::streamoff>(p.hdr.pageId) * PAGE_SIZE, std::ios::beg);
-    file_.write(reinterpret_cast<const char*>(p.bytes.data()), PAGE_SIZE);
-    file_.flush();
+    requireWritable();
+    const uint32_t pid = page.pageId();
+    if (pid >= header_.pageCount) throw std::runtime_error("writePage: out of range");
+    if (map_.isOpen()) {
+        uint8_t* dst = map_.page(pid);
+        if (page.data() != dst) std::memcpy(dst, page.data(), header_.pageSize);
+        pool_->refresh(fileId_, pid, dst);
+        return;
+    }
+    if (!page.frame_ || page.pool_ != pool_ || page.frame_->fileId != fileId_)
+        throw std::runtime_error("writePage: page does not belong to this file");
+    if (durability_ == Durability::FlushOnCommit) {
+        pool_->setDirty(page.frame_, true);
+        return;
+    }
+    writeFrame(pid, page.data());
+    pool_->setDirty(page.frame_, false);
+}
+
+void Storage::writeFrame(uint32_t pageId, const uint8_t* src) {
+    if (map_.isOpen()) {
+        map_.ensurePages(pageId + 1);
+        std::memcpy(map_.page(pageId), src, header_.pageSize);
+        return;
+    }
+    file_.seekp(static_cast<std::streamoff>(pageId) * header_.pageSize, std::ios::beg);
+    file_.write(reinterpret_cast<const char*>(src), header_.pageSize);
+    if (durability_ == Durability::FlushEveryOp) file_.flush();
     if (!file_) throw std::runtime_error("Failed to write page");
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 #include "Page.h"
+#include "BufferPool.h"
+#include "MappedFile.h"
 #include <string>
 #include <fstream>
 
@@ -10,32 +12,74 @@ struct MadHeader {
     uint32_t magic;
     uint16_t version;
     uint32_t pageCount;
-    uint8_t  reserved[54];
+    uint32_t freeHead;   // first page of the free-page chain, 0 if none
+    uint32_t freeCount;
+    uint32_t pageSize;   // 0 in files written before page size was stored: PAGE_SIZE
+    uint8_t  reserved[42];
 };
 #pragma pack(pop)
 
-class Storage {
+class Storage : private PageFile {
 public:
     Storage() = default;
-    ~Storage();
+    ~Storage() override;
 
-    void create(const std::string& path);
+    void setBufferPool(BufferPool* pool) { pool_ = pool ? pool : &BufferPool::shared(); }
+
+    // pageSize must satisfy validPageSize(); open() takes it from the header.
+    void create(const std::string& path, uint32_t pageSize = PAGE_SIZE);
     void open(const std::string& path);
     void close();
+    void flush();
+
+    void setDurability(Durability d);
+    Durability durability() const { return durability_; }
+
+    // Takes effect on the next create()/open().
+    void setBackend(StorageBackend b) { backend_ = b; }
+    StorageBackend backend() const { return backend_; }
 
+    // Takes effect on the next open(). A read-only handle never writes the
+    // file, its header included; calls that would write throw instead.
+    void setReadOnly(bool readOnly) { readOnly_ = readOnly; }
+    bool readOnly() const { return readOnly_; }
+
+    // Reuses a page from the free-page chain before growing the file.
     uint32_t allocatePage();
     Page readPage(uint32_t pageId);
     void writePage(const Page& page);
 
+    // Wipes a data page and puts it on the free-page chain.
+    void freePage(uint32_t pageId);
+    // Drops free pages at the end of the file and shrinks it; returns how
+    // many pages went. Buffered pages of this file are written out first.
+    uint32_t truncateFreeTail();
+
     uint32_t pageCount() const { return header_.pageCount; }
+    uint32_t freePageCount() const { return header_.freeCount; }
+    uint32_t pageSize() const { return header_.pageSize; }
 
 private:
     std::fstream file_;
     std::string path_;
     MadHeader header_{};
+    BufferPool* pool_ = &BufferPool::shared();
+    uint32_t fileId_ = 0;
+    Durability durability_ = Durability::FlushEveryOp;
+    bool headerDirty_ = false;
+    StorageBackend backend_ = StorageBackend::Stream;
+    bool readOnly_ = false;
+    MappedFile map_;
 
     void writeHeader();
+    void writeHeaderPage();
     void readHeader();
+    void headerChanged();
+    uint32_t nextFree(const Page& p) const;
+    void setNextFree(Page& p, uint32_t next);
+
+    void requireWritable() const;
+    void writeFrame(uint32_t pageId, const uint8_t* src);
 };
 
 }
@@ -3,16 +3,93 @@
 #include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <cctype>
 
 namespace ma {
 
 static constexpr uint32_t META_MAGIC = 0x4D455431u;
+static constexpr uint32_t ALLOC_MAGIC = 0x32414C41u;
+
+namespace {
+
+// Values of one column hashed to the rows holding them.
+struct KeySet {
+    std::unordered_multimap<std::string, RID> rids;
+};
+
+// Key sets are shared by every Table on the same .mad: RI checks open the
+// other table for each edit, so a set owned by one handle would never be
+// reused. Any write through any handle bumps the file's generation and drops
+// its sets.
+struct KeySetRegistry {
+    struct FileSets {
+        uint64_t gen = 0;
+        // .mad timestamp the sets were built against; a file swapped in
+        // from outside (e.g. a redesigned table) invalidates them too.
+        std::filesystem::file_time_type madTime{};
+        std::map<int, std::shared_ptr<const KeySet>> byField;
+    };
+    std::mutex mu;
+    std::unordered_map<std::string, FileSets> files;
+};
+
+KeySetRegistry& keySets() {
+    static KeySetRegistry r;
+    return r;
+}
+
+std::string keySetFileKey(const std::string& madPath) {
+    std::error_code ec;
+    auto abs = std::filesystem::absolute(madPath, ec);
+    std::string k = (ec ? std::filesystem::path(madPath) : abs).lexically_normal().string();
+#ifdef _WIN32
+    for (auto& c : k) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+#endif
+    return k;
+}
+
+// Alternative index first, so values of different types never compare equal.
+std::string keyBytes(const Value& v) {
+    std::string k(1, static_cast<char>(v.index()));
+    std::visit([&](const auto& x) {
+        using T = std::decay_t<decltype(x)>;
+        if constexpr (std::is_same_v<T, std::string>) k += x;
+        else k.append(reinterpret_cast<const char*>(&x), sizeof(x));
+    }, v);
+    return k;
+}
+
+// Length-prefixed concatenation of the key columns; nullopt if any is NULL.
+std::optional<std::string> compositeKey(const std::vector<int>& fields, const Record& rec) {
+    std::string k;
+    for (int fi : fields) {
+        const auto& v = rec.values[fi];
+        if (!v.has_value()) return std::nullopt;
+        std::string part = keyBytes(*v);
+        uint32_t len = static_cast<uint32_t>(part.size());
+        k.append(reinterpret_cast<const char*>(&len), 4);
+        k += part;
+    }
+    return k;
+}
+
+bool sameRid(const RID& a, const RID& b) { return a.pageId == b.pageId && a.slotId == b.slotId; }
+
+}
 
 void Table::writeMeta() {
     std::ofstream out(metaPath_, std::ios::binary | std::ios::trunc);
     if (!out) throw std::runtime_error("Cannot write meta: " + metaPath_);
     out.write(reinterpret_cast<const char*>(&META_MAGIC), 4);
-    uint16_t ver = 1; out.write(reinterpret_cast<const char*>(&ver), 2);
+    // v1 has no index catalog, v2 no unique constraints and v3 no record
+    // format (its rows are format 1); keep writing the oldest version that
+    // can describe the table.
+    uint16_t ver = schema_.recordFormat >= 2 ? 4 : !uniqueDefs_.empty() ? 3 : !indexDefs_.empty() ? 2 : 1;
+    out.write(reinterpret_cast<const char*>(&ver), 2);
+    if (ver >= 4) out.write(reinterpret_cast<const char*>(&schema_.recordFormat), 1);
     uint16_t nameLen = static_cast<uint16_t>(schema_.tableName.size());
     out.write(reinterpret_cast<const char*>(&nameLen), 2);
     out.write(schema_.tableName.data(), nameLen);
@@ -26,144 +103,552 @@ void Table::writeMeta() {
         out.write(reinterpret_cast<const char*>(&t), 1);
         out.write(reinterpret_cast<const char*>(&f.size), 2);
     }
+    if (ver >= 2) {
+        uint16_t ni = static_cast<uint16_t>(indexDefs_.size());
+        out.write(reinterpret_cast<const char*>(&ni), 2);
+        for (const auto& d : indexDefs_) {
+            uint16_t dlen = static_cast<uint16_t>(d.name.size());
+            out.write(reinterpret_cast<const char*>(&dlen), 2);
+            out.write(d.name.data(), dlen);
+            uint16_t fi = static_cast<uint16_t>(d.fieldIndex);
+            out.write(reinterpret_cast<const char*>(&fi), 2);
+            uint8_t k = static_cast<uint8_t>(d.kind);
+            out.write(reinterpret_cast<const char*>(&k), 1);
+        }
+    }
+    if (ver >= 3) {
+        uint16_t nu = static_cast<uint16_t>(uniqueDefs_.size());
+        out.write(reinterpret_cast<const char*>(&nu), 2);
+        for (const auto& u : uniqueDefs_) {
+            uint16_t ulen = static_cast<uint16_t>(u.name.size());
+            out.write(reinterpret_cast<const char*>(&ulen), 2);
+            out.write(u.name.data(), ulen);
+            uint16_t nf = static_cast<uint16_t>(u.fields.size());
+            out.write(reinterpret_cast<const char*>(&nf), 2);
+            for (int f : u.fields) {
+                uint16_t fi = static_cast<uint16_t>(f);
+                out.write(reinterpret_cast<const char*>(&fi), 2);
+            }
+        }
+    }
+    out.close();
+    if (!out) throw std::runtime_error("Cannot write meta: " + metaPath_);
+    stampMeta();
 }
 
-void Table::readMeta() {
+void Table::readMeta(Schema& schema, std::vector<IndexDef>& defs, std::vector<UniqueDef>& uniques) const {
     std::ifstream in(metaPath_, std::ios::binary);
     if (!in) throw std::runtime_error("Cannot open meta: " + metaPath_);
     uint32_t magic; in.read(reinterpret_cast<char*>(&magic), 4);
     if (magic != META_MAGIC) throw std::runtime_error("Invalid meta magic");
     uint16_t ver; in.read(reinterpret_cast<char*>(&ver), 2);
-    if (ver != 1) throw std::runtime_error("Meta version unsupported");
+    if (ver < 1 || ver > 4) throw std::runtime_error("Meta version unsupported");
+    schema.recordFormat = 1;
+    if (ver >= 4) in.read(reinterpret_cast<char*>(&schema.recordFormat), 1);
+    if (schema.recordFormat < 1 || schema.recordFormat > 2) throw std::runtime_error("Record format unsupported");
     uint16_t nameLen; in.read(reinterpret_cast<char*>(&nameLen), 2);
-    schema_.tableName.resize(nameLen);
-    in.read(schema_.tableName.data(), nameLen);
+    schema.tableName.resize(nameLen);
+    in.read(schema.tableName.data(), nameLen);
     uint16_t n; in.read(reinterpret_cast<char*>(&n), 2);
-    schema_.fields.clear();
-    schema_.fields.reserve(n);
+    schema.fields.clear();
+    schema.fields.reserve(n);
     for (uint16_t i = 0; i < n; ++i) {
         uint16_t flen; in.read(reinterpret_cast<char*>(&flen), 2);
         std::string fname(flen, '\0');
         in.read(fname.data(), flen);
         uint8_t t; in.read(reinterpret_cast<char*>(&t), 1);
         uint16_t sz; in.read(reinterpret_cast<char*>(&sz), 2);
-        schema_.fields.push_back(Field{fname, static_cast<FieldType>(t), sz});
+        schema.fields.push_back(Field{fname, static_cast<FieldType>(t), sz});
+    }
+    defs.clear();
+    uniques.clear();
+    if (ver < 2) return;
+    uint16_t ni = 0; in.read(reinterpret_cast<char*>(&ni), 2);
+    for (uint16_t i = 0; i < ni && in; ++i) {
+        IndexDef d;
+        uint16_t dlen; in.read(reinterpret_cast<char*>(&dlen), 2);
+        d.name.resize(dlen);
+        in.read(d.name.data(), dlen);
+        uint16_t fi; in.read(reinterpret_cast<char*>(&fi), 2);
+        uint8_t k; in.read(reinterpret_cast<char*>(&k), 1);
+        if (!in) break;
+        d.fieldIndex = fi;
+        d.kind = static_cast<IndexKind>(k);
+        if (d.fieldIndex >= static_cast<int>(schema.fields.size())) continue;
+        defs.push_back(std::move(d));
+    }
+    if (ver < 3) return;
+    uint16_t nu = 0; in.read(reinterpret_cast<char*>(&nu), 2);
+    for (uint16_t i = 0; i < nu && in; ++i) {
+        UniqueDef u;
+        uint16_t ulen; in.read(reinterpret_cast<char*>(&ulen), 2);
+        u.name.resize(ulen);
+        in.read(u.name.data(), ulen);
+        uint16_t nf = 0; in.read(reinterpret_cast<char*>(&nf), 2);
+        bool valid = nf > 0;
+        for (uint16_t j = 0; j < nf && in; ++j) {
+            uint16_t fi; in.read(reinterpret_cast<char*>(&fi), 2);
+            if (fi >= schema.fields.size()) valid = false;
+            u.fields.push_back(fi);
+        }
+        if (!in) break;
+        if (valid) uniques.push_back(std::move(u));
+    }
+}
+
+// Remembers which version of .meta this handle has seen, so syncCatalog() can
+// notice indexes declared through another Table on the same files.
+void Table::stampMeta() {
+    std::error_code ec;
+    metaTime_ = std::filesystem::last_write_time(metaPath_, ec);
+    metaSize_ = std::filesystem::file_size(metaPath_, ec);
+}
+
+void Table::syncCatalog() {
+    if (metaPath_.empty()) return;
+    std::error_code ec;
+    auto t = std::filesystem::last_write_time(metaPath_, ec);
+    if (ec) return;
+    auto sz = std::filesystem::file_size(metaPath_, ec);
+    if (ec || (t == metaTime_ && sz == metaSize_)) return;
+
+    Schema schema;
+    std::vector<IndexDef> defs;
+    std::vector<UniqueDef> uniques;
+    try { readMeta(schema, defs, uniques); } catch (...) { return; }
+    stampMeta();
+
+    auto sameUniques = [&] {
+        if (uniques.size() != uniqueDefs_.size()) return false;
+        for (size_t i = 0; i < uniques.size(); ++i)
+            if (uniques[i].name != uniqueDefs_[i].name || uniques[i].fields != uniqueDefs_[i].fields) return false;
+        return true;
+    };
+    if (!sameUniques()) {
+        uniqueDefs_ = std::move(uniques);
+        uniqueKeys_.clear();
+        uniqueGen_ = UINT64_MAX;
     }
+
+    auto declared = [&](const IndexDef& d) {
+        for (const auto& x : defs) if (x.kind == d.kind && x.fieldIndex == d.fieldIndex) return true;
+        return false;
+    };
+    for (const auto& d : indexDefs_) if (!declared(d)) closeIndex(d);
+    for (const auto& d : defs) if (!hasIndex(d.fieldIndex)) openIndex(d);
+    indexDefs_ = std::move(defs);
+}
+
+// Opens a declared index. A missing or unreadable .idx (e.g. an older format)
+// is rebuilt from the table, or skipped by a read-only handle.
+void Table::openIndex(const IndexDef& def) {
+    if (def.kind == IndexKind::Int32) {
+        IndexInt32Desc d;
+        d.name = def.name;
+        d.fieldIndex = def.fieldIndex;
+        d.path = indexPath(def.name);
+        d.backend = backend_;
+        d.pageSize = indexPageSize_;
+        d.readOnly = readOnly_;
+        auto idx = std::make_unique<IndexInt32>();
+        try {
+            idx->open(d);
+        } catch (const std::exception&) {
+            if (readOnly_) return;
+            idx = std::make_unique<IndexInt32>();
+            idx->create(d);
+            fillInt32Index(*idx, def.fieldIndex);
+        }
+        idx->setDurability(durability_);
+        int32Indexes_[def.fieldIndex] = std::move(idx);
+    } else if (def.kind == IndexKind::String) {
+        IndexStringDesc d; d.name=def.name; d.fieldIndex=def.fieldIndex; d.path = indexPath(def.name);
+        d.backend = backend_;
+        d.pageSize = indexPageSize_;
+        d.readOnly = readOnly_;
+        auto idx = std::make_unique<IndexString>();
+        try {
+            idx->open(d);
+        } catch (const std::exception&) {
+            if (readOnly_) return;
+            idx = std::make_unique<IndexString>();
+            idx->create(d);
+            fillStringIndex(*idx, def.fieldIndex);
+        }
+        idx->setDurability(durability_);
+        stringIndexes_[def.fieldIndex] = std::move(idx);
+    }
+}
+
+void Table::closeIndex(const IndexDef& def) {
+    if (def.kind == IndexKind::Int32) {
+        auto it = int32Indexes_.find(def.fieldIndex);
+        if (it == int32Indexes_.end()) return;
+        it->second->close();
+        int32Indexes_.erase(it);
+    } else {
+        auto it = stringIndexes_.find(def.fieldIndex);
+        if (it == stringIndexes_.end()) return;
+        it->second->close();
+        stringIndexes_.erase(it);
+    }
+}
+
+Table::~Table() {
+    try { close(); } catch (...) {}
+}
+
+void Table::requireWritable() const {
+    if (readOnly_) throw std::runtime_error("Table is open read-only: " + basePath_);
 }
 
 void Table::create(const std::string& basePath, const Schema& schema) {
+    if (readOnly_) throw std::runtime_error("Cannot create a read-only table: " + basePath);
     basePath_ = basePath;
     metaPath_ = basePath_ + ".meta";
     madPath_  = basePath_ + ".mad";
+    keySetFile_ = keySetFileKey(madPath_);
+    if (schema.recordFormat < 1 || schema.recordFormat > 2) throw std::runtime_error("Record format unsupported");
     schema_ = schema;
+    layout_ = RecordLayout::of(schema_);
+    movedTail_ = 0;
+    indexDefs_.clear();
+    uniqueDefs_.clear();
+    uniqueKeys_.clear();
+    uniqueGen_ = UINT64_MAX;
     writeMeta();
-    storage_.create(madPath_);
+    storage_.create(madPath_, pageSize_);
+    storage_.setDurability(durability_);
+    closeOverflow();
+    std::filesystem::remove(overflowPath());
     avail_.clear();
+    fsm_.clear();
+    fsm_.setPageSize(storage_.pageSize());
+    fsm_.resize(storage_.pageCount());
+    saveAllocState();
+    invalidateKeySets();
 }
 
 void Table::open(const std::string& basePath) {
     basePath_ = basePath;
     metaPath_ = basePath_ + ".meta";
     madPath_  = basePath_ + ".mad";
-    readMeta();
+    keySetFile_ = keySetFileKey(madPath_);
+    readMeta(schema_, indexDefs_, uniqueDefs_);
+    layout_ = RecordLayout::of(schema_);
+    movedTail_ = 0;
+    uniqueKeys_.clear();
+    uniqueGen_ = UINT64_MAX;
+    stampMeta();
     storage_.open(madPath_);
-    rebuildAvailFromPages();
+    storage_.setDurability(durability_);
+    closeOverflow();
+    openOverflow(false);
+    pageSize_ = storage_.pageSize();
+    fsm_.setPageSize(pageSize_);
+    // Only inserts use the allocator state, and a rebuild would mark it dirty.
+    if (!readOnly_ && !loadAllocState()) rebuildAllocState();
+    for (const auto& d : indexDefs_) openIndex(d);
+}
+
+Schema Table::readSchema(const std::string& basePath) {
+    Table t;
+    t.metaPath_ = basePath + ".meta";
+    Schema schema;
+    std::vector<IndexDef> defs;
+    std::vector<UniqueDef> uniques;
+    t.readMeta(schema, defs, uniques);
+    return schema;
 }
 
 void Table::close() {
+    for (auto& [fi, idx] : int32Indexes_) idx->close();
+    for (auto& [fi, idx] : stringIndexes_) idx->close();
+    int32Indexes_.clear();
+    stringIndexes_.clear();
+    indexDefs_.clear();
+    uniqueDefs_.clear();
+    uniqueKeys_.clear();
+    uniqueGen_ = UINT64_MAX;
+    if (allocDirty_) {
+        try { saveAllocState(); } catch (...) {}
+    }
+    fsm_.clear();
+    allocDirty_ = false;
     storage_.close();
+    closeOverflow();
     avail_.clear();
 }
 
-void Table::rebuildAvailFromPages() {
+void Table::flush() {
+    storage_.flush();
+    if (ovfOpen_) ovf_.flush();
+    if (allocDirty_) saveAllocState();
+    for (auto& [fi, idx] : int32Indexes_) idx->flush();
+    for (auto& [fi, idx] : stringIndexes_) idx->flush();
+}
+
+void Table::setPageSize(uint32_t bytes) {
+    if (!validPageSize(bytes)) throw std::runtime_error("Unsupported page size");
+    pageSize_ = bytes;
+}
+
+void Table::setIndexPageSize(uint32_t bytes) {
+    if (!validPageSize(bytes)) throw std::runtime_error("Unsupported page size");
+    indexPageSize_ = bytes;
+}
+
+void Table::setDurability(Durability d) {
+    durability_ = d;
+    storage_.setDurability(d);
+    ovf_.setDurability(d);
+    for (auto& [fi, idx] : int32Indexes_) idx->setDurability(d);
+    for (auto& [fi, idx] : stringIndexes_) idx->setDurability(d);
+}
+
+// Reads every page to recover the free-slot list and free-space map. Only
+// needed when the .alc checkpoint is missing or was not closed cleanly.
+void Table::rebuildAllocState() {
     avail_.clear();
+    fsm_.clear();
+    fsm_.resize(storage_.pageCount());
+    std::vector<FreeSlotRef> free;
     for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) {
         Page p = storage_.readPage(pid);
-        for (uint16_t i = 0; i < p.hdr.slotCount; ++i) {
+        if (pageIsFree(p.hdr())) continue; // handed out by allocatePage()
+        if (p.hdr().flags & PAGE_MOVED) continue; // filled only by placeMoved()
+        for (uint16_t i = 0; i < p.hdr().slotCount; ++i) {
             Slot s = p.getSlot(i);
             if (slotIsFree(s) && slotLen(s) > 0) {
-                avail_.add(FreeSlotRef{pid, i, slotLen(s)});
+                free.push_back(FreeSlotRef{pid, i, slotLen(s)});
             }
         }
+        fsm_.set(pid, p.freeSpace());
     }
+    avail_.assign(std::move(free));
+    allocDirty_ = true;
+}
+
+// <base>.alc: magic, clean flag, page count of the .mad it describes, the
+// free-space map and the free-slot list. The flag is cleared before the first
+// write after it was saved, so a checkpoint left by a crash is never used.
+// Both structures are hints that inserts re-check against the page, so a
+// checkpoint from a handle that missed another handle's writes only costs
+// space that a later rebuild recovers.
+bool Table::loadAllocState() {
+    std::ifstream in(allocPath(), std::ios::binary);
+    if (!in) return false;
+    uint32_t magic = 0, pages = 0;
+    uint8_t clean = 0;
+    in.read(reinterpret_cast<char*>(&magic), 4);
+    in.read(reinterpret_cast<char*>(&clean), 1);
+    in.read(reinterpret_cast<char*>(&pages), 4);
+    if (!in || magic != ALLOC_MAGIC || !clean || pages != storage_.pageCount()) return false;
+
+    FreeSpaceMap fsm;
+    fsm.setPageSize(storage_.pageSize());
+    if (!fsm.read(in) || fsm.pageCount() != pages) return false;
+    uint32_t n = 0;
+    in.read(reinterpret_cast<char*>(&n), 4);
+    if (!in) return false;
+    std::vector<uint8_t> raw(static_cast<size_t>(n) * 8);
+    in.read(reinterpret_cast<char*>(raw.data()), static_cast<std::streamsize>(raw.size()));
+    if (!in) return false;
+    std::vector<FreeSlotRef> free(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        const uint8_t* e = raw.data() + static_cast<size_t>(i) * 8;
+        std::memcpy(&free[i].pageId, e, 4);
+        std::memcpy(&free[i].slotId, e + 4, 2);
+        std::memcpy(&free[i].size, e + 6, 2);
+    }
+
+    fsm_ = std::move(fsm);
+    avail_.assign(std::move(free));
+    allocDirty_ = false;
+    return true;
+}
+
+void Table::saveAllocState() {
+    const std::string path = allocPath();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Cannot write allocator state: " + path);
+    uint8_t clean = 1;
+    uint32_t pages = storage_.pageCount();
+    out.write(reinterpret_cast<const char*>(&ALLOC_MAGIC), 4);
+    out.write(reinterpret_cast<const char*>(&clean), 1);
+    out.write(reinterpret_cast<const char*>(&pages), 4);
+    fsm_.write(out);
+    const auto free = avail_.entries();
+    uint32_t n = static_cast<uint32_t>(free.size());
+    std::vector<uint8_t> raw(static_cast<size_t>(n) * 8);
+    for (uint32_t i = 0; i < n; ++i) {
+        uint8_t* e = raw.data() + static_cast<size_t>(i) * 8;
+        std::memcpy(e, &free[i].pageId, 4);
+        std::memcpy(e + 4, &free[i].slotId, 2);
+        std::memcpy(e + 6, &free[i].size, 2);
+    }
+    out.write(reinterpret_cast<const char*>(&n), 4);
+    out.write(reinterpret_cast<const char*>(raw.data()), static_cast<std::streamsize>(raw.size()));
+    out.close();
+    if (!out) throw std::runtime_error("Cannot write allocator state: " + path);
+    allocDirty_ = false;
+}
+
+void Table::markAllocDirty() {
+    if (allocDirty_) return;
+    allocDirty_ = true;
+    std::fstream f(allocPath(), std::ios::binary | std::ios::in | std::ios::out);
+    if (!f) return;
+    uint8_t clean = 0;
+    f.seekp(4, std::ios::beg);
+    f.write(reinterpret_cast<const char*>(&clean), 1);
 }
 
 RID Table::insert(const Record& rec) {
-    auto payload = Serializer::serialize(schema_, rec);
-
-    if (auto rid = tryInsertIntoFreeSlot(rec, payload)) {
-        if (idxInt32_) {
-            const auto& v = rec.values[idxInt32Field_];
-            if (v.has_value()) {
-                int32_t key = std::get<int32_t>(v.value());
-                idxInt32_->insert(key, *rid);
-            }
-        }
-        if (idxString_) {
-            const auto& vs = rec.values[idxStringField_];
-            if (vs.has_value()) {
-                const std::string& s = std::get<std::string>(vs.value());
-                idxString_->insert(s, *rid);
-            }
-        }
-        return *rid;
+    requireWritable();
+    syncCatalog();
+    markAllocDirty();
+    const uint64_t gen = keySetGeneration();
+    checkUnique(rec, std::nullopt);
+    auto payload = encode(rec);
+
+    RID rid = placeRecord(payload);
+    indexInsert(rec, rid);
+    uniqueInsert(rec, rid);
+    noteWrite(gen);
+    return rid;
+}
+
+// Serializes rec, spilling long String values to overflow chains, so that
+// the row stays under a quarter page where it can.
+std::vector<uint8_t> Table::encode(const Record& rec) {
+    auto payload = Serializer::serialize(schema_, rec, rowInlineLimit(storage_.pageSize()),
+        [this](const uint8_t* bytes, size_t len) { return writeOverflow(bytes, len); });
+    if (payload.empty()) payload.push_back(0); // a zero-length live slot is a stub
+    return payload;
+}
+
+// Spilled values live in <base>.ovf, so scanning the .mad never reads
+// their pages. The file is created with the first spill of any handle on the
+// table; handles that were opened before it exist pick it up on first use, so
+// an existing file is always opened, never recreated.
+bool Table::openOverflow(bool create) {
+    if (ovfOpen_) return true;
+    const bool exists = std::filesystem::exists(overflowPath());
+    if (!exists && !create) return false;
+    ovf_.setBackend(backend_);
+    if (exists) ovf_.open(overflowPath());
+    else ovf_.create(overflowPath(), storage_.pageSize());
+    ovf_.setDurability(durability_);
+    ovfOpen_ = true;
+    return true;
+}
+
+void Table::closeOverflow() {
+    if (ovfOpen_) ovf_.close();
+    ovfOpen_ = false;
+}
+
+uint32_t Table::writeOverflow(const uint8_t* bytes, size_t len) {
+    openOverflow(true);
+    const size_t cap = overflowCapacity(ovf_.pageSize());
+    const size_t n = std::max<size_t>(1, (len + cap - 1) / cap);
+    std::vector<uint32_t> pids;
+    pids.reserve(n);
+    for (size_t i = 0; i < n; ++i) pids.push_back(ovf_.allocatePage());
+    for (size_t i = 0; i < n; ++i) {
+        Page p = ovf_.readPage(pids[i]);
+        p.hdr().flags = PAGE_OVERFLOW;
+        OverflowHeader oh{ i + 1 < n ? pids[i + 1] : 0,
+                           static_cast<uint16_t>(std::min<size_t>(cap, len - i * cap)) };
+        std::memcpy(p.data() + sizeof(PageHeader), &oh, sizeof(oh));
+        std::memcpy(p.data() + sizeof(PageHeader) + sizeof(oh), bytes + i * cap, oh.used);
+        ovf_.writePage(p);
     }
+    return pids.front();
+}
 
-    if (auto rid = tryInsertIntoPages(payload)) {
-        if (idxInt32_) {
-            const auto& v = rec.values[idxInt32Field_];
-            if (v.has_value()) {
-                int32_t key = std::get<int32_t>(v.value());
-                idxInt32_->insert(key, *rid);
-            }
-        }
-        if (idxString_) {
-            const auto& vs = rec.values[idxStringField_];
-            if (vs.has_value()) {
-                const std::string& s = std::get<std::string>(vs.value());
-                idxString_->insert(s, *rid);
-            }
+void Table::readOverflow(uint32_t pid, uint8_t* out, size_t len) {
+    if (len > 0 && !openOverflow(false)) throw std::runtime_error("Overflow file missing");
+    size_t got = 0;
+    for (uint32_t hops = 0; got < len; ++hops) {
+        if (pid == 0 || pid >= ovf_.pageCount() || hops >= ovf_.pageCount())
+            throw std::runtime_error("Corrupt overflow chain");
+        Page p = ovf_.readPage(pid);
+        OverflowHeader oh;
+        std::memcpy(&oh, p.data() + sizeof(PageHeader), sizeof(oh));
+        if (!(p.hdr().flags & PAGE_OVERFLOW) || oh.used > overflowCapacity(p.size()) || oh.used > len - got)
+            throw std::runtime_error("Corrupt overflow chain");
+        std::memcpy(out + got, p.data() + sizeof(PageHeader) + sizeof(oh), oh.used);
+        got += oh.used;
+        pid = oh.next;
+    }
+}
+
+void Table::freeOverflow(const std::vector<OverflowRef>& refs) {
+    if (refs.empty() || !openOverflow(false)) return;
+    for (const OverflowRef& o : refs) {
+        uint32_t pid = o.firstPage;
+        for (uint32_t hops = 0; pid != 0 && pid < ovf_.pageCount() && hops < ovf_.pageCount(); ++hops) {
+            Page p = ovf_.readPage(pid);
+            if (!(p.hdr().flags & PAGE_OVERFLOW)) break;
+            OverflowHeader oh;
+            std::memcpy(&oh, p.data() + sizeof(PageHeader), sizeof(oh));
+            p = Page();
+            ovf_.freePage(pid);
+            pid = oh.next;
         }
-        return *rid;
     }
+}
+
+// Stores a serialized row in a free slot, a page with room or a new page.
+RID Table::placeRecord(const std::vector<uint8_t>& payload) {
+    if (payload.size() > 0x7FFF) throw std::runtime_error("Record larger than page capacity"); // slot lengths are 15 bits
+    if (auto rid = tryInsertIntoFreeSlot(payload)) return *rid;
+    if (auto rid = tryInsertIntoPages(payload)) return *rid;
 
     uint32_t pid = storage_.allocatePage();
     Page p = storage_.readPage(pid);
-    if (p.freeSpace() < payload.size()) throw std::runtime_error("Record larger than page capacity");
-
-    uint16_t off = p.hdr.freeStart;
-    std::memcpy(p.bytes.data() + off, payload.data(), payload.size());
-    p.hdr.freeStart += static_cast<uint16_t>(payload.size());
-
-    p.hdr.slotCount += 1;
-    uint16_t slotIdx = p.hdr.slotCount - 1;
-    Slot s{off, static_cast<uint16_t>(payload.size())};
-    markSlotUsed(s);
-    p.hdr.freeEnd -= sizeof(Slot);
-    p.setSlot(slotIdx, s);
-    storage_.writePage(p);
+    if (p.freeSpace() < payload.size()) {
+        fsm_.set(pid, p.freeSpace());
+        throw std::runtime_error("Record larger than page capacity");
+    }
+    return appendToPage(p, payload);
+}
 
-    RID rid{pid, slotIdx};
+// Appends the row in p's contiguous free area, under an empty slot left by
+// vacuum() if the page has one, else under a new slot.
+RID Table::appendToPage(Page& p, const std::vector<uint8_t>& payload) {
+    const uint16_t need = static_cast<uint16_t>(payload.size());
+    uint16_t off = p.hdr().freeStart;
+    std::memcpy(p.data() + off, payload.data(), payload.size());
+    p.hdr().freeStart += need;
 
-    if (idxInt32_) {
-        const auto& v = rec.values[idxInt32Field_];
-        if (v.has_value()) {
-            int32_t key = std::get<int32_t>(v.value());
-            idxInt32_->insert(key, rid);
+    std::optional<uint16_t> hole;
+    if (p.hdr().flags & PAGE_HOLES) {
+        for (uint16_t i = 0; i < p.hdr().slotCount && !hole; ++i) {
+            Slot h = p.getSlot(i);
+            if (slotIsFree(h) && slotLen(h) == 0) hole = i;
         }
+        if (!hole) p.hdr().flags &= static_cast<uint8_t>(~PAGE_HOLES);
     }
-    if (idxString_) {
-        const auto& vs = rec.values[idxStringField_];
-        if (vs.has_value()) {
-            const std::string& sKey = std::get<std::string>(vs.value());
-            idxString_->insert(sKey, rid);
-        }
+    uint16_t slotIdx;
+    if (hole) {
+        slotIdx = *hole;
+    } else {
+        p.hdr().slotCount += 1;
+        slotIdx = p.hdr().slotCount - 1;
+        p.hdr().freeEnd -= sizeof(Slot);
     }
-
-    return rid;
+    Slot s{off, need};
+    markSlotUsed(s);
+    p.setSlot(slotIdx, s);
+    storage_.writePage(p);
+    fsm_.set(p.pageId(), p.freeSpace());
+    return RID{p.pageId(), slotIdx};
 }
 
-std::optional<RID> Table::tryInsertIntoFreeSlot(const Record&, const std::vector<uint8_t>& payload) {
+std::optional<RID> Table::tryInsertIntoFreeSlot(const std::vector<uint8_t>& payload) {
     uint16_t need = static_cast<uint16_t>(payload.size());
     auto chosen = avail_.acquire(need, fit_);
     if (!chosen) return std::nullopt;
@@ -173,7 +658,7 @@ std::optional<RID> Table::tryInsertIntoFreeSlot(const Record&, const std::vector
     if (!slotIsFree(s) || slotLen(s) < need) {
         return std::nullopt;
     }
-    std::memcpy(p.bytes.data() + s.offset, payload.data(), payload.size());
+    std::memcpy(p.data() + s.offset, payload.data(), payload.size());
     s.length = static_cast<uint16_t>((s.length & 0x8000u) | need);
     markSlotUsed(s);
     p.setSlot(chosen->slotId, s);
@@ -182,56 +667,148 @@ std::optional<RID> Table::tryInsertIntoFreeSlot(const Record&, const std::vector
 }
 
 std::optional<RID> Table::tryInsertIntoPages(const std::vector<uint8_t>& payload) {
-    uint16_t need = static_cast<uint16_t>(payload.size());
-    for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) {
-        Page p = storage_.readPage(pid);
-        if (p.freeSpace() >= need) {
-            uint16_t off = p.hdr.freeStart;
-            std::memcpy(p.bytes.data() + off, payload.data(), payload.size());
-            p.hdr.freeStart += need;
-
-            p.hdr.slotCount += 1;
-            uint16_t slotIdx = p.hdr.slotCount - 1;
-            Slot s{off, need};
-            markSlotUsed(s);
-            p.hdr.freeEnd -= sizeof(Slot);
-            p.setSlot(slotIdx, s);
-            storage_.writePage(p);
-            return RID{pid, slotIdx};
-        }
+    const size_t need = payload.size();
+    while (auto pid = fsm_.find(need)) {
+        if (*pid >= storage_.pageCount()) { fsm_.resize(storage_.pageCount()); continue; }
+        Page p = storage_.readPage(*pid);
+        if (p.freeSpace() >= need) return appendToPage(p, payload);
+        fsm_.set(*pid, p.freeSpace());
     }
     return std::nullopt;
 }
 
-std::optional<Record> Table::read(const RID& rid) {
+RID Table::stubTarget(const Page& p, const Slot& s) {
+    RID to;
+    std::memcpy(&to.pageId, p.data() + s.offset, 4);
+    std::memcpy(&to.slotId, p.data() + s.offset + 4, 2);
+    return to;
+}
+
+void Table::setStubTarget(Page& p, const Slot& s, const RID& to) {
+    std::memcpy(p.data() + s.offset, &to.pageId, 4);
+    std::memcpy(p.data() + s.offset + 4, &to.slotId, 2);
+}
+
+// Loads the page holding rid's row into p, following a forwarding stub, and
+// returns the row's offset and length in it.
+std::optional<std::pair<uint16_t, uint16_t>> Table::locateRow(const RID& rid, Page& p) {
     if (rid.pageId == 0) return std::nullopt;
-    Page p = storage_.readPage(rid.pageId);
-    if (rid.slotId >= p.hdr.slotCount) return std::nullopt;
+    p = storage_.readPage(rid.pageId);
+    if (rid.slotId >= p.hdr().slotCount) return std::nullopt;
     Slot s = p.getSlot(rid.slotId);
+    if (slotIsStub(s)) {
+        const RID to = stubTarget(p, s);
+        if (to.pageId == 0 || to.pageId >= storage_.pageCount()) throw std::runtime_error("Dangling forwarding stub");
+        p = storage_.readPage(to.pageId);
+        if (to.slotId >= p.hdr().slotCount) throw std::runtime_error("Dangling forwarding stub");
+        s = p.getSlot(to.slotId);
+        if (slotIsFree(s) || slotLen(s) < MOVED_PREFIX) throw std::runtime_error("Dangling forwarding stub");
+        return std::make_pair(static_cast<uint16_t>(s.offset + MOVED_PREFIX),
+                              static_cast<uint16_t>(slotLen(s) - MOVED_PREFIX));
+    }
     if (slotIsFree(s) || slotLen(s)==0) return std::nullopt;
-    const uint8_t* data = p.bytes.data() + s.offset;
-    return Serializer::deserialize(schema_, data, slotLen(s));
+    return std::make_pair(s.offset, slotLen(s));
+}
+
+std::optional<Record> Table::read(const RID& rid) {
+    Page p;
+    auto at = locateRow(rid, p);
+    if (!at) return std::nullopt;
+    return Serializer::deserialize(schema_, p.data() + at->first, at->second, overflow_);
+}
+
+std::optional<Record> Table::read(const RID& rid, const std::vector<bool>& columns) {
+    Page p;
+    auto at = locateRow(rid, p);
+    if (!at) return std::nullopt;
+    return Serializer::deserialize(schema_, layout_, p.data() + at->first, at->second, columns, overflow_);
+}
+
+// Appends payload, prefixed with its home RID, to a PAGE_MOVED page. Those
+// pages stay out of the free-space map and the free-slot list, so ordinary
+// inserts never land on them.
+RID Table::placeMoved(const RID& home, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> body(MOVED_PREFIX + payload.size());
+    std::memcpy(body.data(), &home.pageId, 4);
+    std::memcpy(body.data() + 4, &home.slotId, 2);
+    std::memcpy(body.data() + MOVED_PREFIX, payload.data(), payload.size());
+    if (body.size() > 0x7FFF || body.size() + sizeof(Slot) > pageEnd(storage_.pageSize()) - sizeof(PageHeader))
+        throw std::runtime_error("Record larger than page capacity");
+
+    if (movedTail_ != 0 && movedTail_ < storage_.pageCount()) {
+        Page p = storage_.readPage(movedTail_);
+        if ((p.hdr().flags & PAGE_MOVED) && !pageIsFree(p.hdr()) && p.freeSpace() >= body.size()) {
+            const RID rid = appendToPage(p, body);
+            fsm_.set(rid.pageId, 0);
+            return rid;
+        }
+    }
+    const uint32_t pid = storage_.allocatePage();
+    Page p = storage_.readPage(pid);
+    p.hdr().flags |= PAGE_MOVED;
+    movedTail_ = pid;
+    const RID rid = appendToPage(p, body);
+    fsm_.set(pid, 0);
+    return rid;
+}
+
+// Calls fn(rid, row bytes, length) for every live row; moved rows are
+// reported under their home RID while their PAGE_MOVED page is read.
+void Table::forEachRow(const std::function<void(const RID&, const uint8_t*, size_t)>& fn) {
+    for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) {
+        Page p = storage_.readPage(pid);
+        const bool moved = (p.hdr().flags & PAGE_MOVED) != 0;
+        for (uint16_t i = 0; i < p.hdr().slotCount; ++i) {
+            Slot s = p.getSlot(i);
+            if (slotIsFree(s) || slotLen(s) == 0) continue; // stubs are seen through their moved row
+            const uint8_t* d = p.data() + s.offset;
+            if (!moved) {
+                fn(RID{pid, i}, d, slotLen(s));
+                continue;
+            }
+            if (slotLen(s) < MOVED_PREFIX) continue;
+            RID home;
+            std::memcpy(&home.pageId, d, 4);
+            std::memcpy(&home.slotId, d + 4, 2);
+            fn(home, d + MOVED_PREFIX, slotLen(s) - MOVED_PREFIX);
+        }
+    }
 }
 
 bool Table::erase(const RID& rid) {
+    requireWritable();
+    syncCatalog();
+    markAllocDirty();
     if (rid.pageId == 0) return false;
+    const uint64_t gen = keySetGeneration();
     Page p = storage_.readPage(rid.pageId);
-    if (rid.slotId >= p.hdr.slotCount) return false;
+    if (rid.slotId >= p.hdr().slotCount) return false;
     Slot s = p.getSlot(rid.slotId);
     if (slotIsFree(s)) return false;
 
-    std::optional<Record> rec = Serializer::deserialize(schema_, p.bytes.data() + s.offset, slotLen(s));
-
-    int32_t keyForIndex = 0; bool hasKey = false;
-    if (idxInt32_ && rec && rec->values[idxInt32Field_].has_value()) {
-        keyForIndex = std::get<int32_t>(rec->values[idxInt32Field_].value());
-        hasKey = true;
-    }
-
-    std::string strKeyForIndex; bool hasStrKey = false;
-    if (idxString_ && rec && rec->values[idxStringField_].has_value()) {
-        strKeyForIndex = std::get<std::string>(rec->values[idxStringField_].value());
-        hasStrKey = true;
+    std::optional<Record> rec;
+    const bool keyed = !indexDefs_.empty() || !uniqueDefs_.empty();
+    if (slotIsStub(s)) {
+        // Drop the moved row too; vacuum() reclaims its space.
+        const RID to = stubTarget(p, s);
+        Page mp = storage_.readPage(to.pageId);
+        if (to.slotId < mp.hdr().slotCount) {
+            Slot ms = mp.getSlot(to.slotId);
+            if (!slotIsFree(ms) && slotLen(ms) >= MOVED_PREFIX) {
+                if (keyed)
+                    rec = Serializer::deserialize(schema_, mp.data() + ms.offset + MOVED_PREFIX,
+                                                  slotLen(ms) - MOVED_PREFIX, overflow_);
+                freeOverflow(Serializer::overflowRefs(schema_, layout_, mp.data() + ms.offset + MOVED_PREFIX,
+                                                      slotLen(ms) - MOVED_PREFIX));
+                markSlotFree(ms);
+                mp.setSlot(to.slotId, ms);
+                storage_.writePage(mp);
+            }
+        }
+        s.length = STUB_BYTES; // the stub's bytes become the free slot
+    } else {
+        if (keyed) rec = Serializer::deserialize(schema_, p.data() + s.offset, slotLen(s), overflow_);
+        freeOverflow(Serializer::overflowRefs(schema_, layout_, p.data() + s.offset, slotLen(s)));
     }
 
     markSlotFree(s);
@@ -239,161 +816,678 @@ bool Table::erase(const RID& rid) {
     storage_.writePage(p);
     avail_.add(FreeSlotRef{rid.pageId, rid.slotId, slotLen(s)});
 
-    if (idxInt32_ && hasKey) {
-        idxInt32_->erase(keyForIndex, rid);
-    }
-    if (idxString_ && hasStrKey) {
-        idxString_->erase(strKeyForIndex, rid);
+    if (rec) {
+        indexErase(*rec, rid);
+        uniqueErase(*rec, rid);
     }
+    noteWrite(gen);
     return true;
 }
 
 std::optional<RID> Table::update(const RID& rid, const Record& rec) {
-    auto payload = Serializer::serialize(schema_, rec);
+    requireWritable();
+    syncCatalog();
+    markAllocDirty();
     if (rid.pageId == 0) return std::nullopt;
+    const uint64_t gen = keySetGeneration();
     Page p = storage_.readPage(rid.pageId);
-    if (rid.slotId >= p.hdr.slotCount) return std::nullopt;
+    if (rid.slotId >= p.hdr().slotCount) return std::nullopt;
     Slot s = p.getSlot(rid.slotId);
     if (slotIsFree(s)) return std::nullopt;
 
-    std::optional<Record> oldRec = Serializer::deserialize(schema_, p.bytes.data() + s.offset, slotLen(s));
-    int32_t oldKey = 0; bool hasOld = false;
-    if (idxInt32_ && oldRec && oldRec->values[idxInt32Field_].has_value()) {
-        oldKey = std::get<int32_t>(oldRec->values[idxInt32Field_].value());
-        hasOld = true;
-    }
-    std::string oldStr; bool hasOldStr = false;
-    if (idxString_ && oldRec && oldRec->values[idxStringField_].has_value()) {
-        oldStr = std::get<std::string>(oldRec->values[idxStringField_].value());
-        hasOldStr = true;
+    checkUnique(rec, rid);
+    auto payload = encode(rec);
+
+    const bool keyed = !indexDefs_.empty() || !uniqueDefs_.empty();
+    const uint16_t need = static_cast<uint16_t>(payload.size());
+    std::optional<Record> oldRec;
+
+    if (slotIsStub(s)) {
+        const RID to = stubTarget(p, s);
+        p = Page();
+        Page mp = storage_.readPage(to.pageId);
+        if (to.slotId >= mp.hdr().slotCount) throw std::runtime_error("Dangling forwarding stub");
+        Slot ms = mp.getSlot(to.slotId);
+        if (slotIsFree(ms) || slotLen(ms) < MOVED_PREFIX) throw std::runtime_error("Dangling forwarding stub");
+        if (keyed)
+            oldRec = Serializer::deserialize(schema_, mp.data() + ms.offset + MOVED_PREFIX, slotLen(ms) - MOVED_PREFIX, overflow_);
+        const auto oldSpill = Serializer::overflowRefs(schema_, layout_, mp.data() + ms.offset + MOVED_PREFIX,
+                                                       slotLen(ms) - MOVED_PREFIX);
+
+        if (MOVED_PREFIX + need <= slotLen(ms)) {
+            std::memcpy(mp.data() + ms.offset + MOVED_PREFIX, payload.data(), payload.size());
+            ms.length = static_cast<uint16_t>(MOVED_PREFIX + need);
+            mp.setSlot(to.slotId, ms);
+            storage_.writePage(mp);
+        } else {
+            // Move it again and repoint the stub; stubs never chain.
+            mp = Page();
+            const RID moved = placeMoved(rid, payload);
+            mp = storage_.readPage(to.pageId);
+            ms = mp.getSlot(to.slotId);
+            markSlotFree(ms);
+            mp.setSlot(to.slotId, ms);
+            storage_.writePage(mp);
+            mp = Page();
+            p = storage_.readPage(rid.pageId);
+            setStubTarget(p, p.getSlot(rid.slotId), moved);
+            storage_.writePage(p);
+        }
+        freeOverflow(oldSpill);
+        if (oldRec) {
+            indexUpdate(*oldRec, rec, rid);
+            uniqueErase(*oldRec, rid);
+            uniqueInsert(rec, rid);
+        }
+        noteWrite(gen);
+        return rid;
     }
 
-    uint16_t need = static_cast<uint16_t>(payload.size());
+    if (keyed)
+        oldRec = Serializer::deserialize(schema_, p.data() + s.offset, slotLen(s), overflow_);
+    const auto oldSpill = Serializer::overflowRefs(schema_, layout_, p.data() + s.offset, slotLen(s));
+
     uint16_t have = slotLen(s);
 
     if (need <= have) {
-        std::memcpy(p.bytes.data() + s.offset, payload.data(), payload.size());
+        std::memcpy(p.data() + s.offset, payload.data(), payload.size());
         s.length = (s.length & 0x8000u) | need;
         markSlotUsed(s);
         p.setSlot(rid.slotId, s);
         storage_.writePage(p);
+        p = Page();
+        freeOverflow(oldSpill);
 
-        if (idxInt32_) {
-            if (hasOld) idxInt32_->erase(oldKey, rid);
-            const auto& vnew = rec.values[idxInt32Field_];
-            if (vnew.has_value()) {
-                int32_t newKey = std::get<int32_t>(vnew.value());
-                idxInt32_->insert(newKey, rid);
-            }
-        }
-        if (idxString_) {
-            if (hasOldStr) idxString_->erase(oldStr, rid);
-            const auto& vnewS = rec.values[idxStringField_];
-            if (vnewS.has_value()) {
-                const std::string& newStr = std::get<std::string>(vnewS.value());
-                idxString_->insert(newStr, rid);
-            }
+        if (oldRec) {
+            indexUpdate(*oldRec, rec, rid);
+            uniqueErase(*oldRec, rid);
+            uniqueInsert(rec, rid);
         }
+        noteWrite(gen);
         return rid;
-    } else {
-        markSlotFree(s);
+    }
+
+    // The row outgrew its slot: move it to a PAGE_MOVED page and leave a
+    // stub here, so the RID, the indexes and saved row orders stay valid.
+    if (have >= STUB_BYTES || p.hdr().freeEnd - p.hdr().freeStart >= STUB_BYTES) {
+        p = Page();
+        const RID moved = placeMoved(rid, payload);
+        p = storage_.readPage(rid.pageId);
+        if (have < STUB_BYTES) {
+            s.offset = p.hdr().freeStart;
+            p.hdr().freeStart += STUB_BYTES;
+        }
+        s.length = 0;
         p.setSlot(rid.slotId, s);
+        setStubTarget(p, s, moved);
         storage_.writePage(p);
-        avail_.add(FreeSlotRef{rid.pageId, rid.slotId, have});
+        fsm_.set(rid.pageId, p.freeSpace());
+        p = Page();
+        freeOverflow(oldSpill);
+
+        if (oldRec) {
+            indexUpdate(*oldRec, rec, rid);
+            uniqueErase(*oldRec, rid);
+            uniqueInsert(rec, rid);
+        }
+        noteWrite(gen);
+        return rid;
+    }
+
+    markSlotFree(s);
+    p.setSlot(rid.slotId, s);
+    storage_.writePage(p);
+    p = Page();
+    avail_.add(FreeSlotRef{rid.pageId, rid.slotId, have});
+    freeOverflow(oldSpill);
 
-        if (idxInt32_ && hasOld)    idxInt32_->erase(oldKey, rid);
-        if (idxString_ && hasOldStr) idxString_->erase(oldStr, rid);
+    if (oldRec) {
+        indexErase(*oldRec, rid);
+        uniqueErase(*oldRec, rid);
+    }
+
+    RID moved = placeRecord(payload);
+    indexInsert(rec, moved);
+    uniqueInsert(rec, moved);
+    noteWrite(gen);
+    return moved;
+}
+
+std::optional<RID> Table::update(const RID& rid, int fieldIndex, const std::optional<Value>& value) {
+    requireWritable();
+    if (fieldIndex < 0 || fieldIndex >= (int)schema_.fields.size())
+        throw std::runtime_error("Field index out of range");
+    syncCatalog();
+    if (rid.pageId == 0) return std::nullopt;
+
+    const bool keyed = hasIndex(fieldIndex) ||
+        std::any_of(uniqueDefs_.begin(), uniqueDefs_.end(), [&](const UniqueDef& u) {
+            return std::find(u.fields.begin(), u.fields.end(), fieldIndex) != u.fields.end();
+        });
+    if (!keyed) {
+        const uint64_t gen = keySetGeneration();
+        Page p;
+        auto at = locateRow(rid, p);
+        if (!at) return std::nullopt;
+        if (Serializer::patchField(schema_, layout_, p.data() + at->first, at->second, fieldIndex, value)) {
+            storage_.writePage(p);
+            noteWrite(gen);
+            return rid;
+        }
+    }
+
+    auto rec = read(rid);
+    if (!rec) return std::nullopt;
+    rec->values[fieldIndex] = value;
+    return update(rid, *rec);
+}
+
+void Table::indexInsert(const Record& rec, const RID& rid) {
+    for (auto& [fi, idx] : int32Indexes_) {
+        const auto& v = rec.values[fi];
+        if (v.has_value()) idx->insert(std::get<int32_t>(v.value()), rid);
+    }
+    for (auto& [fi, idx] : stringIndexes_) {
+        const auto& v = rec.values[fi];
+        if (v.has_value()) idx->insert(std::get<std::string>(v.value()), rid);
+    }
+}
+
+void Table::indexErase(const Record& rec, const RID& rid) {
+    for (auto& [fi, idx] : int32Indexes_) {
+        const auto& v = rec.values[fi];
+        if (v.has_value()) idx->erase(std::get<int32_t>(v.value()), rid);
+    }
+    for (auto& [fi, idx] : stringIndexes_) {
+        const auto& v = rec.values[fi];
+        if (v.has_value()) idx->erase(std::get<std::string>(v.value()), rid);
+    }
+}
+
+// In-place update: the RID is unchanged, so only indexes whose key changed are touched.
+void Table::indexUpdate(const Record& oldRec, const Record& newRec, const RID& rid) {
+    for (auto& [fi, idx] : int32Indexes_) {
+        const auto& o = oldRec.values[fi];
+        const auto& n = newRec.values[fi];
+        if (o == n) continue;
+        if (o.has_value()) idx->erase(std::get<int32_t>(o.value()), rid);
+        if (n.has_value()) idx->insert(std::get<int32_t>(n.value()), rid);
+    }
+    for (auto& [fi, idx] : stringIndexes_) {
+        const auto& o = oldRec.values[fi];
+        const auto& n = newRec.values[fi];
+        if (o == n) continue;
+        if (o.has_value()) idx->erase(std::get<std::string>(o.value()), rid);
+        if (n.has_value()) idx->insert(std::get<std::string>(n.value()), rid);
+    }
+}
+
+VacuumStats Table::vacuum(bool truncateTail) {
+    requireWritable();
+    syncCatalog();
+    markAllocDirty();
+    const uint64_t gen = keySetGeneration();
+    VacuumStats st;
+    std::vector<uint8_t> packed(storage_.pageSize());
+
+    auto compact = [&](uint32_t pid) {
+        Page p = storage_.readPage(pid);
+        if (pageIsFree(p.hdr())) return;
+        const bool moved = (p.hdr().flags & PAGE_MOVED) != 0;
+        const uint16_t before = p.hdr().slotCount;
+        uint16_t keep = before;
+        while (keep > 0 && slotIsFree(p.getSlot(keep - 1))) --keep;
+        for (uint16_t i = keep; i < before; ++i) avail_.remove(pid, i);
+
+        if (keep == 0) {
+            p = Page();
+            storage_.freePage(pid);
+            fsm_.set(pid, 0);
+            if (movedTail_ == pid) movedTail_ = 0;
+            st.pagesFreed++;
+            return;
+        }
+
+        size_t live = 0;
+        bool dead = false; // a free slot still holding bytes
+        for (uint16_t i = 0; i < keep; ++i) {
+            Slot s = p.getSlot(i);
+            if (!slotIsFree(s)) live += slotBytes(s);
+            else if (slotLen(s) > 0) dead = true;
+        }
+        if (!dead && keep == before && p.hdr().freeStart == sizeof(PageHeader) + live) return;
+
+        // Rows and the slot directory do not overlap, so slots can be
+        // rewritten while the rows are copied out.
+        const size_t freeBefore = p.freeSpace();
+        uint16_t end = sizeof(PageHeader);
+        bool holes = false;
+        for (uint16_t i = 0; i < keep; ++i) {
+            Slot s = p.getSlot(i);
+            if (slotIsFree(s)) {
+                if (slotLen(s) > 0) avail_.remove(pid, i);
+                Slot empty{0, 0};
+                markSlotFree(empty);
+                p.setSlot(i, empty);
+                holes = true;
+                continue;
+            }
+            const uint16_t len = slotBytes(s);
+            std::memcpy(packed.data() + end, p.data() + s.offset, len);
+            p.setSlot(i, Slot{end, slotLen(s)});
+            end += len;
+        }
+        std::memcpy(p.data() + sizeof(PageHeader), packed.data() + sizeof(PageHeader), end - sizeof(PageHeader));
+        p.hdr().slotCount = keep;
+        p.hdr().freeStart = end;
+        p.hdr().freeEnd = static_cast<uint16_t>(pageEnd(p.size()) - sizeof(Slot) * keep);
+        p.hdr().flags = static_cast<uint8_t>((holes ? PAGE_HOLES : 0) | (moved ? PAGE_MOVED : 0));
+        storage_.writePage(p);
+        fsm_.set(pid, moved ? 0 : p.freeSpace());
+        st.pagesCompacted++;
+        st.bytesReclaimed += p.freeSpace() - freeBefore;
+    };
+
+    for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) compact(pid);
+
+    // Bring moved rows back into their home slot wherever compaction left
+    // enough room, then compact again the pages that changed.
+    std::vector<uint32_t> touched;
+    for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) {
+        Page mp = storage_.readPage(pid);
+        if (pageIsFree(mp.hdr()) || !(mp.hdr().flags & PAGE_MOVED)) continue;
+        bool changed = false;
+        for (uint16_t i = 0; i < mp.hdr().slotCount; ++i) {
+            Slot ms = mp.getSlot(i);
+            if (slotIsFree(ms) || slotLen(ms) <= MOVED_PREFIX) continue;
+            RID home;
+            std::memcpy(&home.pageId, mp.data() + ms.offset, 4);
+            std::memcpy(&home.slotId, mp.data() + ms.offset + 4, 2);
+            const uint16_t len = static_cast<uint16_t>(slotLen(ms) - MOVED_PREFIX);
+
+            Page hp = storage_.readPage(home.pageId);
+            if (home.slotId >= hp.hdr().slotCount) continue;
+            Slot hs = hp.getSlot(home.slotId);
+            if (!slotIsStub(hs)) continue;
+            const RID to = stubTarget(hp, hs);
+            if (to.pageId != pid || to.slotId != i) continue;
+            if (hp.hdr().freeEnd - hp.hdr().freeStart < len) continue;
+
+            const uint16_t off = hp.hdr().freeStart;
+            std::memcpy(hp.data() + off, mp.data() + ms.offset + MOVED_PREFIX, len);
+            hp.hdr().freeStart = static_cast<uint16_t>(off + len);
+            hp.setSlot(home.slotId, Slot{off, len});
+            storage_.writePage(hp);
+            fsm_.set(home.pageId, hp.freeSpace());
+            touched.push_back(home.pageId);
+
+            markSlotFree(ms);
+            mp.setSlot(i, ms);
+            changed = true;
+            st.rowsReturned++;
+        }
+        if (changed) {
+            storage_.writePage(mp);
+            touched.push_back(pid);
+        }
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (uint32_t pid : touched) compact(pid);
 
-        return insert(rec);
+    if (truncateTail) {
+        st.pagesTruncated = storage_.truncateFreeTail();
+        fsm_.resize(storage_.pageCount());
+        if (ovfOpen_) st.pagesTruncated += ovf_.truncateFreeTail();
     }
+    noteWrite(gen);
+    return st;
 }
 
 size_t Table::scanCount() {
     size_t cnt = 0;
     for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) {
         Page p = storage_.readPage(pid);
-        for (uint16_t i = 0; i < p.hdr.slotCount; ++i) {
-            Slot s = p.getSlot(i);
-            if (!slotIsFree(s) && slotLen(s)>0) cnt++;
+        if (p.hdr().flags & PAGE_MOVED) continue;
+        for (uint16_t i = 0; i < p.hdr().slotCount; ++i) {
+            if (slotIsLive(p.getSlot(i))) cnt++;
         }
     }
     return cnt;
 }
 
 std::vector<RID> Table::scanAll() {
+    return scanPages(1, storage_.pageCount());
+}
+
+std::vector<RID> Table::scanPages(uint32_t firstPage, uint32_t count) {
     std::vector<RID> rids;
-    for (uint32_t pid = 1; pid < storage_.pageCount(); ++pid) {
+    const uint32_t end = static_cast<uint32_t>(std::min<uint64_t>(storage_.pageCount(), uint64_t(firstPage) + count));
+    for (uint32_t pid = std::max<uint32_t>(firstPage, 1); pid < end; ++pid) {
         Page p = storage_.readPage(pid);
-        for (uint16_t i = 0; i < p.hdr.slotCount; ++i) {
-            Slot s = p.getSlot(i);
-            if (!slotIsFree(s) && slotLen(s)>0) rids.push_back(RID{pid, i});
+        if (p.hdr().flags & PAGE_MOVED) continue;
+        for (uint16_t i = 0; i < p.hdr().slotCount; ++i) {
+            if (slotIsLive(p.getSlot(i))) rids.push_back(RID{pid, i});
         }
     }
     return rids;
 }
 
+bool Table::exists(const RID& rid) {
+    if (rid.pageId == 0 || rid.pageId >= storage_.pageCount()) return false;
+    Page p = storage_.readPage(rid.pageId);
+    if (rid.slotId >= p.hdr().slotCount) return false;
+    return slotIsLive(p.getSlot(rid.slotId));
+}
+
 bool Table::createInt32Index(int fieldIndex, const std::string& name) {
+    requireWritable();
     if (fieldIndex < 0 || fieldIndex >= (int)schema_.fields.size()) return false;
     if (schema_.fields[fieldIndex].type != FieldType::Int32) return false;
-    idxInt32_ = std::make_unique<IndexInt32>();
-    idxInt32Field_ = fieldIndex;
+    syncCatalog();
+    if (int32Indexes_.count(fieldIndex)) return true;
+
     IndexInt32Desc d;
     d.name = name;
     d.fieldIndex = fieldIndex;
-    d.path = basePath_ + "." + name + ".idx";
-    idxInt32_->create(d);
-
-    auto rids = scanAll();
-    for (const auto& rid : rids) {
-        auto rec = read(rid);
-        if (!rec) continue;
-        const auto& v = rec->values[fieldIndex];
-        if (!v.has_value()) continue;
-        int32_t key = std::get<int32_t>(v.value());
-        idxInt32_->insert(key, rid);
-    }
+    d.path = indexPath(name);
+    d.backend = backend_;
+    d.pageSize = indexPageSize_;
+    auto idx = std::make_unique<IndexInt32>();
+    idx->create(d);
+    fillInt32Index(*idx, fieldIndex);
+    idx->setDurability(durability_);
+    int32Indexes_[fieldIndex] = std::move(idx);
+    indexDefs_.push_back(IndexDef{name, fieldIndex, IndexKind::Int32});
+    writeMeta();
     return true;
 }
 
+void Table::fillInt32Index(IndexInt32& idx, int fieldIndex) {
+    Int32Sorter sorter(idx.desc().path);
+    forEachRow([&](const RID& rid, const uint8_t* data, size_t len) {
+        auto v = Serializer::readField(schema_, layout_, data, len, fieldIndex, overflow_);
+        if (v.has_value()) sorter.add(LeafEntry{std::get<int32_t>(v.value()), rid.pageId, rid.slotId, 0});
+    });
+    idx.setDurability(Durability::FlushOnCommit);
+    idx.bulkLoad(sorter, indexFill_);
+    idx.flush();
+}
+
 std::vector<RID> Table::findByInt32(int fieldIndex, int32_t key) {
-    if (!idxInt32_ || fieldIndex != idxInt32Field_) return {};
-    return idxInt32_->find(key);
+    auto it = int32Indexes_.find(fieldIndex);
+    if (it == int32Indexes_.end()) return {};
+    return it->second->find(key);
 }
 
 std::vector<RID> Table::rangeByInt32(int fieldIndex, int32_t keyMin, int32_t keyMax) {
-    if (!idxInt32_ || fieldIndex != idxInt32Field_) return {};
-    return idxInt32_->range(keyMin, keyMax);
+    auto it = int32Indexes_.find(fieldIndex);
+    if (it == int32Indexes_.end()) return {};
+    return it->second->range(keyMin, keyMax);
 }
 
 bool Table::createStringIndex(int fieldIndex, const std::string& name) {
+    requireWritable();
     if (fieldIndex < 0 || fieldIndex >= (int)schema_.fields.size()) return false;
     auto t = schema_.fields[fieldIndex].type;
     if (t != FieldType::String && t != FieldType::CharN) return false;
+    syncCatalog();
+    if (stringIndexes_.count(fieldIndex)) return true;
+
+    IndexStringDesc d; d.name=name; d.fieldIndex=fieldIndex; d.path = indexPath(name);
+    d.backend = backend_;
+    d.pageSize = indexPageSize_;
+    auto idx = std::make_unique<IndexString>();
+    idx->create(d);
+    fillStringIndex(*idx, fieldIndex);
+    idx->setDurability(durability_);
+    stringIndexes_[fieldIndex] = std::move(idx);
+    indexDefs_.push_back(IndexDef{name, fieldIndex, IndexKind::String});
+    writeMeta();
+    return true;
+}
 
-    idxString_ = std::make_unique<IndexString>();
-    idxStringField_ = fieldIndex;
-    IndexStringDesc d; d.name=name; d.fieldIndex=fieldIndex; d.path = basePath_ + "." + name + ".idx";
-    idxString_->create(d);
+void Table::fillStringIndex(IndexString& idx, int fieldIndex) {
+    StringSorter sorter(idx.desc().path);
+    forEachRow([&](const RID& rid, const uint8_t* data, size_t len) {
+        auto v = Serializer::readField(schema_, layout_, data, len, fieldIndex, overflow_);
+        if (!v.has_value()) return;
+        LeafEntryS e{};
+        e.key = BPlusTreeString::packKey(std::get<std::string>(v.value()));
+        e.ridPage = rid.pageId;
+        e.ridSlot = rid.slotId;
+        sorter.add(e);
+    });
+    idx.setDurability(Durability::FlushOnCommit);
+    idx.bulkLoad(sorter, indexFill_);
+    idx.flush();
+}
 
-    auto rids = scanAll();
+std::vector<RID> Table::findByString(int fieldIndex, const std::string& key) {
+    auto it = stringIndexes_.find(fieldIndex);
+    if (it == stringIndexes_.end()) return {};
+    auto rids = it->second->find(key);
+    if (key.size() < (size_t)STRIDX_MAX_KEY_BYTES) return rids;
+    return keepStringHits(fieldIndex, rids, [&](const std::string& s) { return s == key; });
+}
+std::vector<RID> Table::rangeByString(int fieldIndex, const std::string& keyMin, const std::string& keyMax) {
+    auto it = stringIndexes_.find(fieldIndex);
+    if (it == stringIndexes_.end()) return {};
+    auto rids = it->second->range(keyMin, keyMax);
+    if (keyMin.size() < (size_t)STRIDX_MAX_KEY_BYTES && keyMax.size() < (size_t)STRIDX_MAX_KEY_BYTES) return rids;
+    return keepStringHits(fieldIndex, rids, [&](const std::string& s) { return keyMin <= s && s <= keyMax; });
+}
+
+// Index keys stop at STRIDX_MAX_KEY_BYTES, so a probe of that length or more
+// can match rows that only share its indexed prefix (a truncated key equals an
+// exact one at the cap); this reads the column back to sort them out.
+std::vector<RID> Table::keepStringHits(int fieldIndex, const std::vector<RID>& rids,
+                                       const std::function<bool(const std::string&)>& keep) {
+    std::vector<bool> columns(schema_.fields.size(), false);
+    columns[fieldIndex] = true;
+    std::vector<RID> out;
     for (const auto& rid : rids) {
-        auto rec = read(rid);
-        if (!rec) continue;
-        const auto& v = rec->values[fieldIndex];
-        if (!v.has_value()) continue;
-        const std::string& s = std::get<std::string>(v.value());
-        idxString_->insert(s, rid);
+        auto rec = read(rid, columns);
+        if (!rec || !rec->values[fieldIndex].has_value()) continue;
+        if (keep(std::get<std::string>(*rec->values[fieldIndex]))) out.push_back(rid);
+    }
+    return out;
+}
+
+// Bumps the file's write generation and drops its shared key sets.
+uint64_t Table::invalidateKeySets() {
+    if (keySetFile_.empty()) return 0;
+    auto& reg = keySets();
+    std::lock_guard<std::mutex> lk(reg.mu);
+    auto& fs = reg.files[keySetFile_];
+    fs.gen++;
+    fs.byField.clear();
+    return fs.gen;
+}
+
+uint64_t Table::keySetGeneration() const {
+    if (keySetFile_.empty()) return 0;
+    auto& reg = keySets();
+    std::lock_guard<std::mutex> lk(reg.mu);
+    return reg.files[keySetFile_].gen;
+}
+
+// Called after every write. This handle's unique keys were maintained along
+// with the write, so they stay valid unless another handle wrote in between.
+void Table::noteWrite(uint64_t genBefore) {
+    const uint64_t g = invalidateKeySets();
+    uniqueGen_ = (uniqueGen_ == genBefore) ? g : UINT64_MAX;
+}
+
+std::vector<RID> Table::findEqual(int fieldIndex, const Value& v) {
+    if (fieldIndex < 0 || fieldIndex >= (int)schema_.fields.size()) return {};
+    syncCatalog();
+
+    if (auto it = int32Indexes_.find(fieldIndex); it != int32Indexes_.end()) {
+        if (!std::holds_alternative<int32_t>(v)) return {};
+        return it->second->find(std::get<int32_t>(v));
     }
+    if (auto it = stringIndexes_.find(fieldIndex); it != stringIndexes_.end()) {
+        if (!std::holds_alternative<std::string>(v)) return {};
+        return findByString(fieldIndex, std::get<std::string>(v));
+    }
+
+    auto& reg = keySets();
+    const std::string& fileKey = keySetFile_;
+    std::shared_ptr<const KeySet> set;
+    std::error_code ec;
+    const auto madTime = std::filesystem::last_write_time(madPath_, ec);
+    uint64_t gen = 0;
+    {
+        std::lock_guard<std::mutex> lk(reg.mu);
+        auto& fs = reg.files[fileKey];
+        if (fs.madTime != madTime) {
+            fs.gen++;
+            fs.byField.clear();
+            fs.madTime = madTime;
+        }
+        gen = fs.gen;
+        auto it = fs.byField.find(fieldIndex);
+        if (it != fs.byField.end()) set = it->second;
+    }
+    if (!set) {
+        auto built = std::make_shared<KeySet>();
+        forEachRow([&](const RID& rid, const uint8_t* data, size_t len) {
+            auto fv = Serializer::readField(schema_, layout_, data, len, fieldIndex, overflow_);
+            if (fv.has_value()) built->rids.emplace(keyBytes(*fv), rid);
+        });
+        set = built;
+        std::lock_guard<std::mutex> lk(reg.mu);
+        auto& fs = reg.files[fileKey];
+        if (fs.gen == gen) fs.byField[fieldIndex] = set;
+    }
+
+    std::vector<RID> out;
+    auto range = set->rids.equal_range(keyBytes(v));
+    for (auto it = range.first; it != range.second; ++it) out.push_back(it->second);
+    return out;
+}
+
+bool Table::containsValue(int fieldIndex, const Value& v) {
+    return !findEqual(fieldIndex, v).empty();
+}
+
+void Table::ensureUniqueKeys() {
+    if (uniqueDefs_.empty()) return;
+    const uint64_t g = keySetGeneration();
+    if (uniqueGen_ == g && uniqueKeys_.size() == uniqueDefs_.size()) return;
+
+    uniqueKeys_.assign(uniqueDefs_.size(), {});
+    std::vector<bool> keyCols(schema_.fields.size(), false);
+    for (const auto& u : uniqueDefs_)
+        for (int f : u.fields) keyCols[f] = true;
+    forEachRow([&](const RID& rid, const uint8_t* data, size_t len) {
+        Record rec = Serializer::deserialize(schema_, layout_, data, len, keyCols, overflow_);
+        for (size_t u = 0; u < uniqueDefs_.size(); ++u)
+            if (auto k = compositeKey(uniqueDefs_[u].fields, rec))
+                uniqueKeys_[u].emplace(std::move(*k), rid);
+    });
+    uniqueGen_ = g;
+}
+
+void Table::checkUnique(const Record& rec, const std::optional<RID>& self) {
+    if (uniqueDefs_.empty()) return;
+    ensureUniqueKeys();
+    for (size_t u = 0; u < uniqueDefs_.size(); ++u) {
+        auto k = compositeKey(uniqueDefs_[u].fields, rec);
+        if (!k) continue;
+        auto it = uniqueKeys_[u].find(*k);
+        if (it != uniqueKeys_[u].end() && !(self && sameRid(it->second, *self)))
+            throw DuplicateKeyError(uniqueDefs_[u].name);
+    }
+}
+
+void Table::uniqueInsert(const Record& rec, const RID& rid) {
+    if (uniqueKeys_.size() != uniqueDefs_.size()) return;
+    for (size_t u = 0; u < uniqueDefs_.size(); ++u)
+        if (auto k = compositeKey(uniqueDefs_[u].fields, rec))
+            uniqueKeys_[u][std::move(*k)] = rid;
+}
+
+void Table::uniqueErase(const Record& rec, const RID& rid) {
+    if (uniqueKeys_.size() != uniqueDefs_.size()) return;
+    for (size_t u = 0; u < uniqueDefs_.size(); ++u) {
+        auto k = compositeKey(uniqueDefs_[u].fields, rec);
+        if (!k) continue;
+        auto it = uniqueKeys_[u].find(*k);
+        if (it != uniqueKeys_[u].end() && sameRid(it->second, rid)) uniqueKeys_[u].erase(it);
+    }
+}
+
+bool Table::addUniqueConstraint(const std::string& name, const std::vector<int>& fields) {
+    requireWritable();
+    if (name.empty() || fields.empty()) return false;
+    for (int f : fields)
+        if (f < 0 || f >= (int)schema_.fields.size()) return false;
+    syncCatalog();
+
+    auto existing = std::find_if(uniqueDefs_.begin(), uniqueDefs_.end(),
+                                 [&](const UniqueDef& u) { return u.name == name; });
+    if (existing != uniqueDefs_.end() && existing->fields == fields) return true;
+
+    std::unordered_map<std::string, RID> keys;
+    std::vector<bool> keyCols(schema_.fields.size(), false);
+    for (int f : fields) keyCols[f] = true;
+    bool duplicate = false;
+    forEachRow([&](const RID& rid, const uint8_t* data, size_t len) {
+        if (duplicate) return;
+        Record rec = Serializer::deserialize(schema_, layout_, data, len, keyCols, overflow_);
+        auto k = compositeKey(fields, rec);
+        if (k && !keys.emplace(std::move(*k), rid).second) duplicate = true;
+    });
+    if (duplicate) return false;
+
+    if (existing != uniqueDefs_.end()) existing->fields = fields;
+    else uniqueDefs_.push_back(UniqueDef{name, fields});
+    uniqueKeys_.clear();
+    uniqueGen_ = UINT64_MAX;
+    writeMeta();
     return true;
 }
 
-std::vector<RID> Table::findByString(int fieldIndex, const std::string& key) {
-    if (!idxString_ || fieldIndex != idxStringField_) return {};
-    return idxString_->find(key);
+void Table::dropUniqueConstraint(const std::string& name) {
+    requireWritable();
+    syncCatalog();
+    auto it = std::find_if(uniqueDefs_.begin(), uniqueDefs_.end(),
+                           [&](const UniqueDef& u) { return u.name == name; });
+    if (it == uniqueDefs_.end()) return;
+    uniqueDefs_.erase(it);
+    uniqueKeys_.clear();
+    uniqueGen_ = UINT64_MAX;
+    writeMeta();
 }
-std::vector<RID> Table::rangeByString(int fieldIndex, const std::string& keyMin, const std::string& keyMax) {
-    if (!idxString_ || fieldIndex != idxStringField_) return {};
-    return idxString_->range(keyMin, keyMax);
+
+bool Table::keyIsFree(const std::vector<int>& fields, const Record& rec, const std::optional<RID>& self) {
+    if (fields.empty()) return true;
+    for (int f : fields)
+        if (f < 0 || f >= (int)rec.values.size() || !rec.values[f].has_value()) return true;
+    syncCatalog();
+
+    auto isSelf = [&](const RID& r) { return self && sameRid(r, *self); };
+
+    for (size_t u = 0; u < uniqueDefs_.size(); ++u) {
+        if (uniqueDefs_[u].fields != fields) continue;
+        ensureUniqueKeys();
+        auto it = uniqueKeys_[u].find(*compositeKey(fields, rec));
+        return it == uniqueKeys_[u].end() || isSelf(it->second);
+    }
+
+    for (const auto& rid : findEqual(fields[0], *rec.values[fields[0]])) {
+        if (isSelf(rid)) continue;
+        if (fields.size() == 1) return false;
+        auto other = read(rid);
+        if (!other) continue;
+        bool same = true;
+        for (size_t j = 1; j < fields.size() && same; ++j)
+            same = other->values[fields[j]] == rec.values[fields[j]];
+        if (same) return false;
+    }
+    return true;
 }
 
 }
@@ -3,24 +3,32 @@
 #include <stdexcept>
 #include <algorithm>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MA_BTREE_SSE2 1
+#endif
+
 namespace ma {
 
-static constexpr int LEAF_ENTRY_SIZE = sizeof(LeafEntry);
-static constexpr int INTERNAL_ENTRY_SIZE = sizeof(InternalEntry);
+static_assert(sizeof(NodeHdr) <= 32, "node header must fit before the key array");
+
+static constexpr int LEAF_ENTRY_BYTES = sizeof(int32_t) + sizeof(uint32_t) + sizeof(uint16_t);
 static constexpr int CHILD_PTR_SIZE = sizeof(uint32_t);
 
-int BPlusTreeInt32::maxLeafEntries() {
-    return (PAGE_SIZE - (int)sizeof(NodeHdr)) / LEAF_ENTRY_SIZE;
+int BPlusTreeInt32::maxLeafEntries() const {
+    return ((int)st_->pageSize() - KEYS_OFFSET) / LEAF_ENTRY_BYTES;
 }
-int BPlusTreeInt32::maxInternalKeys() {
-    int M = (PAGE_SIZE - (int)sizeof(NodeHdr) - (int)sizeof(uint32_t)) /
-            (INTERNAL_ENTRY_SIZE + (int)sizeof(uint32_t));
-    return std::max(3, M-1); // holgura
+int BPlusTreeInt32::maxInternalKeys() const {
+    // keys[M+1] and children[M+2]
+    int M = ((int)st_->pageSize() - KEYS_OFFSET - 3 * CHILD_PTR_SIZE) / ((int)sizeof(int32_t) + CHILD_PTR_SIZE);
+    return std::max(3, M);
 }
-int BPlusTreeInt32::minLeafEntries() {
+int BPlusTreeInt32::minLeafEntries() const {
     return std::max(1, maxLeafEntries() / 2);
 }
-int BPlusTreeInt32::minInternalKeys() {
+int BPlusTreeInt32::minInternalKeys() const {
     return std::max(1, maxInternalKeys() / 2);
 }
 
@@ -29,18 +37,17 @@ bool BPlusTreeInt32::isEmpty() const { return st_->rootPageId() == 0; }
 
 uint32_t BPlusTreeInt32::ensureRootLeaf() {
     if (!isEmpty()) return root();
-    Page leaf;
-    leaf.hdr.pageId = st_->allocatePage();
+    Page leaf = read(st_->allocatePage());
     NodeHdr nh{};
-    nh.pageId   = leaf.hdr.pageId;
+    nh.pageId   = leaf.pageId();
     nh.isLeaf   = 1;
     nh.keyCount = 0;
     nh.parent   = 0;
     nh.nextLeaf = 0;
-    std::memcpy(leaf.bytes.data(), &nh, sizeof(NodeHdr));
+    std::memcpy(leaf.data(), &nh, sizeof(NodeHdr));
     write(leaf);
-    setRoot(leaf.hdr.pageId);
-    return leaf.hdr.pageId;
+    setRoot(leaf.pageId());
+    return leaf.pageId();
 }
 
 void BPlusTreeInt32::createEmpty() { ensureRootLeaf(); }
@@ -48,43 +55,59 @@ void BPlusTreeInt32::createEmpty() { ensureRootLeaf(); }
 uint32_t BPlusTreeInt32::findLeafForKey(int32_t k) {
     uint32_t pid = ensureRootLeaf();
     Page p = read(pid);
+    const int M = maxInternalKeys();
     while (!NHc(p).isLeaf) {
-        int M = maxInternalKeys();
-        const auto* keys = IEc(p);
-        const auto* ch = CHILDc(p, M);
-        int kc = NHc(p).keyCount;
-        (void)keys; (void)kc;
-        int i = internalChildIndex(p, k);
-        pid = ch[i];
+        pid = CHILDc(p, M)[lowerBound(KEYSc(p), NHc(p).keyCount, k)];
         p = read(pid);
     }
     return pid;
 }
 
-int BPlusTreeInt32::leafLowerBound(const Page& leaf, int32_t k) {
-    int lo = 0, hi = NHc(leaf).keyCount;
-    const auto* a = LEc(leaf);
-    while (lo < hi) {
+// Binary search narrows the keys to a window of at most SEARCH_WINDOW (two
+// cache lines), which is then scanned with vector compares where available.
+// Keys are sorted, so the number of lanes below k is where the first key >= k sits.
+static constexpr int SEARCH_WINDOW = 32;
+
+int BPlusTreeInt32::lowerBound(const int32_t* keys, int n, int32_t k) {
+    int lo = 0, hi = n;
+    while (hi - lo > SEARCH_WINDOW) {
         int mid = (lo + hi) / 2;
-        if (a[mid].key < k) lo = mid + 1; else hi = mid;
+        if (keys[mid] < k) lo = mid + 1; else hi = mid;
     }
-    return lo;
-}
-int BPlusTreeInt32::leafUpperBound(const Page& leaf, int32_t k) {
-    int lo = 0, hi = NHc(leaf).keyCount;
-    const auto* a = LEc(leaf);
-    while (lo < hi) {
-        int mid = (lo + hi) / 2;
-        if (a[mid].key <= k) lo = mid + 1; else hi = mid;
+#if defined(__AVX2__)
+    const __m256i kv = _mm256_set1_epi32(k);
+    for (; lo + 8 <= hi; lo += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + lo));
+        unsigned below = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(kv, v)));
+        if (below != 0xFFu) {
+            while (below & 1u) { ++lo; below >>= 1; }
+            return lo;
+        }
+    }
+#elif defined(MA_BTREE_SSE2)
+    const __m128i kv = _mm_set1_epi32(k);
+    for (; lo + 4 <= hi; lo += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + lo));
+        unsigned below = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(kv, v)));
+        if (below != 0xFu) {
+            while (below & 1u) { ++lo; below >>= 1; }
+            return lo;
+        }
     }
+#endif
+    while (lo < hi && keys[lo] < k) ++lo;
     return lo;
 }
-int BPlusTreeInt32::internalChildIndex(const Page& internal, int32_t k) {
-    int kc = NHc(internal).keyCount;
-    const auto* a = IEc(internal);
-    int i = 0;
-    while (i < kc && k >= a[i].key) ++i;
-    return i;
+int BPlusTreeInt32::upperBound(const int32_t* keys, int n, int32_t k) {
+    return k == INT32_MAX ? n : lowerBound(keys, n, k + 1);
+}
+
+// Moves n leaf entries from src[si..] to dst[di..]; the ranges may overlap.
+void BPlusTreeInt32::copyLeafEntries(Page& dst, int di, const Page& src, int si, int n, int cap) {
+    if (n <= 0) return;
+    std::memmove(KEYS(dst) + di, KEYSc(src) + si, n * sizeof(int32_t));
+    std::memmove(RIDPAGE(dst, cap) + di, RIDPAGEc(src, cap) + si, n * sizeof(uint32_t));
+    std::memmove(RIDSLOT(dst, cap) + di, RIDSLOTc(src, cap) + si, n * sizeof(uint16_t));
 }
 
 void BPlusTreeInt32::insert(int32_t key, RID rid) {
@@ -100,57 +123,53 @@ void BPlusTreeInt32::insert(int32_t key, RID rid) {
 }
 
 void BPlusTreeInt32::insertIntoLeaf(Page& leaf, int32_t k, RID rid) {
-    int pos = leafUpperBound(leaf, k);
+    const int cap = maxLeafEntries();
     int kc = NHc(leaf).keyCount;
-    auto* a = LE(leaf);
-    for (int i = kc; i > pos; --i) a[i] = a[i-1];
-    a[pos].key = k; a[pos].ridPage = rid.pageId; a[pos].ridSlot = rid.slotId; a[pos].pad=0;
+    int pos = upperBound(KEYSc(leaf), kc, k);
+    copyLeafEntries(leaf, pos + 1, leaf, pos, kc - pos, cap);
+    KEYS(leaf)[pos] = k; RIDPAGE(leaf, cap)[pos] = rid.pageId; RIDSLOT(leaf, cap)[pos] = rid.slotId;
     NH(leaf).keyCount = kc + 1;
 }
 
 void BPlusTreeInt32::splitLeafAndInsert(Page& leaf, int32_t k, RID rid) {
-    Page right;
-    right.hdr.pageId = st_->allocatePage();
-    NodeHdr rnh{}; rnh.pageId=right.hdr.pageId; rnh.isLeaf=1; rnh.keyCount=0; rnh.parent=NHc(leaf).parent; rnh.nextLeaf=NHc(leaf).nextLeaf;
-    std::memcpy(right.bytes.data(), &rnh, sizeof(NodeHdr));
+    Page right = read(st_->allocatePage());
+    NodeHdr rnh{}; rnh.pageId=right.pageId(); rnh.isLeaf=1; rnh.keyCount=0; rnh.parent=NHc(leaf).parent; rnh.nextLeaf=NHc(leaf).nextLeaf;
+    std::memcpy(right.data(), &rnh, sizeof(NodeHdr));
 
     int kc = NHc(leaf).keyCount;
     int move = kc/2;
-    auto* la = LE(leaf);
-    auto* ra = LE(right);
-    for (int i=0;i<move;i++) ra[i] = la[kc - move + i];
+    copyLeafEntries(right, 0, leaf, kc - move, move, maxLeafEntries());
     NH(right).keyCount = move;
     NH(leaf).keyCount = kc - move;
-    NH(leaf).nextLeaf = right.hdr.pageId;
+    NH(leaf).nextLeaf = right.pageId();
 
-    if (k >= LEc(right)[0].key) insertIntoLeaf(right, k, rid);
+    if (k >= KEYSc(right)[0]) insertIntoLeaf(right, k, rid);
     else insertIntoLeaf(leaf, k, rid);
 
     write(leaf); write(right);
 
-    int32_t sepKey = LEc(right)[0].key;
-    insertIntoParent(leaf.hdr.pageId, sepKey, right.hdr.pageId);
+    int32_t sepKey = KEYSc(right)[0];
+    insertIntoParent(leaf.pageId(), sepKey, right.pageId());
 }
 
 void BPlusTreeInt32::insertIntoParent(uint32_t leftPid, int32_t sepKey, uint32_t rightPid) {
     if (leftPid == root()) {
-        Page rootp;
-        rootp.hdr.pageId = st_->allocatePage();
-        NodeHdr nh{}; nh.pageId=rootp.hdr.pageId; nh.isLeaf=0; nh.keyCount=1; nh.parent=0; nh.nextLeaf=0;
-        std::memcpy(rootp.bytes.data(), &nh, sizeof(NodeHdr));
+        Page rootp = read(st_->allocatePage());
+        NodeHdr nh{}; nh.pageId=rootp.pageId(); nh.isLeaf=0; nh.keyCount=1; nh.parent=0; nh.nextLeaf=0;
+        std::memcpy(rootp.data(), &nh, sizeof(NodeHdr));
 
         int M = maxInternalKeys();
-        auto* keys = IE(rootp);
+        auto* keys = KEYS(rootp);
         auto* ch = CHILD(rootp, M);
-        keys[0].key = sepKey;
+        keys[0] = sepKey;
         ch[0] = leftPid;
         ch[1] = rightPid;
 
-        Page L = read(leftPid); NH(L).parent = rootp.hdr.pageId; write(L);
-        Page R = read(rightPid); NH(R).parent = rootp.hdr.pageId; write(R);
+        Page L = read(leftPid); NH(L).parent = rootp.pageId(); write(L);
+        Page R = read(rightPid); NH(R).parent = rootp.pageId(); write(R);
 
         write(rootp);
-        setRoot(rootp.hdr.pageId);
+        setRoot(rootp.pageId());
         return;
     }
 
@@ -159,7 +178,7 @@ void BPlusTreeInt32::insertIntoParent(uint32_t leftPid, int32_t sepKey, uint32_t
     Page parent = read(parentPid);
 
     int M = maxInternalKeys();
-    auto* keys = IE(parent);
+    auto* keys = KEYS(parent);
     auto* ch = CHILD(parent, M);
     int kc = NHc(parent).keyCount;
 
@@ -168,13 +187,13 @@ void BPlusTreeInt32::insertIntoParent(uint32_t leftPid, int32_t sepKey, uint32_t
 
     for (int i = kc; i > iChild; --i) keys[i] = keys[i-1];
     for (int i = kc+1; i > iChild+1; --i) ch[i] = ch[i-1];
-    keys[iChild].key = sepKey;
+    keys[iChild] = sepKey;
     ch[iChild+1] = rightPid;
     NH(parent).keyCount = kc + 1;
 
     if (NHc(parent).keyCount <= maxInternalKeys()) {
         write(parent);
-        Page R = read(rightPid); NH(R).parent = parent.hdr.pageId; write(R);
+        Page R = read(rightPid); NH(R).parent = parent.pageId(); write(R);
     } else {
         splitInternalAndInsert(parent, 0 /*dummy*/, 0 /*unused*/);
         Page R = read(rightPid); write(R);
@@ -186,17 +205,16 @@ void BPlusTreeInt32::splitInternalAndInsert(Page& node, int32_t /*sepKeyUnused*/
     int mid = kc/2;
     int M = maxInternalKeys();
 
-    Page right;
-    right.hdr.pageId = st_->allocatePage();
-    NodeHdr nh{}; nh.pageId=right.hdr.pageId; nh.isLeaf=0; nh.keyCount=0; nh.parent=NHc(node).parent; nh.nextLeaf=0;
-    std::memcpy(right.bytes.data(), &nh, sizeof(NodeHdr));
+    Page right = read(st_->allocatePage());
+    NodeHdr nh{}; nh.pageId=right.pageId(); nh.isLeaf=0; nh.keyCount=0; nh.parent=NHc(node).parent; nh.nextLeaf=0;
+    std::memcpy(right.data(), &nh, sizeof(NodeHdr));
 
-    auto* keysL = IE(node);
+    auto* keysL = KEYS(node);
     auto* chL   = CHILD(node, M);
-    auto* keysR = IE(right);
+    auto* keysR = KEYS(right);
     auto* chR   = CHILD(right, M);
 
-    int32_t promote = keysL[mid].key;
+    int32_t promote = keysL[mid];
 
     int rkeys = kc - (mid + 1);
     for (int i=0;i<rkeys;i++) keysR[i] = keysL[mid+1 + i];
@@ -205,51 +223,67 @@ void BPlusTreeInt32::splitInternalAndInsert(Page& node, int32_t /*sepKeyUnused*/
     NH(node).keyCount = mid;
 
     for (int i=0;i<rkeys+1;i++) {
-        Page c = read(chR[i]); NH(c).parent = right.hdr.pageId; write(c);
+        Page c = read(chR[i]); NH(c).parent = right.pageId(); write(c);
     }
 
     NH(right).keyCount = rkeys;
     write(node); write(right);
 
-    insertIntoParent(node.hdr.pageId, promote, right.hdr.pageId);
+    insertIntoParent(node.pageId(), promote, right.pageId());
 }
 
 std::vector<RID> BPlusTreeInt32::find(int32_t key) {
-    uint32_t leafPid = findLeafForKey(key);
-    Page leaf = read(leafPid);
-    int lo = leafLowerBound(leaf, key);
-    int hi = leafUpperBound(leaf, key);
     std::vector<RID> out;
-    const auto* a = LEc(leaf);
-    for (int i=lo;i<hi;i++) out.push_back(RID{a[i].ridPage, a[i].ridSlot});
+    const int cap = maxLeafEntries();
+    Page leaf = read(findLeafForKey(key));
+    int i = lowerBound(KEYSc(leaf), NHc(leaf).keyCount, key);
+    while (true) {
+        const auto* keys = KEYSc(leaf);
+        const auto* rp = RIDPAGEc(leaf, cap);
+        const auto* rs = RIDSLOTc(leaf, cap);
+        int kc = NHc(leaf).keyCount;
+        for (; i<kc; i++) {
+            if (keys[i] != key) return out;
+            out.push_back(RID{rp[i], rs[i]});
+        }
+        if (NHc(leaf).nextLeaf == 0) break;
+        leaf = read(NHc(leaf).nextLeaf);
+        i = 0;
+    }
     return out;
 }
 
 std::vector<RID> BPlusTreeInt32::range(int32_t keyMin, int32_t keyMax) {
     if (keyMax < keyMin) return {};
     std::vector<RID> out;
-    uint32_t pid = findLeafForKey(keyMin);
-    Page leaf = read(pid);
+    const int cap = maxLeafEntries();
+    Page leaf = read(findLeafForKey(keyMin));
+    int i = lowerBound(KEYSc(leaf), NHc(leaf).keyCount, keyMin);
     while (true) {
-        const auto* a = LEc(leaf);
+        const auto* keys = KEYSc(leaf);
+        const auto* rp = RIDPAGEc(leaf, cap);
+        const auto* rs = RIDSLOTc(leaf, cap);
         int kc = NHc(leaf).keyCount;
-        for (int i=0;i<kc;i++) {
-            if (a[i].key < keyMin) continue;
-            if (a[i].key > keyMax) return out;
-            out.push_back(RID{a[i].ridPage, a[i].ridSlot});
+        for (; i<kc; i++) {
+            if (keys[i] > keyMax) return out;
+            out.push_back(RID{rp[i], rs[i]});
         }
         if (NHc(leaf).nextLeaf == 0) break;
         leaf = read(NHc(leaf).nextLeaf);
+        i = 0;
     }
     return out;
 }
 
 bool BPlusTreeInt32::removeFromLeaf(Page& leaf, int32_t k, RID rid) {
-    auto* a = LE(leaf);
+    const int cap = maxLeafEntries();
+    const auto* keys = KEYSc(leaf);
+    const auto* rp = RIDPAGEc(leaf, cap);
+    const auto* rs = RIDSLOTc(leaf, cap);
     int kc = NHc(leaf).keyCount;
-    for (int i=0;i<kc;i++) {
-        if (a[i].key==k && a[i].ridPage==rid.pageId && a[i].ridSlot==rid.slotId) {
-            for (int j=i+1;j<kc;j++) a[j-1]=a[j];
+    for (int i = lowerBound(keys, kc, k); i<kc && keys[i]==k; i++) {
+        if (rp[i]==rid.pageId && rs[i]==rid.slotId) {
+            copyLeafEntries(leaf, i, leaf, i+1, kc-i-1, cap);
             NH(leaf).keyCount = kc-1;
             return true;
         }
@@ -260,19 +294,25 @@ bool BPlusTreeInt32::removeFromLeaf(Page& leaf, int32_t k, RID rid) {
 void BPlusTreeInt32::remove(int32_t key, RID rid) {
     uint32_t leafPid = findLeafForKey(key);
     Page leaf = read(leafPid);
-    if (removeFromLeaf(leaf, key, rid)) {
-        write(leaf);
-        rebalanceAfterDelete(leafPid);
+    while (!removeFromLeaf(leaf, key, rid)) {
+        // duplicates of key may continue into the following leaves
+        int kc = NHc(leaf).keyCount;
+        if (kc > 0 && KEYSc(leaf)[kc-1] > key) return;
+        leafPid = NHc(leaf).nextLeaf;
+        if (leafPid == 0) return;
+        leaf = read(leafPid);
     }
+    write(leaf);
+    rebalanceAfterDelete(leafPid);
 }
 
 int32_t BPlusTreeInt32::firstKeyLeaf(const Page& leaf) {
     if (NHc(leaf).keyCount == 0) return INT32_MIN;
-    return LEc(leaf)[0].key;
+    return KEYSc(leaf)[0];
 }
 int32_t BPlusTreeInt32::firstKeyInternal(const Page& internal) {
     if (NHc(internal).keyCount == 0) return INT32_MIN;
-    return IEc(internal)[0].key;
+    return KEYSc(internal)[0];
 }
 
 void BPlusTreeInt32::rebalanceAfterDelete(uint32_t pid) {
@@ -362,14 +402,13 @@ bool BPlusTreeInt32::borrowFromLeftLeaf(Page& parent, int sepIdx, Page& left, Pa
     int kcN = NHc(node).keyCount;
     if (kcL <= minLeafEntries()) return false;
 
-    auto* aL = LE(left);
-    auto* aN = LE(node);
-    for (int i=kcN; i>0; --i) aN[i] = aN[i-1];
-    aN[0] = aL[kcL-1];
+    const int cap = maxLeafEntries();
+    copyLeafEntries(node, 1, node, 0, kcN, cap);
+    copyLeafEntries(node, 0, left, kcL-1, 1, cap);
     NH(node).keyCount = kcN + 1;
     NH(left).keyCount = kcL - 1;
 
-    IE(parent)[sepIdx].key = firstKeyLeaf(node);
+    KEYS(parent)[sepIdx] = firstKeyLeaf(node);
     return true;
 }
 
@@ -378,29 +417,26 @@ bool BPlusTreeInt32::borrowFromRightLeaf(Page& parent, int sepIdx, Page& node, P
     int kcN = NHc(node).keyCount;
     if (kcR <= minLeafEntries()) return false;
 
-    auto* aR = LE(right);
-    auto* aN = LE(node);
-    aN[kcN] = aR[0];
-    for (int i=1;i<kcR;i++) aR[i-1] = aR[i];
+    const int cap = maxLeafEntries();
+    copyLeafEntries(node, kcN, right, 0, 1, cap);
+    copyLeafEntries(right, 0, right, 1, kcR-1, cap);
     NH(node).keyCount = kcN + 1;
     NH(right).keyCount = kcR - 1;
 
-    IE(parent)[sepIdx].key = firstKeyLeaf(right);
+    KEYS(parent)[sepIdx] = firstKeyLeaf(right);
     return true;
 }
 
 void BPlusTreeInt32::mergeLeaves(Page& parent, int sepIdxLeft, Page& left, Page& right) {
     int kcL = NHc(left).keyCount;
     int kcR = NHc(right).keyCount;
-    auto* aL = LE(left);
-    const auto* aR = LEc(right);
-    for (int i=0;i<kcR;i++) aL[kcL+i] = aR[i];
+    copyLeafEntries(left, kcL, right, 0, kcR, maxLeafEntries());
     NH(left).keyCount = kcL + kcR;
 
     NH(left).nextLeaf = NHc(right).nextLeaf;
 
     int M = maxInternalKeys();
-    auto* keysP = IE(parent);
+    auto* keysP = KEYS(parent);
     auto* chP = CHILD(parent, M);
     int kcP = NHc(parent).keyCount;
 
@@ -415,24 +451,24 @@ bool BPlusTreeInt32::borrowFromLeftInternal(Page& parent, int sepIdx, Page& left
     if (kcL <= minInternalKeys()) return false;
 
     int M = maxInternalKeys();
-    auto* keysL = IE(left);
+    auto* keysL = KEYS(left);
     auto* chL   = CHILD(left, M);
-    auto* keysN = IE(node);
+    auto* keysN = KEYS(node);
     auto* chN   = CHILD(node, M);
 
     for (int i=kcN; i>0; --i) keysN[i] = keysN[i-1];
     for (int i=kcN+1; i>0; --i) chN[i] = chN[i-1];
 
-    keysN[0].key = IEc(parent)[sepIdx].key;
+    keysN[0] = KEYSc(parent)[sepIdx];
     chN[0] = chL[kcL];
 
-    IE(parent)[sepIdx].key = keysL[kcL-1].key;
+    KEYS(parent)[sepIdx] = keysL[kcL-1];
 
     NH(left).keyCount = kcL - 1;
     NH(node).keyCount = kcN + 1;
 
     Page movedChild = read(chN[0]);
-    NH(movedChild).parent = node.hdr.pageId;
+    NH(movedChild).parent = node.pageId();
     write(movedChild);
     return true;
 }
@@ -443,15 +479,15 @@ bool BPlusTreeInt32::borrowFromRightInternal(Page& parent, int sepIdx, Page& nod
     if (kcR <= minInternalKeys()) return false;
 
     int M = maxInternalKeys();
-    auto* keysR = IE(right);
+    auto* keysR = KEYS(right);
     auto* chR   = CHILD(right, M);
-    auto* keysN = IE(node);
+    auto* keysN = KEYS(node);
     auto* chN   = CHILD(node, M);
 
-    keysN[kcN].key = IEc(parent)[sepIdx].key;
+    keysN[kcN] = KEYSc(parent)[sepIdx];
     chN[kcN+1] = chR[0];
 
-    IE(parent)[sepIdx].key = keysR[0].key;
+    KEYS(parent)[sepIdx] = keysR[0];
 
     for (int i=1;i<kcR;i++) keysR[i-1] = keysR[i];
     for (int i=1;i<kcR+1;i++) chR[i-1] = chR[i];
@@ -460,7 +496,7 @@ bool BPlusTreeInt32::borrowFromRightInternal(Page& parent, int sepIdx, Page& nod
     NH(node).keyCount  = kcN + 1;
 
     Page movedChild = read(chN[kcN+1]);
-    NH(movedChild).parent = node.hdr.pageId;
+    NH(movedChild).parent = node.pageId();
     write(movedChild);
     return true;
 }
@@ -470,24 +506,24 @@ void BPlusTreeInt32::mergeInternals(Page& parent, int sepIdxLeft, Page& left, Pa
     int kcR = NHc(right).keyCount;
     int M = maxInternalKeys();
 
-    auto* keysL = IE(left);
+    auto* keysL = KEYS(left);
     auto* chL   = CHILD(left, M);
-    const auto* keysR = IEc(right);
+    const auto* keysR = KEYSc(right);
     const auto* chR   = CHILDc(right, M);
 
-    keysL[kcL].key = IEc(parent)[sepIdxLeft].key;
+    keysL[kcL] = KEYSc(parent)[sepIdxLeft];
     chL[kcL+1] = chR[0];
 
     for (int i=0;i<kcR;i++) keysL[kcL+1+i] = keysR[i];
     for (int i=1;i<kcR+1;i++) chL[kcL+1+i] = chR[i];
 
     for (int i=0;i<kcR+1;i++) {
-        Page c = read(chR[i]); NH(c).parent = left.hdr.pageId; write(c);
+        Page c = read(chR[i]); NH(c).parent = left.pageId(); write(c);
     }
 
     NH(left).keyCount = kcL + 1 + kcR;
 
-    auto* keysP = IE(parent);
+    auto* keysP = KEYS(parent);
     auto* chP   = CHILD(parent, M);
     int kcP = NHc(parent).keyCount;
     for (int i=sepIdxLeft; i<kcP-1; ++i) keysP[i] = keysP[i+1];
@@ -495,4 +531,77 @@ void BPlusTreeInt32::mergeInternals(Page& parent, int sepIdxLeft, Page& left, Pa
     NH(parent).keyCount = kcP - 1;
 }
 
+// Nodes are filled to fillFactor of capacity, never below the minimum.
+static int bulkCapacity(int maxN, int minN, double fillFactor) {
+    int c = static_cast<int>(maxN * fillFactor);
+    return std::min(maxN, std::max(minN, c));
+}
+
+// Bottom-up build: leaves are written left to right, then each internal level
+// in one pass over the level below. Entries are spread evenly over the nodes
+// of a level so the last node is not left underfull.
+void BPlusTreeInt32::bulkLoad(const std::function<bool(LeafEntry&)>& next, uint64_t count, double fillFactor) {
+    Page leaf = read(ensureRootLeaf());
+    if (!NHc(leaf).isLeaf || NHc(leaf).keyCount != 0) throw std::runtime_error("B+ bulk load needs an empty tree");
+    if (count == 0) return;
+
+    struct Child { int32_t key; uint32_t pid; };
+    const int cap = maxLeafEntries();
+    const uint64_t leafCap = bulkCapacity(cap, minLeafEntries(), fillFactor);
+    const uint64_t leaves = (count + leafCap - 1) / leafCap;
+    std::vector<Child> level;
+    level.reserve(leaves);
+
+    for (uint64_t i = 0; i < leaves; ++i) {
+        const int n = static_cast<int>(count / leaves + (i < count % leaves ? 1 : 0));
+        auto* keys = KEYS(leaf);
+        auto* rp = RIDPAGE(leaf, cap);
+        auto* rs = RIDSLOT(leaf, cap);
+        LeafEntry e{};
+        for (int j = 0; j < n; ++j) {
+            if (!next(e)) throw std::runtime_error("B+ bulk load: input ended early");
+            keys[j] = e.key; rp[j] = e.ridPage; rs[j] = e.ridSlot;
+        }
+        NodeHdr nh{}; nh.pageId=leaf.pageId(); nh.isLeaf=1; nh.keyCount=n; nh.parent=0; nh.nextLeaf=0;
+        level.push_back(Child{keys[0], leaf.pageId()});
+        if (i + 1 == leaves) {
+            std::memcpy(leaf.data(), &nh, sizeof(NodeHdr));
+            write(leaf);
+            break;
+        }
+        Page right = read(st_->allocatePage());
+        nh.nextLeaf = right.pageId();
+        std::memcpy(leaf.data(), &nh, sizeof(NodeHdr));
+        write(leaf);
+        leaf = std::move(right);
+    }
+
+    const int M = maxInternalKeys();
+    const uint64_t fanout = bulkCapacity(M, minInternalKeys(), fillFactor) + 1;
+    while (level.size() > 1) {
+        const uint64_t nodes = (level.size() + fanout - 1) / fanout;
+        std::vector<Child> up;
+        up.reserve(nodes);
+        size_t c = 0;
+        for (uint64_t i = 0; i < nodes; ++i) {
+            const int n = static_cast<int>(level.size() / nodes + (i < level.size() % nodes ? 1 : 0));
+            Page node = read(st_->allocatePage());
+            NodeHdr nh{}; nh.pageId=node.pageId(); nh.isLeaf=0; nh.keyCount=n-1; nh.parent=0; nh.nextLeaf=0;
+            std::memcpy(node.data(), &nh, sizeof(NodeHdr));
+            auto* keys = KEYS(node);
+            auto* ch = CHILD(node, M);
+            for (int j = 0; j < n; ++j) {
+                ch[j] = level[c + j].pid;
+                if (j > 0) keys[j-1] = level[c + j].key;
+                Page child = read(ch[j]); NH(child).parent = node.pageId(); write(child);
+            }
+            write(node);
+            up.push_back(Child{level[c].key, node.pageId()});
+            c += n;
+        }
+        level.swap(up);
+    }
+    setRoot(level[0].pid);
+}
+
 }
@@ -3,9 +3,13 @@
 #include "Record.h"
 #include <vector>
 #include <optional>
+#include <functional>
 
 namespace ma {
 
+// IdxHeader::keyKind of int32 indexes with the split key/payload node layout.
+constexpr uint16_t INTIDX_KEY_KIND = 1;
+
 #pragma pack(push,1)
 struct NodeHdr {
     uint32_t pageId;
@@ -17,6 +21,7 @@ struct NodeHdr {
 };
 #pragma pack(pop)
 
+// Sort record for bulk loading.
 struct LeafEntry {
     int32_t  key;
     uint32_t ridPage;
@@ -24,11 +29,6 @@ struct LeafEntry {
     uint16_t pad;
 };
 
-struct InternalEntry {
-    int32_t  key;
-    uint32_t child;
-};
-
 class BPlusTreeInt32 {
 public:
     explicit BPlusTreeInt32(IndexStorage* storage);
@@ -41,6 +41,9 @@ public:
     std::vector<RID> find(int32_t key);
     std::vector<RID> range(int32_t keyMin, int32_t keyMax);
 
+    // Fills an empty tree from count entries delivered in key order.
+    void bulkLoad(const std::function<bool(LeafEntry&)>& next, uint64_t count, double fillFactor);
+
 private:
     IndexStorage* st_{};
 
@@ -52,40 +55,52 @@ private:
     uint32_t ensureRootLeaf();
     uint32_t findLeafForKey(int32_t k);
 
-    static int maxLeafEntries();
-    static int maxInternalKeys();
-    static int minLeafEntries();
-    static int minInternalKeys();
+    int maxLeafEntries() const;
+    int maxInternalKeys() const;
+    int minLeafEntries() const;
+    int minInternalKeys() const;
 
-    static int leafLowerBound(const Page& leaf, int32_t k);
-    static int leafUpperBound(const Page& leaf, int32_t k);
-    static int internalChildIndex(const Page& internal, int32_t k);
+    // Node keys sit in one contiguous int32_t array at KEYS_OFFSET, so a
+    // search reads only keys; payloads follow in parallel arrays sized for a
+    // full node. Leaf: keys[cap], ridPage[cap], ridSlot[cap]. Internal:
+    // keys[M+1], children[M+2], one spare key for the overflow before a split.
+    static constexpr int KEYS_OFFSET = 32;
 
     static inline NodeHdr& NH(Page& p) {
-        return *reinterpret_cast<NodeHdr*>(p.bytes.data());
+        return *reinterpret_cast<NodeHdr*>(p.data());
     }
     static inline const NodeHdr& NHc(const Page& p) {
-        return *reinterpret_cast<const NodeHdr*>(p.bytes.data());
+        return *reinterpret_cast<const NodeHdr*>(p.data());
+    }
+    static inline int32_t* KEYS(Page& p) {
+        return reinterpret_cast<int32_t*>(p.data() + KEYS_OFFSET);
     }
-    static inline LeafEntry* LE(Page& p) {
-        return reinterpret_cast<LeafEntry*>(p.bytes.data() + sizeof(NodeHdr));
+    static inline const int32_t* KEYSc(const Page& p) {
+        return reinterpret_cast<const int32_t*>(p.data() + KEYS_OFFSET);
     }
-    static inline const LeafEntry* LEc(const Page& p) {
-        return reinterpret_cast<const LeafEntry*>(p.bytes.data() + sizeof(NodeHdr));
+    static inline uint32_t* RIDPAGE(Page& p, int cap) {
+        return reinterpret_cast<uint32_t*>(p.data() + KEYS_OFFSET + cap * sizeof(int32_t));
     }
-    static inline InternalEntry* IE(Page& p) {
-        return reinterpret_cast<InternalEntry*>(p.bytes.data() + sizeof(NodeHdr));
+    static inline const uint32_t* RIDPAGEc(const Page& p, int cap) {
+        return reinterpret_cast<const uint32_t*>(p.data() + KEYS_OFFSET + cap * sizeof(int32_t));
     }
-    static inline const InternalEntry* IEc(const Page& p) {
-        return reinterpret_cast<const InternalEntry*>(p.bytes.data() + sizeof(NodeHdr));
+    static inline uint16_t* RIDSLOT(Page& p, int cap) {
+        return reinterpret_cast<uint16_t*>(p.data() + KEYS_OFFSET + cap * (sizeof(int32_t) + sizeof(uint32_t)));
+    }
+    static inline const uint16_t* RIDSLOTc(const Page& p, int cap) {
+        return reinterpret_cast<const uint16_t*>(p.data() + KEYS_OFFSET + cap * (sizeof(int32_t) + sizeof(uint32_t)));
     }
     static inline uint32_t* CHILD(Page& p, int maxKeys) {
-        return reinterpret_cast<uint32_t*>(p.bytes.data() + sizeof(NodeHdr) + maxKeys * sizeof(InternalEntry));
+        return reinterpret_cast<uint32_t*>(p.data() + KEYS_OFFSET + (maxKeys + 1) * sizeof(int32_t));
     }
     static inline const uint32_t* CHILDc(const Page& p, int maxKeys) {
-        return reinterpret_cast<const uint32_t*>(p.bytes.data() + sizeof(NodeHdr) + maxKeys * sizeof(InternalEntry));
+        return reinterpret_cast<const uint32_t*>(p.data() + KEYS_OFFSET + (maxKeys + 1) * sizeof(int32_t));
     }
 
+    static int lowerBound(const int32_t* keys, int n, int32_t k);
+    static int upperBound(const int32_t* keys, int n, int32_t k);
+    static void copyLeafEntries(Page& dst, int di, const Page& src, int si, int n, int cap);
+
     void insertIntoLeaf(Page& leaf, int32_t k, RID rid);
     void splitLeafAndInsert(Page& leaf, int32_t k, RID rid);
     void insertIntoParent(uint32_t leftPid, int32_t sepKey, uint32_t rightPid);
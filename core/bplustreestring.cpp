@@ -1,13 +1,31 @@
 #include "BPlusTreeString.h"
 #include <algorithm>
+#include <climits>
 #include <stdexcept>
 #include <cstring>
 
 namespace ma {
 
-static constexpr int LEAF_ENTRY_SIZE  = sizeof(LeafEntryS);
-static constexpr int INTERNAL_ENTRY_SIZE = sizeof(InternalEntryS);
-static constexpr int CHILD_PTR_SIZE   = sizeof(uint32_t);
+static constexpr int SLOT_BYTES     = sizeof(uint16_t);
+static constexpr int RID_BYTES      = sizeof(uint32_t) + sizeof(uint16_t);
+static constexpr int CHILD_PTR_SIZE = sizeof(uint32_t);
+
+static int payloadBytes(bool leaf) { return leaf ? RID_BYTES : CHILD_PTR_SIZE; }
+
+static int commonPrefix(const std::string& a, const std::string& b) {
+    const size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) ++i;
+    return static_cast<int>(i);
+}
+
+static int cmpBytes(const void* a, int an, const void* b, int bn) {
+    int c = std::memcmp(a, b, std::min(an, bn));
+    if (c != 0) return c;
+    if (an < bn) return -1;
+    if (an > bn) return  1;
+    return 0;
+}
 
 StrKey BPlusTreeString::packKey(const std::string& s) {
     StrKey k{};
@@ -22,275 +40,422 @@ StrKey BPlusTreeString::packKey(const std::string& s) {
 }
 
 int BPlusTreeString::cmpKey(const StrKey& a, const StrKey& b) {
-    int n = std::min<int>(a.len, b.len);
-    int c = std::memcmp(a.bytes, b.bytes, n);
-    if (c != 0) return c;
-    if (a.len < b.len) return -1;
-    if (a.len > b.len) return  1;
-    return 0;
+    return cmpBytes(a.bytes, a.len, b.bytes, b.len);
 }
 
-int BPlusTreeString::maxLeafEntries() {
-    return (PAGE_SIZE - (int)sizeof(NodeHdrS)) / LEAF_ENTRY_SIZE;
+int BPlusTreeString::capacity() const {
+    return (int)pageEnd(st_->pageSize()) - (int)sizeof(NodeHdrS);
 }
-int BPlusTreeString::maxInternalKeys() {
-    int M = (PAGE_SIZE - (int)sizeof(NodeHdrS) - (int)sizeof(uint32_t)) /
-            (INTERNAL_ENTRY_SIZE + (int)sizeof(uint32_t));
-    return std::max(3, M-1);
-}
-int BPlusTreeString::minLeafEntries()  { return std::max(1, maxLeafEntries() / 2); }
-int BPlusTreeString::minInternalKeys() { return std::max(1, maxInternalKeys() / 2); }
 
 BPlusTreeString::BPlusTreeString(IndexStorage* storage): st_(storage) {}
 bool BPlusTreeString::isEmpty() const { return st_->rootPageId() == 0; }
 
 uint32_t BPlusTreeString::ensureRootLeaf() {
     if (!isEmpty()) return root();
-    Page leaf; leaf.hdr.pageId = st_->allocatePage();
-    NodeHdrS nh{}; nh.pageId=leaf.hdr.pageId; nh.isLeaf=1; nh.keyCount=0; nh.parent=0; nh.nextLeaf=0;
-    std::memcpy(leaf.bytes.data(), &nh, sizeof(NodeHdrS));
+    Page leaf = read(st_->allocatePage());
+    NodeHdrS nh{}; nh.pageId=leaf.pageId(); nh.isLeaf=1; nh.keyCount=0; nh.parent=0; nh.nextLeaf=0;
+    nh.cellStart = static_cast<uint16_t>(pageEnd(leaf.size()));
+    std::memcpy(leaf.data(), &nh, sizeof(NodeHdrS));
     write(leaf);
-    setRoot(leaf.hdr.pageId);
-    return leaf.hdr.pageId;
+    setRoot(leaf.pageId());
+    return leaf.pageId();
 }
 
 void BPlusTreeString::createEmpty() { ensureRootLeaf(); }
 
-uint32_t BPlusTreeString::findLeafForKey(const StrKey& k) {
-    uint32_t pid = ensureRootLeaf();
-    Page p = read(pid);
-    while (!NHc(p).isLeaf) {
-        int M = maxInternalKeys();
-        const auto* keys = IEc(p);
-        const auto* ch = CHILDc(p, M);
-        int kc = NHc(p).keyCount;
-        (void)keys; (void)kc;
-        int i = internalChildIndex(p, k);
-        pid = ch[i];
-        p = read(pid);
+// Bytes past the header taken by keys [first, last) of es packed into one node.
+int BPlusTreeString::nodeBytes(bool leaf, const std::vector<Entry>& es, size_t first, size_t last) {
+    if (first >= last) return 0;
+    const int pfx = commonPrefix(es[first].key, es[last-1].key);
+    int bytes = pfx;
+    for (size_t i = first; i < last; ++i)
+        bytes += SLOT_BYTES + 1 + (int)es[i].key.size() - pfx + payloadBytes(leaf);
+    return bytes;
+}
+
+int BPlusTreeString::usedBytes(const Page& p) {
+    const int kc = NHc(p).keyCount;
+    if (kc == 0) return 0;
+    const int pay = payloadBytes(NHc(p).isLeaf);
+    int bytes = NHc(p).prefixLen + kc * SLOT_BYTES;
+    for (int i = 0; i < kc; ++i) bytes += 1 + CELL(p, i)[0] + pay;
+    return bytes;
+}
+
+std::vector<BPlusTreeString::Entry> BPlusTreeString::decode(const Page& p) {
+    const int kc = NHc(p).keyCount;
+    const bool leaf = NHc(p).isLeaf;
+    const char* pre = reinterpret_cast<const char*>(PREFIX(p));
+    const int pl = NHc(p).prefixLen;
+    std::vector<Entry> out(kc);
+    for (int i = 0; i < kc; ++i) {
+        const uint8_t* c = CELL(p, i);
+        Entry& e = out[i];
+        e.key.reserve(pl + c[0]);
+        e.key.assign(pre, pl);
+        e.key.append(reinterpret_cast<const char*>(c + 1), c[0]);
+        std::memcpy(&e.ref, c + 1 + c[0], sizeof(uint32_t));
+        e.slot = 0;
+        if (leaf) std::memcpy(&e.slot, c + 1 + c[0] + sizeof(uint32_t), sizeof(uint16_t));
     }
-    return pid;
+    return out;
+}
+
+// Rewrites p's keys as es[first, last), recomputing the shared prefix. The
+// rest of the header (links, firstChild) is left as it is.
+void BPlusTreeString::pack(Page& p, const std::vector<Entry>& es, size_t first, size_t last) {
+    const bool leaf = NHc(p).isLeaf;
+    const int end = (int)pageEnd(p.size());
+    if ((int)sizeof(NodeHdrS) + nodeBytes(leaf, es, first, last) > end)
+        throw std::runtime_error("B+ node overflow");
+    const int n = (int)(last - first);
+    const int pl = n ? commonPrefix(es[first].key, es[last-1].key) : 0;
+    NH(p).keyCount = static_cast<uint16_t>(n);
+    NH(p).prefixLen = static_cast<uint8_t>(pl);
+    if (pl) std::memcpy(p.data() + sizeof(NodeHdrS), es[first].key.data(), pl);
+
+    uint8_t* slots = SLOTS(p);
+    const int pay = payloadBytes(leaf);
+    int off = end;
+    for (int i = 0; i < n; ++i) {
+        const Entry& e = es[first + i];
+        const int suf = (int)e.key.size() - pl;
+        off -= 1 + suf + pay;
+        uint8_t* c = p.data() + off;
+        c[0] = static_cast<uint8_t>(suf);
+        std::memcpy(c + 1, e.key.data() + pl, suf);
+        std::memcpy(c + 1 + suf, &e.ref, sizeof(uint32_t));
+        if (leaf) std::memcpy(c + 1 + suf + sizeof(uint32_t), &e.slot, sizeof(uint16_t));
+        const uint16_t o = static_cast<uint16_t>(off);
+        std::memcpy(slots + i * SLOT_BYTES, &o, sizeof(o));
+    }
+    NH(p).cellStart = static_cast<uint16_t>(off);
+}
+
+// Shortest key s with leftLast < s <= rightFirst; rightFirst itself when a
+// run of duplicates straddles the split.
+std::string BPlusTreeString::separator(const std::string& leftLast, const std::string& rightFirst) {
+    const size_t n = commonPrefix(leftLast, rightFirst);
+    if (n >= rightFirst.size()) return rightFirst;
+    return rightFirst.substr(0, n + 1);
+}
+
+// Where to split an overfull node: both halves must fit and be close in size.
+// Leaves split before the returned index and, among near-even choices, take
+// the one with the shortest separator. Internal nodes push that key up.
+size_t BPlusTreeString::chooseSplit(bool leaf, const std::vector<Entry>& es) const {
+    const size_t n = es.size();
+    const int cap = capacity();
+    const int pay = payloadBytes(leaf);
+    std::vector<int> raw(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) raw[i+1] = raw[i] + SLOT_BYTES + 1 + (int)es[i].key.size() + pay;
+    auto bytes = [&](size_t first, size_t last) {
+        if (first >= last) return 0;
+        const int pfx = commonPrefix(es[first].key, es[last-1].key);
+        return pfx + raw[last] - raw[first] - (int)(last - first) * pfx;
+    };
+
+    std::vector<int> worst(n, INT_MAX);
+    size_t best = 0;
+    for (size_t m = 1; m + (leaf ? 0 : 1) < n; ++m) {
+        const int l = bytes(0, m);
+        const int r = bytes(leaf ? m : m + 1, n);
+        if (l > cap || r > cap) continue;
+        worst[m] = std::max(l, r);
+        if (best == 0 || worst[m] < worst[best]) best = m;
+    }
+    if (best == 0) throw std::runtime_error("B+ node split failed");
+    if (!leaf) return best;
+
+    auto sepLen = [&](size_t m) {
+        return std::min<size_t>(commonPrefix(es[m-1].key, es[m].key) + 1, es[m].key.size());
+    };
+    const int slack = cap / 16;
+    size_t pick = best;
+    for (size_t m = 1; m < n; ++m) {
+        if (worst[m] > worst[best] + slack) continue;
+        if (sepLen(m) < sepLen(pick)) pick = m;
+    }
+    return pick;
+}
+
+// Orders k against the node's shared prefix: negative or positive when k
+// sorts before or after every key in the node, 0 when k starts with it.
+int BPlusTreeString::cmpPrefix(const Page& p, const StrKey& k) {
+    const int pl = NHc(p).prefixLen;
+    int c = std::memcmp(k.bytes, PREFIX(p), std::min<int>(pl, k.len));
+    if (c != 0) return c;
+    return k.len < pl ? -1 : 0;
+}
+
+// Compares key i of the node with k.
+int BPlusTreeString::cmpAt(const Page& p, int i, const StrKey& k) {
+    const int pc = cmpPrefix(p, k);
+    if (pc != 0) return -pc;
+    const int pl = NHc(p).prefixLen;
+    const uint8_t* c = CELL(p, i);
+    return cmpBytes(c + 1, c[0], k.bytes + pl, k.len - pl);
 }
 
-int BPlusTreeString::leafLowerBound(const Page& leaf, const StrKey& k) {
-    int lo = 0, hi = NHc(leaf).keyCount;
-    const auto* a = LEc(leaf);
+// Number of keys in the node below k; for an internal node, the child to descend into.
+int BPlusTreeString::lowerBound(const Page& node, const StrKey& k) {
+    const int kc = NHc(node).keyCount;
+    const int pc = cmpPrefix(node, k);
+    if (pc < 0) return 0;
+    if (pc > 0) return kc;
+    const int pl = NHc(node).prefixLen;
+    int lo = 0, hi = kc;
     while (lo < hi) {
         int mid = (lo + hi) / 2;
-        if (cmpKey(a[mid].key, k) < 0) lo = mid + 1; else hi = mid;
+        const uint8_t* c = CELL(node, mid);
+        if (cmpBytes(c + 1, c[0], k.bytes + pl, k.len - pl) < 0) lo = mid + 1; else hi = mid;
     }
     return lo;
 }
-int BPlusTreeString::leafUpperBound(const Page& leaf, const StrKey& k) {
-    int lo = 0, hi = NHc(leaf).keyCount;
-    const auto* a = LEc(leaf);
+int BPlusTreeString::upperBound(const Page& node, const StrKey& k) {
+    const int kc = NHc(node).keyCount;
+    const int pc = cmpPrefix(node, k);
+    if (pc < 0) return 0;
+    if (pc > 0) return kc;
+    const int pl = NHc(node).prefixLen;
+    int lo = 0, hi = kc;
     while (lo < hi) {
         int mid = (lo + hi) / 2;
-        if (cmpKey(a[mid].key, k) <= 0) lo = mid + 1; else hi = mid;
+        const uint8_t* c = CELL(node, mid);
+        if (cmpBytes(c + 1, c[0], k.bytes + pl, k.len - pl) <= 0) lo = mid + 1; else hi = mid;
     }
     return lo;
 }
-int BPlusTreeString::internalChildIndex(const Page& internal, const StrKey& k) {
-    int kc = NHc(internal).keyCount;
-    const auto* a = IEc(internal);
-    int i = 0;
-    while (i < kc && cmpKey(a[i].key, k) <= 0) ++i;
-    return i;
+
+uint32_t BPlusTreeString::childAt(const Page& internal, int i) {
+    if (i == 0) return NHc(internal).firstChild;
+    const uint8_t* c = CELL(internal, i - 1);
+    uint32_t child;
+    std::memcpy(&child, c + 1 + c[0], sizeof(child));
+    return child;
+}
+
+int BPlusTreeString::childIndex(const Page& internal, uint32_t child) {
+    const int kc = NHc(internal).keyCount;
+    for (int i = 0; i <= kc; ++i)
+        if (childAt(internal, i) == child) return i;
+    throw std::runtime_error("B+ parent child not found");
+}
+
+RID BPlusTreeString::ridAt(const Page& leaf, int i) {
+    const uint8_t* c = CELL(leaf, i);
+    RID r;
+    std::memcpy(&r.pageId, c + 1 + c[0], sizeof(uint32_t));
+    std::memcpy(&r.slotId, c + 1 + c[0] + sizeof(uint32_t), sizeof(uint16_t));
+    return r;
+}
+
+uint32_t BPlusTreeString::findLeafForKey(const StrKey& k) {
+    uint32_t pid = ensureRootLeaf();
+    Page p = read(pid);
+    while (!NHc(p).isLeaf) {
+        pid = childAt(p, lowerBound(p, k));
+        p = read(pid);
+    }
+    return pid;
 }
 
 void BPlusTreeString::insert(const StrKey& key, RID rid) {
-    uint32_t leafPid = findLeafForKey(key);
-    Page leaf = read(leafPid);
-    int maxE = maxLeafEntries();
-    if (NHc(leaf).keyCount < maxE) {
-        insertIntoLeaf(leaf, key, rid);
+    Page leaf = read(findLeafForKey(key));
+    if (insertIntoLeaf(leaf, key, rid)) {
+        write(leaf);
+        return;
+    }
+    auto es = decode(leaf);
+    es.insert(es.begin() + upperBound(leaf, key), Entry{std::string(key.bytes, key.len), rid.pageId, rid.slotId});
+    if (nodeBytes(true, es, 0, es.size()) <= capacity()) {
+        pack(leaf, es, 0, es.size());
         write(leaf);
     } else {
-        splitLeafAndInsert(leaf, key, rid);
+        splitLeaf(leaf, es);
     }
 }
 
-void BPlusTreeString::insertIntoLeaf(Page& leaf, const StrKey& k, RID rid) {
-    int pos = leafUpperBound(leaf, k);
-    int kc = NHc(leaf).keyCount;
-    auto* a = LE(leaf);
-    for (int i = kc; i > pos; --i) a[i] = a[i-1];
-    a[pos].key = k; a[pos].ridPage = rid.pageId; a[pos].ridSlot = rid.slotId; a[pos].pad=0;
+// Adds the entry in place when the key shares the node prefix and its cell
+// fits in the gap between the slots and the cells; otherwise the caller repacks.
+bool BPlusTreeString::insertIntoLeaf(Page& leaf, const StrKey& k, RID rid) {
+    if (cmpPrefix(leaf, k) != 0) return false;
+    const int pl = NHc(leaf).prefixLen;
+    const int kc = NHc(leaf).keyCount;
+    const int suf = k.len - pl;
+    const int cell = 1 + suf + RID_BYTES;
+    const int slotsEnd = (int)sizeof(NodeHdrS) + pl + (kc + 1) * SLOT_BYTES;
+    if ((int)NHc(leaf).cellStart < slotsEnd + cell) return false;
+
+    const int pos = upperBound(leaf, k);
+    const uint16_t off = static_cast<uint16_t>(NHc(leaf).cellStart - cell);
+    uint8_t* c = leaf.data() + off;
+    c[0] = static_cast<uint8_t>(suf);
+    std::memcpy(c + 1, k.bytes + pl, suf);
+    std::memcpy(c + 1 + suf, &rid.pageId, sizeof(uint32_t));
+    std::memcpy(c + 1 + suf + sizeof(uint32_t), &rid.slotId, sizeof(uint16_t));
+
+    uint8_t* slots = SLOTS(leaf);
+    std::memmove(slots + (pos + 1) * SLOT_BYTES, slots + pos * SLOT_BYTES, (kc - pos) * SLOT_BYTES);
+    std::memcpy(slots + pos * SLOT_BYTES, &off, sizeof(off));
+    NH(leaf).cellStart = off;
     NH(leaf).keyCount = kc + 1;
+    return true;
 }
 
-void BPlusTreeString::splitLeafAndInsert(Page& leaf, const StrKey& k, RID rid) {
-    Page right; right.hdr.pageId = st_->allocatePage();
-    NodeHdrS rnh{}; rnh.pageId=right.hdr.pageId; rnh.isLeaf=1; rnh.keyCount=0; rnh.parent=NHc(leaf).parent; rnh.nextLeaf=NHc(leaf).nextLeaf;
-    std::memcpy(right.bytes.data(), &rnh, sizeof(NodeHdrS));
-
-    int kc = NHc(leaf).keyCount;
-    int move = kc/2;
-    auto* la = LE(leaf);
-    auto* ra = LE(right);
-    for (int i=0;i<move;i++) ra[i] = la[kc - move + i];
-    NH(right).keyCount = move;
-    NH(leaf).keyCount = kc - move;
-    NH(leaf).nextLeaf = right.hdr.pageId;
-
-    if (cmpKey(k, LEc(right)[0].key) >= 0) insertIntoLeaf(right, k, rid);
-    else insertIntoLeaf(leaf, k, rid);
+void BPlusTreeString::splitLeaf(Page& leaf, const std::vector<Entry>& es) {
+    const size_t m = chooseSplit(true, es);
+    Page right = read(st_->allocatePage());
+    NodeHdrS rnh{}; rnh.pageId=right.pageId(); rnh.isLeaf=1; rnh.keyCount=0; rnh.parent=NHc(leaf).parent; rnh.nextLeaf=NHc(leaf).nextLeaf;
+    std::memcpy(right.data(), &rnh, sizeof(NodeHdrS));
+    pack(right, es, m, es.size());
+    NH(leaf).nextLeaf = right.pageId();
+    pack(leaf, es, 0, m);
 
     write(leaf); write(right);
-
-    StrKey sepKey = LEc(right)[0].key;
-    insertIntoParent(leaf.hdr.pageId, sepKey, right.hdr.pageId);
+    insertIntoParent(leaf.pageId(), separator(es[m-1].key, es[m].key), right.pageId());
 }
 
-void BPlusTreeString::insertIntoParent(uint32_t leftPid, const StrKey& sepKey, uint32_t rightPid) {
+void BPlusTreeString::insertIntoParent(uint32_t leftPid, const std::string& sepKey, uint32_t rightPid) {
     if (leftPid == root()) {
-        Page rootp; rootp.hdr.pageId = st_->allocatePage();
-        NodeHdrS nh{}; nh.pageId=rootp.hdr.pageId; nh.isLeaf=0; nh.keyCount=1; nh.parent=0; nh.nextLeaf=0;
-        std::memcpy(rootp.bytes.data(), &nh, sizeof(NodeHdrS));
+        Page rootp = read(st_->allocatePage());
+        NodeHdrS nh{}; nh.pageId=rootp.pageId(); nh.isLeaf=0; nh.parent=0; nh.nextLeaf=0; nh.firstChild=leftPid;
+        std::memcpy(rootp.data(), &nh, sizeof(NodeHdrS));
+        pack(rootp, {Entry{sepKey, rightPid, 0}}, 0, 1);
 
-        int M = maxInternalKeys();
-        auto* keys = IE(rootp);
-        auto* ch = CHILD(rootp, M);
-        keys[0].key = sepKey;
-        ch[0] = leftPid;
-        ch[1] = rightPid;
-
-        Page L = read(leftPid);  NH(L).parent = rootp.hdr.pageId; write(L);
-        Page R = read(rightPid); NH(R).parent = rootp.hdr.pageId; write(R);
+        Page L = read(leftPid);  NH(L).parent = rootp.pageId(); write(L);
+        Page R = read(rightPid); NH(R).parent = rootp.pageId(); write(R);
 
         write(rootp);
-        setRoot(rootp.hdr.pageId);
+        setRoot(rootp.pageId());
         return;
     }
 
     Page left = read(leftPid);
-    uint32_t parentPid = NHc(left).parent;
-    Page parent = read(parentPid);
+    Page parent = read(NHc(left).parent);
+    auto es = decode(parent);
+    es.insert(es.begin() + childIndex(parent, leftPid), Entry{sepKey, rightPid, 0});
 
-    int M = maxInternalKeys();
-    auto* keys = IE(parent);
-    auto* ch = CHILD(parent, M);
-    int kc = NHc(parent).keyCount;
-
-    int iChild = 0; while (iChild <= kc && ch[iChild] != leftPid) ++iChild;
-    if (iChild > kc) throw std::runtime_error("B+ parent child not found");
-
-    for (int i = kc; i > iChild; --i) keys[i] = keys[i-1];
-    for (int i = kc+1; i > iChild+1; --i) ch[i] = ch[i-1];
-    keys[iChild].key = sepKey;
-    ch[iChild+1] = rightPid;
-    NH(parent).keyCount = kc + 1;
+    Page R = read(rightPid); NH(R).parent = parent.pageId(); write(R);
+    storeInternal(parent, es);
+}
 
-    if (NHc(parent).keyCount <= maxInternalKeys()) {
-        write(parent);
-        Page R = read(rightPid); NH(R).parent = parent.hdr.pageId; write(R);
+// Writes an internal node's entries back, splitting it when they no longer fit.
+void BPlusTreeString::storeInternal(Page& node, const std::vector<Entry>& es) {
+    if (nodeBytes(false, es, 0, es.size()) <= capacity()) {
+        pack(node, es, 0, es.size());
+        write(node);
     } else {
-        splitInternalAndInsert(parent);
-        Page R = read(rightPid); write(R);
+        splitInternal(node, es);
     }
 }
 
-void BPlusTreeString::splitInternalAndInsert(Page& node) {
-    int kc = NHc(node).keyCount;
-    int mid = kc/2;
-    int M = maxInternalKeys();
-
-    Page right; right.hdr.pageId = st_->allocatePage();
-    NodeHdrS nh{}; nh.pageId=right.hdr.pageId; nh.isLeaf=0; nh.keyCount=0; nh.parent=NHc(node).parent; nh.nextLeaf=0;
-    std::memcpy(right.bytes.data(), &nh, sizeof(NodeHdrS));
-
-    auto* keysL = IE(node);
-    auto* chL   = CHILD(node, M);
-    auto* keysR = IE(right);
-    auto* chR   = CHILD(right, M);
-
-    StrKey promote = keysL[mid].key;
-
-    int rkeys = kc - (mid + 1);
-    for (int i=0;i<rkeys;i++) keysR[i] = keysL[mid+1 + i];
-    for (int i=0;i<rkeys+1;i++) chR[i] = chL[mid+1 + i];
+void BPlusTreeString::splitInternal(Page& node, const std::vector<Entry>& es) {
+    const size_t m = chooseSplit(false, es);
+    Page right = read(st_->allocatePage());
+    NodeHdrS nh{}; nh.pageId=right.pageId(); nh.isLeaf=0; nh.keyCount=0; nh.parent=NHc(node).parent; nh.nextLeaf=0;
+    nh.firstChild = es[m].ref;
+    std::memcpy(right.data(), &nh, sizeof(NodeHdrS));
+    pack(right, es, m + 1, es.size());
+    pack(node, es, 0, m);
 
-    NH(node).keyCount = mid;
-
-    for (int i=0;i<rkeys+1;i++) {
-        Page c = read(chR[i]); NH(c).parent = right.hdr.pageId; write(c);
-    }
-
-    NH(right).keyCount = rkeys;
     write(node); write(right);
+    adoptChildren(right);
+    insertIntoParent(node.pageId(), es[m].key, right.pageId());
+}
 
-    insertIntoParent(node.hdr.pageId, promote, right.hdr.pageId);
+// Points the parent link of every child of node at it.
+void BPlusTreeString::adoptChildren(const Page& node) {
+    const int kc = NHc(node).keyCount;
+    for (int i = 0; i <= kc; ++i) {
+        Page c = read(childAt(node, i));
+        if (NHc(c).parent == node.pageId()) continue;
+        NH(c).parent = node.pageId();
+        write(c);
+    }
 }
 
 std::vector<RID> BPlusTreeString::find(const StrKey& key) {
-    uint32_t leafPid = findLeafForKey(key);
-    Page leaf = read(leafPid);
-    int lo = leafLowerBound(leaf, key);
-    int hi = leafUpperBound(leaf, key);
     std::vector<RID> out;
-    const auto* a = LEc(leaf);
-    for (int i=lo;i<hi;i++) out.push_back(RID{a[i].ridPage, a[i].ridSlot});
+    Page leaf = read(findLeafForKey(key));
+    int i = lowerBound(leaf, key);
+    while (true) {
+        int kc = NHc(leaf).keyCount;
+        for (; i<kc; i++) {
+            if (cmpAt(leaf, i, key) != 0) return out;
+            out.push_back(ridAt(leaf, i));
+        }
+        if (NHc(leaf).nextLeaf == 0) break;
+        leaf = read(NHc(leaf).nextLeaf);
+        i = 0;
+    }
     return out;
 }
 
 std::vector<RID> BPlusTreeString::range(const StrKey& keyMin, const StrKey& keyMax) {
     if (cmpKey(keyMax, keyMin) < 0) return {};
     std::vector<RID> out;
-    uint32_t pid = findLeafForKey(keyMin);
-    Page leaf = read(pid);
+    Page leaf = read(findLeafForKey(keyMin));
+    int i = lowerBound(leaf, keyMin);
     while (true) {
-        const auto* a = LEc(leaf);
         int kc = NHc(leaf).keyCount;
-        for (int i=0;i<kc;i++) {
-            if (cmpKey(a[i].key, keyMin) < 0) continue;
-            if (cmpKey(a[i].key, keyMax) > 0) return out;
-            out.push_back(RID{a[i].ridPage, a[i].ridSlot});
+        for (; i<kc; i++) {
+            if (cmpAt(leaf, i, keyMax) > 0) return out;
+            out.push_back(ridAt(leaf, i));
         }
         if (NHc(leaf).nextLeaf == 0) break;
         leaf = read(NHc(leaf).nextLeaf);
+        i = 0;
     }
     return out;
 }
 
-bool BPlusTreeString::removeFromLeaf(Page& leaf, const StrKey& k, RID rid) {
-    auto* a = LE(leaf);
-    int kc = NHc(leaf).keyCount;
-    for (int i=0;i<kc;i++) {
-        if (cmpKey(a[i].key, k)==0 && a[i].ridPage==rid.pageId && a[i].ridSlot==rid.slotId) {
-            for (int j=i+1;j<kc;j++) a[j-1]=a[j];
-            NH(leaf).keyCount = kc-1;
-            return true;
-        }
+// Drops entry i. Its cell stays behind as a hole until the node is next repacked.
+void BPlusTreeString::removeFromLeaf(Page& leaf, int i) {
+    const int kc = NHc(leaf).keyCount;
+    const uint8_t* c = CELL(leaf, i);
+    if (c == leaf.data() + NHc(leaf).cellStart) NH(leaf).cellStart += 1 + c[0] + RID_BYTES;
+    uint8_t* slots = SLOTS(leaf);
+    std::memmove(slots + i * SLOT_BYTES, slots + (i + 1) * SLOT_BYTES, (kc - i - 1) * SLOT_BYTES);
+    NH(leaf).keyCount = kc - 1;
+    if (kc == 1) {
+        NH(leaf).prefixLen = 0;
+        NH(leaf).cellStart = static_cast<uint16_t>(pageEnd(leaf.size()));
     }
-    return false;
 }
 
 void BPlusTreeString::remove(const StrKey& key, RID rid) {
     uint32_t leafPid = findLeafForKey(key);
     Page leaf = read(leafPid);
-    if (removeFromLeaf(leaf, key, rid)) {
-        write(leaf);
-        rebalanceAfterDelete(leafPid);
+    int i = lowerBound(leaf, key);
+    while (true) {
+        const int kc = NHc(leaf).keyCount;
+        for (; i < kc; ++i) {
+            if (cmpAt(leaf, i, key) != 0) return;
+            const RID r = ridAt(leaf, i);
+            if (r.pageId == rid.pageId && r.slotId == rid.slotId) {
+                removeFromLeaf(leaf, i);
+                write(leaf);
+                rebalanceAfterDelete(leafPid);
+                return;
+            }
+        }
+        // duplicates of key may continue into the following leaves
+        leafPid = NHc(leaf).nextLeaf;
+        if (leafPid == 0) return;
+        leaf = read(leafPid);
+        i = 0;
     }
 }
 
-StrKey BPlusTreeString::firstKeyLeaf(const Page& leaf) {
-    if (NHc(leaf).keyCount == 0) return StrKey{};
-    return LEc(leaf)[0].key;
-}
-StrKey BPlusTreeString::firstKeyInternal(const Page& internal) {
-    if (NHc(internal).keyCount == 0) return StrKey{};
-    return IEc(internal)[0].key;
-}
-
+// A node under a quarter full is merged with a sibling, or evened out with it
+// when the two do not fit in one page.
 void BPlusTreeString::rebalanceAfterDelete(uint32_t pid) {
     Page node = read(pid);
 
     if (pid == root()) {
         if (!NHc(node).isLeaf && NHc(node).keyCount == 0) {
-            int M = maxInternalKeys();
-            auto* ch = CHILD(node, M);
-            uint32_t newRootPid = ch[0];
+            uint32_t newRootPid = NHc(node).firstChild;
             Page child = read(newRootPid);
             NH(child).parent = 0;
             write(child);
@@ -299,193 +464,125 @@ void BPlusTreeString::rebalanceAfterDelete(uint32_t pid) {
         return;
     }
 
-    int minReq = NHc(node).isLeaf ? minLeafEntries() : minInternalKeys();
-    if (NHc(node).keyCount >= minReq) return;
+    if (usedBytes(node) >= capacity() / 4) return;
 
-    uint32_t parentPid = NHc(node).parent;
+    const uint32_t parentPid = NHc(node).parent;
     Page parent = read(parentPid);
-    int M = maxInternalKeys();
-    auto* ch = CHILD(parent, M);
-    int kcP = NHc(parent).keyCount;
-    int idx = 0; while (idx <= kcP && ch[idx] != pid) ++idx;
-    if (idx > kcP) throw std::runtime_error("rebalance: child not found");
-
-    if (NHc(node).isLeaf) {
-        if (idx > 0) {
-            Page left = read(ch[idx-1]);
-            if (NHc(left).keyCount > minLeafEntries()) {
-                if (borrowFromLeftLeaf(parent, idx-1, left, node)) { write(parent); write(left); write(node); return; }
-            }
-        }
-        if (idx < kcP) {
-            Page right = read(ch[idx+1]);
-            if (NHc(right).keyCount > minLeafEntries()) {
-                if (borrowFromRightLeaf(parent, idx, node, right)) { write(parent); write(right); write(node); return; }
-            }
-        }
-        if (idx > 0) {
-            Page left = read(ch[idx-1]);
-            mergeLeaves(parent, idx-1, left, node);
-            write(parent); write(left);
-            rebalanceAfterDelete(parentPid);
-            return;
-        } else {
-            Page right = read(ch[idx+1]);
-            mergeLeaves(parent, idx, node, right);
-            write(parent); write(node);
-            rebalanceAfterDelete(parentPid);
-            return;
-        }
+    if (NHc(parent).keyCount == 0) return;
+    auto pes = decode(parent);
+    const int idx = childIndex(parent, pid);
+    const int sep = idx > 0 ? idx - 1 : idx;
+    Page other = read(childAt(parent, idx > 0 ? idx - 1 : idx + 1));
+    Page& left  = idx > 0 ? other : node;
+    Page& right = idx > 0 ? node : other;
+    const bool leaf = NHc(node).isLeaf;
+
+    auto es = decode(left);
+    if (!leaf) es.push_back(Entry{pes[sep].key, NHc(right).firstChild, 0});
+    auto rs = decode(right);
+    es.insert(es.end(), std::make_move_iterator(rs.begin()), std::make_move_iterator(rs.end()));
+
+    if (nodeBytes(leaf, es, 0, es.size()) <= capacity()) {
+        pack(left, es, 0, es.size());
+        if (leaf) NH(left).nextLeaf = NHc(right).nextLeaf;
+        write(left);
+        if (!leaf) adoptChildren(left);
+        pes.erase(pes.begin() + sep);
+        pack(parent, pes, 0, pes.size());
+        write(parent);
+        rebalanceAfterDelete(parentPid);
+        return;
+    }
+
+    const size_t m = chooseSplit(leaf, es);
+    pack(left, es, 0, m);
+    if (leaf) {
+        pack(right, es, m, es.size());
+        pes[sep].key = separator(es[m-1].key, es[m].key);
     } else {
-        if (idx > 0) {
-            Page left = read(ch[idx-1]);
-            if (NHc(left).keyCount > minInternalKeys()) {
-                if (borrowFromLeftInternal(parent, idx-1, left, node)) { write(parent); write(left); write(node); return; }
+        NH(right).firstChild = es[m].ref;
+        pack(right, es, m + 1, es.size());
+        pes[sep].key = es[m].key;
+    }
+    write(left); write(right);
+    if (!leaf) { adoptChildren(left); adoptChildren(right); }
+    storeInternal(parent, pes);
+}
+
+// Bottom-up build like BPlusTreeInt32::bulkLoad, but nodes are filled by
+// bytes rather than by entry count.
+void BPlusTreeString::bulkLoad(const std::function<bool(LeafEntryS&)>& next, uint64_t count, double fillFactor) {
+    Page leaf = read(ensureRootLeaf());
+    if (!NHc(leaf).isLeaf || NHc(leaf).keyCount != 0) throw std::runtime_error("B+ bulk load needs an empty tree");
+    if (count == 0) return;
+
+    const int cap = capacity();
+    const int target = std::min(cap, std::max(cap / 2, static_cast<int>(cap * fillFactor)));
+
+    // One entry per node of the level being built: the separator left of it and its page.
+    std::vector<Entry> level;
+    std::vector<Entry> es;
+    std::string lastKey;
+    int raw = 0;
+    auto finishLeaf = [&](uint32_t nextLeaf) {
+        NodeHdrS nh{}; nh.pageId=leaf.pageId(); nh.isLeaf=1; nh.parent=0; nh.nextLeaf=nextLeaf;
+        std::memcpy(leaf.data(), &nh, sizeof(NodeHdrS));
+        pack(leaf, es, 0, es.size());
+        write(leaf);
+    };
+
+    LeafEntryS in{};
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!next(in)) throw std::runtime_error("B+ bulk load: input ended early");
+        Entry e{std::string(in.key.bytes, in.key.len), in.ridPage, in.ridSlot};
+        const int cell = SLOT_BYTES + 1 + (int)e.key.size() + RID_BYTES;
+        if (!es.empty()) {
+            const int pfx = commonPrefix(es.front().key, e.key);
+            if (pfx + raw + cell - (int)(es.size() + 1) * pfx > target) {
+                Page right = read(st_->allocatePage());
+                finishLeaf(right.pageId());
+                lastKey = std::move(es.back().key);
+                es.clear();
+                raw = 0;
+                leaf = std::move(right);
             }
         }
-        if (idx < kcP) {
-            Page right = read(ch[idx+1]);
-            if (NHc(right).keyCount > minInternalKeys()) {
-                if (borrowFromRightInternal(parent, idx, node, right)) { write(parent); write(right); write(node); return; }
+        if (es.empty()) level.push_back(Entry{level.empty() ? std::string() : separator(lastKey, e.key), leaf.pageId(), 0});
+        es.push_back(std::move(e));
+        raw += cell;
+    }
+    finishLeaf(0);
+
+    while (level.size() > 1) {
+        std::vector<Entry> up;
+        size_t c = 0;
+        while (c < level.size()) {
+            // level[c] is the node's first child, the entries after it its keys
+            size_t end = c + 1;
+            int bytes = 0;
+            while (end < level.size()) {
+                const int cell = SLOT_BYTES + 1 + (int)level[end].key.size() + CHILD_PTR_SIZE;
+                const int pfx = commonPrefix(level[c + 1].key, level[end].key);
+                if (end > c + 1 && pfx + bytes + cell - (int)(end - c) * pfx > target) break;
+                bytes += cell;
+                ++end;
             }
+            // never leave the next node a single child
+            if (level.size() - end == 1) {
+                if (nodeBytes(false, level, c + 1, end + 1) <= cap) ++end; else --end;
+            }
+            Page node = read(st_->allocatePage());
+            NodeHdrS nh{}; nh.pageId=node.pageId(); nh.isLeaf=0; nh.parent=0; nh.nextLeaf=0; nh.firstChild=level[c].ref;
+            std::memcpy(node.data(), &nh, sizeof(NodeHdrS));
+            pack(node, level, c + 1, end);
+            write(node);
+            adoptChildren(node);
+            up.push_back(Entry{level[c].key, node.pageId(), 0});
+            c = end;
         }
-        if (idx > 0) {
-            Page left = read(ch[idx-1]);
-            mergeInternals(parent, idx-1, left, node);
-            write(parent); write(left);
-            rebalanceAfterDelete(parentPid);
-            return;
-        } else {
-            Page right = read(ch[idx+1]);
-            mergeInternals(parent, idx, node, right);
-            write(parent); write(node);
-            rebalanceAfterDelete(parentPid);
-            return;
-        }
-    }
-}
-
-bool BPlusTreeString::borrowFromLeftLeaf(Page& parent, int sepIdx, Page& left, Page& node) {
-    int kcL = NHc(left).keyCount;
-    int kcN = NHc(node).keyCount;
-    if (kcL <= minLeafEntries()) return false;
-    auto* aL = LE(left);
-    auto* aN = LE(node);
-    for (int i=kcN; i>0; --i) aN[i] = aN[i-1];
-    aN[0] = aL[kcL-1];
-    NH(node).keyCount = kcN + 1;
-    NH(left).keyCount = kcL - 1;
-    IE(parent)[sepIdx].key = firstKeyLeaf(node);
-    return true;
-}
-bool BPlusTreeString::borrowFromRightLeaf(Page& parent, int sepIdx, Page& node, Page& right) {
-    int kcR = NHc(right).keyCount;
-    int kcN = NHc(node).keyCount;
-    if (kcR <= minLeafEntries()) return false;
-    auto* aR = LE(right);
-    auto* aN = LE(node);
-    aN[kcN] = aR[0];
-    for (int i=1;i<kcR;i++) aR[i-1] = aR[i];
-    NH(node).keyCount = kcN + 1;
-    NH(right).keyCount = kcR - 1;
-    IE(parent)[sepIdx].key = firstKeyLeaf(right);
-    return true;
-}
-void BPlusTreeString::mergeLeaves(Page& parent, int sepIdxLeft, Page& left, Page& right) {
-    int kcL = NHc(left).keyCount;
-    int kcR = NHc(right).keyCount;
-    auto* aL = LE(left);
-    const auto* aR = LEc(right);
-    for (int i=0;i<kcR;i++) aL[kcL+i] = aR[i];
-    NH(left).keyCount = kcL + kcR;
-    NH(left).nextLeaf = NHc(right).nextLeaf;
-
-    int M = maxInternalKeys();
-    auto* keysP = IE(parent);
-    auto* chP = CHILD(parent, M);
-    int kcP = NHc(parent).keyCount;
-    for (int i=sepIdxLeft; i<kcP-1; ++i) keysP[i] = keysP[i+1];
-    for (int i=sepIdxLeft+1; i<kcP; ++i) chP[i] = chP[i+1];
-    NH(parent).keyCount = kcP - 1;
-}
-
-bool BPlusTreeString::borrowFromLeftInternal(Page& parent, int sepIdx, Page& left, Page& node) {
-    int kcL = NHc(left).keyCount;
-    int kcN = NHc(node).keyCount;
-    if (kcL <= minInternalKeys()) return false;
-
-    int M = maxInternalKeys();
-    auto* keysL = IE(left);
-    auto* chL   = CHILD(left, M);
-    auto* keysN = IE(node);
-    auto* chN   = CHILD(node, M);
-
-    for (int i=kcN; i>0; --i) keysN[i] = keysN[i-1];
-    for (int i=kcN+1; i>0; --i) chN[i] = chN[i-1];
-
-    keysN[0].key = IEc(parent)[sepIdx].key;
-    chN[0] = chL[kcL];
-
-    IE(parent)[sepIdx].key = keysL[kcL-1].key;
-
-    NH(left).keyCount = kcL - 1;
-    NH(node).keyCount = kcN + 1;
-
-    Page movedChild = read(chN[0]); NH(movedChild).parent = node.hdr.pageId; write(movedChild);
-    return true;
-}
-bool BPlusTreeString::borrowFromRightInternal(Page& parent, int sepIdx, Page& node, Page& right) {
-    int kcR = NHc(right).keyCount;
-    int kcN = NHc(node).keyCount;
-    if (kcR <= minInternalKeys()) return false;
-
-    int M = maxInternalKeys();
-    auto* keysR = IE(right);
-    auto* chR   = CHILD(right, M);
-    auto* keysN = IE(node);
-    auto* chN   = CHILD(node, M);
-
-    keysN[kcN].key = IEc(parent)[sepIdx].key;
-    chN[kcN+1] = chR[0];
-    IE(parent)[sepIdx].key = keysR[0].key;
-
-    for (int i=1;i<kcR;i++) keysR[i-1] = keysR[i];
-    for (int i=1;i<kcR+1;i++) chR[i-1] = chR[i];
-
-    NH(right).keyCount = kcR - 1;
-    NH(node).keyCount  = kcN + 1;
-
-    Page movedChild = read(chN[kcN+1]); NH(movedChild).parent = node.hdr.pageId; write(movedChild);
-    return true;
-}
-void BPlusTreeString::mergeInternals(Page& parent, int sepIdxLeft, Page& left, Page& right) {
-    int kcL = NHc(left).keyCount;
-    int kcR = NHc(right).keyCount;
-    int M = maxInternalKeys();
-
-    auto* keysL = IE(left);
-    auto* chL   = CHILD(left, M);
-    const auto* keysR = IEc(right);
-    const auto* chR   = CHILDc(right, M);
-
-    keysL[kcL].key = IEc(parent)[sepIdxLeft].key;
-    chL[kcL+1] = chR[0];
-
-    for (int i=0;i<kcR;i++) keysL[kcL+1+i] = keysR[i];
-    for (int i=1;i<kcR+1;i++) chL[kcL+1+i] = chR[i];
-
-    for (int i=0;i<kcR+1;i++) {
-        Page c = read(chR[i]); NH(c).parent = left.hdr.pageId; write(c);
+        level.swap(up);
     }
-
-    NH(left).keyCount = kcL + 1 + kcR;
-
-    auto* keysP = IE(parent);
-    auto* chP   = CHILD(parent, M);
-    int kcP = NHc(parent).keyCount;
-    for (int i=sepIdxLeft; i<kcP-1; ++i) keysP[i] = keysP[i+1];
-    for (int i=sepIdxLeft+1; i<kcP;   ++i) chP[i]   = chP[i+1];
-    NH(parent).keyCount = kcP - 1;
+    setRoot(level[0].ref);
 }
 
 }
@@ -5,11 +5,23 @@
 #include <optional>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <string>
 
 namespace ma {
 
-constexpr int STRIDX_MAX_KEY_BYTES = 64;
-
+// Keys shorter than this are stored whole; longer ones are indexed by their
+// first STRIDX_MAX_KEY_BYTES bytes and then equal a key of exactly that length,
+// so hits on keys at the cap must be checked against the row.
+constexpr int STRIDX_MAX_KEY_BYTES = 128;
+// IdxHeader::keyKind of string indexes with slotted, prefix-compressed nodes.
+constexpr uint16_t STRIDX_KEY_KIND = 2;
+
+// Node page: NodeHdrS, the prefix shared by every key in the node
+// (prefixLen bytes), one uint16_t cell offset per key in key order, free
+// space, and the cells packed against the end of the page. A cell holds the
+// key's length past the prefix (uint8_t), those bytes, then the RID (leaf,
+// 6 bytes) or the child right of the key (internal node, 4 bytes).
 #pragma pack(push,1)
 struct NodeHdrS {
     uint32_t pageId;
@@ -17,7 +29,9 @@ struct NodeHdrS {
     uint16_t keyCount;
     uint32_t parent;
     uint32_t nextLeaf;
-    uint32_t reserved;
+    uint32_t firstChild;  // internal nodes: child left of the first key
+    uint16_t cellStart;   // lowest cell offset
+    uint8_t  prefixLen;
 };
 
 struct StrKey {
@@ -25,17 +39,13 @@ struct StrKey {
     char    bytes[STRIDX_MAX_KEY_BYTES];
 };
 
+// Sort record for bulk loading.
 struct LeafEntryS {
     StrKey   key;
     uint32_t ridPage;
     uint16_t ridSlot;
     uint16_t pad;
 };
-
-struct InternalEntryS {
-    StrKey   key;
-    uint32_t child;
-};
 #pragma pack(pop)
 
 class BPlusTreeString {
@@ -50,6 +60,9 @@ public:
     std::vector<RID> find(const StrKey& key);
     std::vector<RID> range(const StrKey& keyMin, const StrKey& keyMax);
 
+    // Fills an empty tree from count entries delivered in key order.
+    void bulkLoad(const std::function<bool(LeafEntryS&)>& next, uint64_t count, double fillFactor);
+
     static StrKey packKey(const std::string& s);
 
 private:
@@ -63,60 +76,63 @@ private:
     uint32_t ensureRootLeaf();
     uint32_t findLeafForKey(const StrKey& k);
 
-    static int maxLeafEntries();
-    static int maxInternalKeys();
-    static int minLeafEntries();
-    static int minInternalKeys();
+    // Decoded key with its RID (leaf) or the child right of it (internal node).
+    struct Entry {
+        std::string key;
+        uint32_t ref;
+        uint16_t slot;
+    };
+
+    int capacity() const;
+    size_t chooseSplit(bool leaf, const std::vector<Entry>& es) const;
+    static int nodeBytes(bool leaf, const std::vector<Entry>& es, size_t first, size_t last);
+    static int usedBytes(const Page& p);
+    static std::vector<Entry> decode(const Page& p);
+    static void pack(Page& p, const std::vector<Entry>& es, size_t first, size_t last);
+    static std::string separator(const std::string& leftLast, const std::string& rightFirst);
 
+public:
     static int cmpKey(const StrKey& a, const StrKey& b);
+private:
 
-    static int leafLowerBound(const Page& leaf, const StrKey& k);
-    static int leafUpperBound(const Page& leaf, const StrKey& k);
-    static int internalChildIndex(const Page& internal, const StrKey& k);
+    static int cmpPrefix(const Page& p, const StrKey& k);
+    static int cmpAt(const Page& p, int i, const StrKey& k);
+    static int lowerBound(const Page& node, const StrKey& k);
+    static int upperBound(const Page& node, const StrKey& k);
+    static uint32_t childAt(const Page& internal, int i);
+    static int childIndex(const Page& internal, uint32_t child);
+    static RID ridAt(const Page& leaf, int i);
 
     static inline NodeHdrS& NH(Page& p) {
-        return *reinterpret_cast<NodeHdrS*>(p.bytes.data());
+        return *reinterpret_cast<NodeHdrS*>(p.data());
     }
     static inline const NodeHdrS& NHc(const Page& p) {
-        return *reinterpret_cast<const NodeHdrS*>(p.bytes.data());
-    }
-    static inline LeafEntryS* LE(Page& p) {
-        return reinterpret_cast<LeafEntryS*>(p.bytes.data() + sizeof(NodeHdrS));
-    }
-    static inline const LeafEntryS* LEc(const Page& p) {
-        return reinterpret_cast<const LeafEntryS*>(p.bytes.data() + sizeof(NodeHdrS));
+        return *reinterpret_cast<const NodeHdrS*>(p.data());
     }
-    static inline InternalEntryS* IE(Page& p) {
-        return reinterpret_cast<InternalEntryS*>(p.bytes.data() + sizeof(NodeHdrS));
+    static inline const uint8_t* PREFIX(const Page& p) {
+        return p.data() + sizeof(NodeHdrS);
     }
-    static inline const InternalEntryS* IEc(const Page& p) {
-        return reinterpret_cast<const InternalEntryS*>(p.bytes.data() + sizeof(NodeHdrS));
+    static inline uint8_t* SLOTS(Page& p) {
+        return p.data() + sizeof(NodeHdrS) + NHc(p).prefixLen;
     }
-    static inline uint32_t* CHILD(Page& p, int maxKeys) {
-        return reinterpret_cast<uint32_t*>(p.bytes.data() + sizeof(NodeHdrS) + maxKeys * sizeof(InternalEntryS));
+    static inline const uint8_t* SLOTSc(const Page& p) {
+        return p.data() + sizeof(NodeHdrS) + NHc(p).prefixLen;
     }
-    static inline const uint32_t* CHILDc(const Page& p, int maxKeys) {
-        return reinterpret_cast<const uint32_t*>(p.bytes.data() + sizeof(NodeHdrS) + maxKeys * sizeof(InternalEntryS));
+    static inline const uint8_t* CELL(const Page& p, int i) {
+        uint16_t off;
+        std::memcpy(&off, SLOTSc(p) + i * sizeof(uint16_t), sizeof(off));
+        return p.data() + off;
     }
 
-    void insertIntoLeaf(Page& leaf, const StrKey& k, RID rid);
-    void splitLeafAndInsert(Page& leaf, const StrKey& k, RID rid);
-    void insertIntoParent(uint32_t leftPid, const StrKey& sepKey, uint32_t rightPid);
-    void splitInternalAndInsert(Page& node);
+    bool insertIntoLeaf(Page& leaf, const StrKey& k, RID rid);
+    void splitLeaf(Page& leaf, const std::vector<Entry>& es);
+    void insertIntoParent(uint32_t leftPid, const std::string& sepKey, uint32_t rightPid);
+    void splitInternal(Page& node, const std::vector<Entry>& es);
+    void storeInternal(Page& node, const std::vector<Entry>& es);
+    void adoptChildren(const Page& node);
 
-    bool removeFromLeaf(Page& leaf, const StrKey& k, RID rid);
+    static void removeFromLeaf(Page& leaf, int i);
     void rebalanceAfterDelete(uint32_t pid);
-
-    bool borrowFromLeftLeaf(Page& parent, int sepIdx, Page& left, Page& node);
-    bool borrowFromRightLeaf(Page& parent, int sepIdx, Page& node, Page& right);
-    void mergeLeaves(Page& parent, int sepIdxLeft, Page& left, Page& right);
-
-    bool borrowFromLeftInternal(Page& parent, int sepIdx, Page& left, Page& node);
-    bool borrowFromRightInternal(Page& parent, int sepIdx, Page& node, Page& right);
-    void mergeInternals(Page& parent, int sepIdxLeft, Page& left, Page& right);
-
-    static StrKey firstKeyLeaf(const Page& leaf);
-    static StrKey firstKeyInternal(const Page& internal);
 };
 
 }
@@ -1,11 +1,14 @@
 #include "IndexInt32.h"
+#include <stdexcept>
 
 namespace ma {
 
 void IndexInt32::create(const IndexInt32Desc& d) {
     desc_ = d;
     storage_ = std::make_unique<IndexStorage>();
-    storage_->create(desc_.path);
+    storage_->setBackend(desc_.backend);
+    storage_->create(desc_.path, desc_.pageSize);
+    storage_->setKeyMeta(INTIDX_KEY_KIND, sizeof(int32_t));
     tree_ = std::make_unique<BPlusTreeInt32>(storage_.get());
     tree_->createEmpty();
 }
@@ -13,7 +16,13 @@ void IndexInt32::create(const IndexInt32Desc& d) {
 void IndexInt32::open(const IndexInt32Desc& d) {
     desc_ = d;
     storage_ = std::make_unique<IndexStorage>();
+    storage_->setBackend(desc_.backend);
+    storage_->setReadOnly(desc_.readOnly);
     storage_->open(desc_.path);
+    if (storage_->keyKind() != INTIDX_KEY_KIND || storage_->keyBytes() != sizeof(int32_t)) {
+        close();
+        throw std::runtime_error("Int32 index uses an older node format");
+    }
     tree_ = std::make_unique<BPlusTreeInt32>(storage_.get());
     if (storage_->rootPageId()==0) tree_->createEmpty();
 }
@@ -24,9 +33,17 @@ void IndexInt32::close() {
     storage_.reset();
 }
 
+void IndexInt32::flush() { if (storage_) storage_->flush(); }
+void IndexInt32::setDurability(Durability d) { if (storage_) storage_->setDurability(d); }
+
 void IndexInt32::insert(int32_t k, RID rid) { tree_->insert(k, rid); }
 void IndexInt32::erase(int32_t k, RID rid)  { tree_->remove(k, rid); }
 std::vector<RID> IndexInt32::find(int32_t k){ return tree_->find(k); }
 std::vector<RID> IndexInt32::range(int32_t kmin, int32_t kmax){ return tree_->range(kmin,kmax); }
 
+void IndexInt32::bulkLoad(Int32Sorter& entries, double fillFactor) {
+    entries.finish();
+    tree_->bulkLoad([&](LeafEntry& e) { return entries.next(e); }, entries.count(), fillFactor);
+}
+
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "BPlusTreeInt32.h"
+#include "ExternalSort.h"
 #include <memory>
 
 namespace ma {
@@ -8,8 +9,20 @@ struct IndexInt32Desc {
     std::string name;
     int fieldIndex;
     std::string path;
+    StorageBackend backend = StorageBackend::Stream;
+    uint32_t pageSize = PAGE_SIZE;   // used by create(); open() reads it from the file
+    bool readOnly = false;           // used by open(); see IndexStorage::setReadOnly()
 };
 
+struct Int32EntryLess {
+    bool operator()(const LeafEntry& a, const LeafEntry& b) const {
+        if (a.key != b.key) return a.key < b.key;
+        if (a.ridPage != b.ridPage) return a.ridPage < b.ridPage;
+        return a.ridSlot < b.ridSlot;
+    }
+};
+using Int32Sorter = ExternalSorter<LeafEntry, Int32EntryLess>;
+
 class IndexInt32 {
 public:
     IndexInt32() = default;
@@ -17,12 +30,17 @@ public:
     void create(const IndexInt32Desc& d);
     void open(const IndexInt32Desc& d);
     void close();
+    void flush();
+    void setDurability(Durability d);
 
     void insert(int32_t k, RID rid);
     void erase(int32_t k, RID rid);
     std::vector<RID> find(int32_t k);
     std::vector<RID> range(int32_t kmin, int32_t kmax);
 
+    // Builds a freshly created index from all entries collected in the sorter.
+    void bulkLoad(Int32Sorter& entries, double fillFactor);
+
     const IndexInt32Desc& desc() const { return desc_; }
 
 private:
@@ -6,76 +6,156 @@
 namespace ma {
 
 static constexpr uint32_t IDX_MAGIC = 0x31584449u;
+// v2: internal nodes reserve an overflow key slot before the child array
+// v3: same layout with a page size other than PAGE_SIZE in the header
+static constexpr uint16_t IDX_VERSION = 2;
+static constexpr uint16_t IDX_VERSION_SIZED = 3;
 
 IndexStorage::~IndexStorage() { close(); }
 
-void IndexStorage::create(const std::string& path) {
+void IndexStorage::create(const std::string& path, uint32_t pageSize) {
+    if (!validPageSize(pageSize)) throw std::runtime_error("Idx: unsupported page size");
     close();
+    if (readOnly_) throw std::runtime_error("Idx: open read-only " + path);
     path_ = path;
     file_.open(path_, std::ios::binary | std::ios::out | std::ios::trunc);
     if (!file_) throw std::runtime_error("Idx: cannot create " + path_);
     header_.magic = IDX_MAGIC;
-    header_.version = 1;
+    header_.version = pageSize == PAGE_SIZE ? IDX_VERSION : IDX_VERSION_SIZED;
     header_.pageCount = 1;
     header_.rootPageId = 0;
     header_.keyKind = 0;
     header_.keyBytes = 0;
+    header_.pageSize = pageSize;
     std::memset(header_.reserved, 0, sizeof(header_.reserved));
 
-    std::vector<uint8_t> p0(PAGE_SIZE, 0);
-    std::memcpy(p0.data(), &header_, sizeof(IdxHeader));
-    file_.write(reinterpret_cast<const char*>(p0.data()), PAGE_SIZE);
-    file_.flush();
+    writeHeaderPage();
     file_.close();
 
-    file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
-    if (!file_) throw std::runtime_error("Idx: cannot reopen " + path_);
+    if (backend_ == StorageBackend::Mapped) {
+        map_.open(path_, pageSize);
+    } else {
+        file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file_) throw std::runtime_error("Idx: cannot reopen " + path_);
+    }
+    fileId_ = pool_->attach(path_, this, pageSize);
+    pool_->discard(fileId_);
 }
 
 void IndexStorage::open(const std::string& path) {
     close();
     path_ = path;
-    file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
-    if (!file_) throw std::runtime_error("Idx: cannot open " + path_);
     readHeader();
+    if (backend_ == StorageBackend::Mapped) {
+        map_.open(path_, header_.pageSize, readOnly_);
+    } else {
+        file_.open(path_, readOnly_ ? std::ios::binary | std::ios::in : std::ios::binary | std::ios::in | std::ios::out);
+        if (!file_) throw std::runtime_error("Idx: cannot open " + path_);
+    }
+    fileId_ = pool_->attach(path_, this, header_.pageSize);
 }
 
 void IndexStorage::close() {
+    if (fileId_ != 0) {
+        if (!readOnly_) pool_->flushFile(fileId_);
+        pool_->detach(fileId_, this);
+        fileId_ = 0;
+    }
+    // A mapped header is written as it changes; copying it again here would
+    // undo changes other handles made to the file since.
+    if (map_.isOpen()) {
+        if (headerDirty_) std::memcpy(map_.page(0), &header_, sizeof(IdxHeader));
+        map_.close(header_.pageCount);
+    }
+    headerDirty_ = false;
     if (file_.is_open()) {
-        std::vector<uint8_t> p0(PAGE_SIZE, 0);
-        std::memcpy(p0.data(), &header_, sizeof(IdxHeader));
-        file_.seekp(0, std::ios::beg);
-        file_.write(reinterpret_cast<const char*>(p0.data()), PAGE_SIZE);
-        file_.flush();
+        if (!readOnly_) writeHeaderPage();
         file_.close();
     }
 }
 
+void IndexStorage::flush() {
+    if (readOnly_) return;
+    if (map_.isOpen()) {
+        pool_->flushFile(fileId_);
+        writeHeader();
+        map_.sync();
+        return;
+    }
+    if (!file_.is_open()) return;
+    pool_->flushFile(fileId_);
+    if (headerDirty_) writeHeader();
+    file_.flush();
+    if (!file_) throw std::runtime_error("Idx: flush failed " + path_);
+}
+
+void IndexStorage::setDurability(Durability d) {
+    if (d == durability_) return;
+    durability_ = d;
+    if (d == Durability::FlushEveryOp) flush();
+}
+
 void IndexStorage::writeHeader() {
-    std::vector<uint8_t> p0(PAGE_SIZE, 0);
+    if (map_.isOpen()) {
+        std::memcpy(map_.page(0), &header_, sizeof(IdxHeader));
+        headerDirty_ = false;
+        return;
+    }
+    writeHeaderPage();
+    headerDirty_ = false;
+}
+
+void IndexStorage::writeHeaderPage() {
+    std::vector<uint8_t> p0(header_.pageSize, 0);
     std::memcpy(p0.data(), &header_, sizeof(IdxHeader));
     file_.seekp(0, std::ios::beg);
-    file_.write(reinterpret_cast<const char*>(p0.data()), PAGE_SIZE);
+    file_.write(reinterpret_cast<const char*>(p0.data()), p0.size());
     file_.flush();
 }
 
+// Read before the file is opened for paging, since the backends need the
+// page size.
 void IndexStorage::readHeader() {
-    std::vector<uint8_t> p0(PAGE_SIZE, 0);
-    file_.seekg(0, std::ios::beg);
-    file_.read(reinterpret_cast<char*>(p0.data()), PAGE_SIZE);
-    if (!file_) throw std::runtime_error("Idx: read header failed");
-    std::memcpy(&header_, p0.data(), sizeof(IdxHeader));
-    if (header_.magic != IDX_MAGIC || header_.version != 1)
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) throw std::runtime_error("Idx: cannot open " + path_);
+    in.read(reinterpret_cast<char*>(&header_), sizeof(IdxHeader));
+    if (!in) throw std::runtime_error("Idx: read header failed");
+    if (header_.magic != IDX_MAGIC || (header_.version != IDX_VERSION && header_.version != IDX_VERSION_SIZED))
         throw std::runtime_error("Idx: invalid header");
+    if (header_.pageSize == 0) header_.pageSize = PAGE_SIZE;
+    if (!validPageSize(header_.pageSize)) throw std::runtime_error("Idx: invalid header");
+}
+
+void IndexStorage::requireWritable() const {
+    if (readOnly_) throw std::runtime_error("Idx: open read-only " + path_);
 }
 
 uint32_t IndexStorage::allocatePage() {
-    uint32_t newPid = header_.pageCount;
-    std::vector<uint8_t> zero(PAGE_SIZE, 0);
-    file_.seekp(static_cast<std::streamoff>(newPid) * PAGE_SIZE, std::ios::beg);
-    file_.write(reinterpret_cast<const char*>(zero.data()), PAGE_SIZE);
-    file_.flush();
-    if (!file_) throw std::runtime_error("Idx: allocatePage failed");
+    requireWritable();
+    const uint32_t newPid = header_.pageCount;
+    if (map_.isOpen()) {
+        map_.ensurePages(newPid + 1);
+        std::memset(map_.page(newPid), 0, header_.pageSize);
+        pool_->refresh(fileId_, newPid, map_.page(newPid));
+        header_.pageCount++;
+        writeHeader();
+        return newPid;
+    }
+    BufferPool::Frame* f = pool_->pinNew(fileId_, newPid);
+    if (durability_ == Durability::FlushOnCommit) {
+        pool_->unpin(f, true);
+        header_.pageCount++;
+        headerDirty_ = true;
+        return newPid;
+    }
+    try {
+        writeFrame(newPid, f->data);
+    } catch (...) {
+        pool_->unpin(f, false);
+        throw std::runtime_error("Idx: allocatePage failed");
+    }
+    pool_->setDirty(f, false);
+    pool_->unpin(f, false);
     header_.pageCount++;
     writeHeader();
     return newPid;
@@ -83,31 +163,56 @@ uint32_t IndexStorage::allocatePage() {
 
 Page IndexStorage::readPage(uint32_t pageId) {
     if (pageId >= header_.pageCount) throw std::runtime_error("Idx: readPage out of range");
-    Page p;
-    file_.seekg(static_cast<std::streamoff>(pageId) * PAGE_SIZE, std::ios::beg);
-    file_.read(reinterpret_cast<char*>(p.bytes.data()), PAGE_SIZE);
-    if (!file_) throw std::runtime_error("Idx: read page failed");
-    p.hdr.pageId = pageId;
-    return p;
+    if (map_.isOpen()) return Page(pageId, map_.page(pageId), header_.pageSize, nullptr, nullptr);
+    BufferPool::Frame* f = pool_->pin(fileId_, pageId);
+    return Page(pageId, f->data, header_.pageSize, pool_, f);
 }
 
 void IndexStorage::writePage(const Page& page) {
-    if (page.hdr.pageId >= header_.pageCount) throw std::runtime_error("Idx: writePage out of range");
-    file_.seekp(static_cast<std::streamoff>(page.hdr.pageId) * PAGE_SIZE, std::ios::beg);
-    file_.write(reinterpret_cast<const char*>(page.bytes.data()), PAGE_SIZE);
-    file_.flush();
+    requireWritable();
+    const uint32_t pid = page.pageId();
+    if (pid >= header_.pageCount) throw std::runtime_error("Idx: writePage out of range");
+    if (map_.isOpen()) {
+        uint8_t* dst = map_.page(pid);
+        if (page.data() != dst) std::memcpy(dst, page.data(), header_.pageSize);
+        pool_->refresh(fileId_, pid, dst);
+        return;
+    }
+    if (!page.frame_ || page.pool_ != pool_ || page.frame_->fileId != fileId_)
+        throw std::runtime_error("Idx: page does not belong to " + path_);
+    if (durability_ == Durability::FlushOnCommit) {
+        pool_->setDirty(page.frame_, true);
+        return;
+    }
+    writeFrame(pid, page.data());
+    pool_->setDirty(page.frame_, false);
+}
+
+void IndexStorage::writeFrame(uint32_t pageId, const uint8_t* src) {
+    if (map_.isOpen()) {
+        map_.ensurePages(pageId + 1);
+        std::memcpy(map_.page(pageId), src, header_.pageSize);
+        return;
+    }
+    file_.seekp(static_cast<std::streamoff>(pageId) * header_.pageSize, std::ios::beg);
+    file_.write(reinterpret_cast<const char*>(src), header_.pageSize);
+    if (durability_ == Durability::FlushEveryOp) file_.flush();
     if (!file_) throw std::runtime_error("Idx: write page failed");
 }
 
 void IndexStorage::setRootPageId(uint32_t pid) {
+    requireWritable();
     header_.rootPageId = pid;
-    writeHeader();
+    if (durability_ == Durability::FlushOnCommit) headerDirty_ = true;
+    else writeHeader();
 }
 
 void IndexStorage::setKeyMeta(uint16_t kind, uint16_t bytes) {
+    requireWritable();
     header_.keyKind = kind;
     header_.keyBytes = bytes;
-    writeHeader();
+    if (durability_ == Durability::FlushOnCommit) headerDirty_ = true;
+    else writeHeader();
 }
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "Page.h"
+#include "BufferPool.h"
+#include "MappedFile.h"
 #include <string>
 #include <fstream>
 
@@ -13,24 +15,42 @@ struct IdxHeader {
     uint32_t rootPageId;
     uint16_t keyKind;
     uint16_t keyBytes;
-    uint8_t  reserved[44];
+    uint32_t pageSize;   // 0 in files written before page size was stored: PAGE_SIZE
+    uint8_t  reserved[40];
 };
 #pragma pack(pop)
 
-class IndexStorage {
+class IndexStorage : private PageFile {
 public:
     IndexStorage() = default;
-    ~IndexStorage();
+    ~IndexStorage() override;
 
-    void create(const std::string& path);
+    void setBufferPool(BufferPool* pool) { pool_ = pool ? pool : &BufferPool::shared(); }
+
+    // pageSize must satisfy validPageSize(); open() takes it from the header.
+    void create(const std::string& path, uint32_t pageSize = PAGE_SIZE);
     void open(const std::string& path);
     void close();
+    void flush();
+
+    void setDurability(Durability d);
+    Durability durability() const { return durability_; }
+
+    // Takes effect on the next create()/open().
+    void setBackend(StorageBackend b) { backend_ = b; }
+    StorageBackend backend() const { return backend_; }
+
+    // Takes effect on the next open(). A read-only handle never writes the
+    // file, its header included; calls that would write throw instead.
+    void setReadOnly(bool readOnly) { readOnly_ = readOnly; }
+    bool readOnly() const { return readOnly_; }
 
     uint32_t allocatePage();
     Page readPage(uint32_t pageId);
     void writePage(const Page& page);
 
     uint32_t pageCount() const { return header_.pageCount; }
+    uint32_t pageSize() const { return header_.pageSize; }
     uint32_t rootPageId() const { return header_.rootPageId; }
     void setRootPageId(uint32_t pid);
 
@@ -42,9 +62,20 @@ private:
     std::fstream file_;
     std::string path_;
     IdxHeader header_{};
+    BufferPool* pool_ = &BufferPool::shared();
+    uint32_t fileId_ = 0;
+    Durability durability_ = Durability::FlushEveryOp;
+    bool headerDirty_ = false;
+    StorageBackend backend_ = StorageBackend::Stream;
+    bool readOnly_ = false;
+    MappedFile map_;
 
     void writeHeader();
+    void writeHeaderPage();
     void readHeader();
+
+    void requireWritable() const;
+    void writeFrame(uint32_t pageId, const uint8_t* src);
 };
 
 }
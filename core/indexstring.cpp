@@ -1,11 +1,14 @@
 #include "IndexString.h"
+#include <stdexcept>
 
 namespace ma {
 
 void IndexString::create(const IndexStringDesc& d) {
     desc_ = d;
     storage_ = std::make_unique<IndexStorage>();
-    storage_->create(desc_.path);
+    storage_->setBackend(desc_.backend);
+    storage_->create(desc_.path, desc_.pageSize);
+    storage_->setKeyMeta(STRIDX_KEY_KIND, STRIDX_MAX_KEY_BYTES);
     tree_ = std::make_unique<BPlusTreeString>(storage_.get());
     tree_->createEmpty();
 }
@@ -13,7 +16,13 @@ void IndexString::create(const IndexStringDesc& d) {
 void IndexString::open(const IndexStringDesc& d) {
     desc_ = d;
     storage_ = std::make_unique<IndexStorage>();
+    storage_->setBackend(desc_.backend);
+    storage_->setReadOnly(desc_.readOnly);
     storage_->open(desc_.path);
+    if (storage_->keyKind() != STRIDX_KEY_KIND || storage_->keyBytes() != STRIDX_MAX_KEY_BYTES) {
+        close();
+        throw std::runtime_error("String index uses an older node format");
+    }
     tree_ = std::make_unique<BPlusTreeString>(storage_.get());
     if (storage_->rootPageId()==0) tree_->createEmpty();
 }
@@ -24,6 +33,9 @@ void IndexString::close() {
     storage_.reset();
 }
 
+void IndexString::flush() { if (storage_) storage_->flush(); }
+void IndexString::setDurability(Durability d) { if (storage_) storage_->setDurability(d); }
+
 void IndexString::insert(const std::string& k, RID rid) {
     tree_->insert(BPlusTreeString::packKey(k), rid);
 }
@@ -37,4 +49,9 @@ std::vector<RID> IndexString::range(const std::string& kmin, const std::string&
     return tree_->range(BPlusTreeString::packKey(kmin), BPlusTreeString::packKey(kmax));
 }
 
+void IndexString::bulkLoad(StringSorter& entries, double fillFactor) {
+    entries.finish();
+    tree_->bulkLoad([&](LeafEntryS& e) { return entries.next(e); }, entries.count(), fillFactor);
+}
+
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "BPlusTreeString.h"
+#include "ExternalSort.h"
 #include <memory>
 
 namespace ma {
@@ -8,8 +9,21 @@ struct IndexStringDesc {
     std::string name;
     int fieldIndex;
     std::string path;
+    StorageBackend backend = StorageBackend::Stream;
+    uint32_t pageSize = PAGE_SIZE;   // used by create(); open() reads it from the file
+    bool readOnly = false;           // used by open(); see IndexStorage::setReadOnly()
 };
 
+struct StringEntryLess {
+    bool operator()(const LeafEntryS& a, const LeafEntryS& b) const {
+        int c = BPlusTreeString::cmpKey(a.key, b.key);
+        if (c != 0) return c < 0;
+        if (a.ridPage != b.ridPage) return a.ridPage < b.ridPage;
+        return a.ridSlot < b.ridSlot;
+    }
+};
+using StringSorter = ExternalSorter<LeafEntryS, StringEntryLess>;
+
 class IndexString {
 public:
     IndexString() = default;
@@ -17,12 +31,17 @@ public:
     void create(const IndexStringDesc& d);
     void open(const IndexStringDesc& d);
     void close();
+    void flush();
+    void setDurability(Durability d);
 
     void insert(const std::string& k, RID rid);
     void erase(const std::string& k, RID rid);
     std::vector<RID> find(const std::string& k);
     std::vector<RID> range(const std::string& kmin, const std::string& kmax);
 
+    // Builds a freshly created index from all entries collected in the sorter.
+    void bulkLoad(StringSorter& entries, double fillFactor);
+
     const IndexStringDesc& desc() const { return desc_; }
 
 private:
@@ -3,68 +3,251 @@
 #include "Storage.h"
 #include "Record.h"
 #include "AvailList.h"
+#include "FreeSpaceMap.h"
 #include <string>
 #include <optional>
+#include <filesystem>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <functional>
 #include "IndexInt32.h"
 #include "IndexString.h"
 
 namespace ma {
 
+enum class IndexKind : uint8_t { Int32 = 1, String = 2 };
+
+// Catalog entry persisted in .meta; the file is <basePath>.<name>.idx.
+struct IndexDef {
+    std::string name;
+    int fieldIndex = -1;
+    IndexKind kind = IndexKind::Int32;
+};
+
+// A set of columns whose combined values must be distinct across rows.
+// Persisted in .meta; rows with a NULL in any of the columns are not checked.
+struct UniqueDef {
+    std::string name;
+    std::vector<int> fields;
+};
+
+// What Table::vacuum() did.
+struct VacuumStats {
+    uint32_t pagesCompacted = 0;
+    uint32_t pagesFreed = 0;      // pages with no rows, now on the free-page chain
+    uint32_t pagesTruncated = 0;  // free pages cut from the end of the file
+    size_t bytesReclaimed = 0;    // contiguous free space gained by compaction
+    uint32_t rowsReturned = 0;    // moved rows brought back to their home page
+};
+
+// Thrown by insert/update when a row would repeat a unique key.
+class DuplicateKeyError : public std::runtime_error {
+public:
+    explicit DuplicateKeyError(const std::string& constraint)
+        : std::runtime_error("Duplicate key for unique constraint " + constraint) {}
+};
+
 class Table {
 public:
     Table() = default;
-    ~Table() = default;
+    ~Table();
 
     void create(const std::string& basePath, const Schema& schema);
     void open(const std::string& basePath);
+    // Reads only <basePath>.meta; for callers that just need the columns.
+    static Schema readSchema(const std::string& basePath);
     void close();
+    void flush();
+
+    void setDurability(Durability d);
+    Durability durability() const { return durability_; }
 
     const Schema& schema() const { return schema_; }
 
+    // In format-2 tables, String values that would make a row longer than
+    // ROW_INLINE_LIMIT are kept on overflow pages. Reads that leave those
+    // columns out never touch them.
     RID insert(const Record& rec);
     std::optional<Record> read(const RID& rid);
+    // Decodes only the fields set in columns; the others read as NULL.
+    std::optional<Record> read(const RID& rid, const std::vector<bool>& columns);
     bool erase(const RID& rid);
     std::optional<RID> update(const RID& rid, const Record& rec);
+    // Sets a single field. Fixed-width values are patched into the stored row
+    // without touching indexes when the field is neither indexed nor part of
+    // a unique constraint; anything else goes through update(rid, rec).
+    std::optional<RID> update(const RID& rid, int fieldIndex, const std::optional<Value>& value);
+
+    // Packs each page's rows together and trims free slots off the end of its
+    // slot directory, moves pages left without rows to the free-page chain
+    // and, with truncateTail, cuts free pages off the end of the file. Live
+    // rows keep their RIDs, so indexes and saved row orders stay valid.
+    VacuumStats vacuum(bool truncateTail = false);
 
     size_t scanCount();
     std::vector<RID> scanAll();
+    // Live rows on pages [firstPage, firstPage + count), for scanning in steps.
+    std::vector<RID> scanPages(uint32_t firstPage, uint32_t count);
+    uint32_t pageCount() const { return storage_.pageCount(); }
+    // True when rid names a live row; only the slot is looked at.
+    bool exists(const RID& rid);
 
     void setFitStrategy(FitStrategy s) { fit_ = s; }
     FitStrategy fitStrategy() const { return fit_; }
 
+    // Takes effect on the next create()/open() and for indexes built afterwards.
+    void setBackend(StorageBackend b) { backend_ = b; storage_.setBackend(b); ovf_.setBackend(b); }
+    StorageBackend backend() const { return backend_; }
+
+    // Takes effect on the next open(). A read-only handle writes none of the
+    // table's files: the .alc is not loaded or saved, an index that cannot be
+    // opened is left out instead of rebuilt, and changes throw.
+    void setReadOnly(bool readOnly) { readOnly_ = readOnly; storage_.setReadOnly(readOnly); ovf_.setReadOnly(readOnly); }
+    bool readOnly() const { return readOnly_; }
+
+    // Page size of the .mad (and .ovf) made by the next create(), and of
+    // indexes created afterwards; see validPageSize(). Larger data pages suit
+    // scan-heavy tables, larger index pages give wider, shallower trees.
+    // Existing files keep the size they were created with; open() adopts it.
+    void setPageSize(uint32_t bytes);
+    uint32_t pageSize() const { return pageSize_; }
+    void setIndexPageSize(uint32_t bytes);
+    uint32_t indexPageSize() const { return indexPageSize_; }
+
+    // Leaf/internal fill used when an index is built in bulk (0.5 .. 1.0).
+    void setIndexFillFactor(double f) { indexFill_ = std::min(1.0, std::max(0.5, f)); }
+    double indexFillFactor() const { return indexFill_; }
+
     bool createInt32Index(int fieldIndex, const std::string& name);
     std::vector<RID> findByInt32(int fieldIndex, int32_t key);
     std::vector<RID> rangeByInt32(int fieldIndex, int32_t keyMin, int32_t keyMax);
 
     bool createStringIndex(int fieldIndex, const std::string& name);
+    // Exact: hits on keys of STRIDX_MAX_KEY_BYTES or more are checked against the row.
     std::vector<RID> findByString(int fieldIndex, const std::string& key);
     std::vector<RID> rangeByString(int fieldIndex, const std::string& keyMin, const std::string& keyMax);
 
+    // Equality lookup on one column, used for referential-integrity checks.
+    // Uses the field's index when there is one; otherwise a hash of the
+    // column's values that is built on first use and shared by every Table on
+    // the same file until one of them writes.
+    std::vector<RID> findEqual(int fieldIndex, const Value& v);
+    bool containsValue(int fieldIndex, const Value& v);
+
+    // Declares (or redefines) a unique constraint enforced by insert/update
+    // for every writer. Returns false, leaving the catalog unchanged, if the
+    // existing rows already repeat a key.
+    bool addUniqueConstraint(const std::string& name, const std::vector<int>& fields);
+    void dropUniqueConstraint(const std::string& name);
+    const std::vector<UniqueDef>& uniqueConstraints() const { return uniqueDefs_; }
+
+    // True when no row other than `self` holds rec's values in `fields`.
+    bool keyIsFree(const std::vector<int>& fields, const Record& rec,
+                   const std::optional<RID>& self = std::nullopt);
+
     const ma::Schema& getSchema() const { return schema_; }
+    const std::vector<IndexDef>& indexes() const { return indexDefs_; }
+    bool hasIndex(int fieldIndex) const {
+        return int32Indexes_.count(fieldIndex) != 0 || stringIndexes_.count(fieldIndex) != 0;
+    }
 
 private:
     std::string basePath_;
     std::string metaPath_;
     std::string madPath_;
+    std::string keySetFile_; // registry key for shared key sets (normalized .mad path)
 
     Schema schema_;
+    RecordLayout layout_;      // field slots when schema_ uses record format 2
+    uint32_t movedTail_ = 0;   // PAGE_MOVED page that placeMoved() appends to
+    Storage ovf_;              // <base>.ovf, pages of spilled String values
+    bool ovfOpen_ = false;
+    OverflowReader overflow_ = [this](uint32_t firstPage, uint8_t* out, size_t len) {
+        readOverflow(firstPage, out, len);
+    };
     Storage storage_;
     AvailList avail_;
+    FreeSpaceMap fsm_;
+    bool allocDirty_ = false; // free-slot list / free-space map differ from .alc
     FitStrategy fit_ = FitStrategy::FirstFit;
-
+    Durability durability_ = Durability::FlushEveryOp;
+    StorageBackend backend_ = StorageBackend::Stream;
+    bool readOnly_ = false;
+    uint32_t pageSize_ = PAGE_SIZE;
+    uint32_t indexPageSize_ = PAGE_SIZE;
+    double indexFill_ = 0.9; // room for later inserts before leaves split
+
+    std::vector<IndexDef> indexDefs_;
+    std::vector<UniqueDef> uniqueDefs_;
+    std::filesystem::file_time_type metaTime_{};
+    uintmax_t metaSize_ = 0;
+
+    // Keys held by each unique constraint (same order as uniqueDefs_), valid
+    // while the file's write generation is still uniqueGen_.
+    std::vector<std::unordered_map<std::string, RID>> uniqueKeys_;
+    uint64_t uniqueGen_ = UINT64_MAX;
+
+    void requireWritable() const;
     void writeMeta();
-    void readMeta();
-
-    void rebuildAvailFromPages();
-
-    std::optional<RID> tryInsertIntoFreeSlot(const Record& rec, const std::vector<uint8_t>& payload);
+    void readMeta(Schema& schema, std::vector<IndexDef>& defs, std::vector<UniqueDef>& uniques) const;
+    void stampMeta();
+    void syncCatalog();
+
+    std::string indexPath(const std::string& name) const { return basePath_ + "." + name + ".idx"; }
+    void openIndex(const IndexDef& def);
+    void closeIndex(const IndexDef& def);
+    void fillInt32Index(IndexInt32& idx, int fieldIndex);
+    void fillStringIndex(IndexString& idx, int fieldIndex);
+    std::vector<RID> keepStringHits(int fieldIndex, const std::vector<RID>& rids,
+                                    const std::function<bool(const std::string&)>& keep);
+
+    void indexInsert(const Record& rec, const RID& rid);
+    void indexErase(const Record& rec, const RID& rid);
+    void indexUpdate(const Record& oldRec, const Record& newRec, const RID& rid);
+
+    void rebuildAllocState();
+    bool loadAllocState();
+    void saveAllocState();
+    void markAllocDirty();
+    uint64_t invalidateKeySets();
+    uint64_t keySetGeneration() const;
+
+    void ensureUniqueKeys();
+    void checkUnique(const Record& rec, const std::optional<RID>& self);
+    void uniqueInsert(const Record& rec, const RID& rid);
+    void uniqueErase(const Record& rec, const RID& rid);
+    void noteWrite(uint64_t genBefore);
+
+    RID placeRecord(const std::vector<uint8_t>& payload);
+
+    std::optional<RID> tryInsertIntoFreeSlot(const std::vector<uint8_t>& payload);
     std::optional<RID> tryInsertIntoPages(const std::vector<uint8_t>& payload);
-
-    std::unique_ptr<IndexInt32> idxInt32_;
-    int idxInt32Field_ = -1;
-
-    std::unique_ptr<IndexString> idxString_;
-    int idxStringField_ = -1;
+    RID appendToPage(Page& p, const std::vector<uint8_t>& payload);
+
+    // Forwarding: a row that outgrows its page is moved to a PAGE_MOVED page
+    // and its home slot becomes a stub naming the new location.
+    RID placeMoved(const RID& home, const std::vector<uint8_t>& payload);
+    static RID stubTarget(const Page& p, const Slot& s);
+    static void setStubTarget(Page& p, const Slot& s, const RID& to);
+    std::optional<std::pair<uint16_t, uint16_t>> locateRow(const RID& rid, Page& p);
+
+    // Overflow chains holding spilled String values; see Serializer.
+    std::vector<uint8_t> encode(const Record& rec);
+    bool openOverflow(bool create);
+    void closeOverflow();
+    uint32_t writeOverflow(const uint8_t* bytes, size_t len);
+    void readOverflow(uint32_t firstPage, uint8_t* out, size_t len);
+    void freeOverflow(const std::vector<OverflowRef>& refs);
+    void forEachRow(const std::function<void(const RID&, const uint8_t*, size_t)>& fn);
+
+    std::string allocPath() const { return basePath_ + ".alc"; }
+    std::string overflowPath() const { return basePath_ + ".ovf"; }
+
+    // Open indexes keyed by field index; at most one per field.
+    std::map<int, std::unique_ptr<IndexInt32>> int32Indexes_;
+    std::map<int, std::unique_ptr<IndexString>> stringIndexes_;
 };
 
 }
@@ -134,6 +134,8 @@ void MainWindow::setupUi() {
     makeGroup("Tables");
     QAction* actDeleteTable = new QAction(QIcon(":/icons/icons/delete.svg"), "Delete Table...", this);
     ribbon->addAction(actDeleteTable);
+    QAction* actCompactTable = new QAction(QIcon(":/icons/icons/refresh.svg"), "Compact Table...", this);
+    ribbon->addAction(actCompactTable);
 
     for (auto* btn : ribbon->findChildren<QToolButton*>()) {
         btn->setAutoRaise(false);
@@ -155,6 +157,7 @@ void MainWindow::setupUi() {
     connect(actZoomOut,      &QAction::triggered, this, &MainWindow::zoomOut);
 
     connect(actDeleteTable, &QAction::triggered, this, &MainWindow::deleteSelectedTable);
+    connect(actCompactTable, &QAction::triggered, this, &MainWindow::compactSelectedTable);
 
     connect(actQuery,        &QAction::triggered, this, &MainWindow::openQueryBuilder);
     connect(actRelations, &QAction::triggered, this, &MainWindow::openRelationDesigner);
@@ -510,6 +513,19 @@ void MainWindow::closeTabsForBase(const QString& base) {
         openDesigns_.remove(base);
     }
 
+    // Forms on the table hold a handle and a row loader of their own.
+    const QString absBase = QFileInfo(base).absoluteFilePath();
+    for (auto it = openFormRunners_.begin(); it != openFormRunners_.end(); ) {
+        auto* fr = qobject_cast<FormRunnerPage*>(it.value().data());
+        if (fr && QFileInfo(fr->basePath()).absoluteFilePath() != absBase) { ++it; continue; }
+        if (fr) {
+            int idx = tabs_->indexOf(fr);
+            if (idx >= 0) tabs_->removeTab(idx);
+            delete fr;
+        }
+        it = openFormRunners_.erase(it);
+    }
+
     QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents, 10);
 }
 
@@ -529,6 +545,8 @@ bool MainWindow::removeTableFiles(const QString& base) {
     bool ok = true;
     ok &= tryRemove(base + ".mad");
     ok &= tryRemove(base + ".meta");
+    ok &= tryRemove(base + ".ovf");
+    QFile::remove(base + ".alc");
 
     QFileInfo bi(base);
     const QString dir = bi.dir().absolutePath();
@@ -686,6 +704,47 @@ void MainWindow::deleteSelectedTable() {
     deleteTableByBase(base);
 }
 
+void MainWindow::compactSelectedTable() {
+    if (!dock_) return;
+    const QString base = dock_->currentSelectedBase();
+    if (base.isEmpty()) {
+        QMessageBox::information(this, "Compact Table", "Select a table in the left panel first.");
+        return;
+    }
+
+    // Every open handle on the file has to go first: truncating the file
+    // under a mapped reader faults it, and a stream handle would keep a stale
+    // header. Tabs on the table are closed and reopened afterwards; a running
+    // query may read it too, so it is stopped.
+    const bool reopen = openDatasheets_.contains(base);
+    QList<QPair<QString, QJsonObject>> forms;
+    const QString absBase = QFileInfo(base).absoluteFilePath();
+    for (auto it = openFormRunners_.cbegin(); it != openFormRunners_.cend(); ++it) {
+        auto* fr = qobject_cast<FormRunnerPage*>(it.value().data());
+        if (fr && QFileInfo(fr->basePath()).absoluteFilePath() == absBase)
+            forms.append(qMakePair(it.key(), fr->formDef()));
+    }
+    if (auto* qb = qobject_cast<QueryBuilderPage*>(queryBuilderTab_.data())) qb->cancelQuery();
+    closeTabsForBase(base);
+
+    const QString tableName = QFileInfo(base).fileName();
+    try {
+        ma::Table t;
+        t.open(base.toStdString());
+        const ma::VacuumStats st = t.vacuum(true);
+        t.close();
+        QString msg = QString("Table \"%1\" compacted: %2 pages packed, %3 freed, %4 removed from the file")
+                          .arg(tableName).arg(st.pagesCompacted).arg(st.pagesFreed).arg(st.pagesTruncated);
+        if (st.rowsReturned > 0) msg += QString(", %1 moved rows returned").arg(st.rowsReturned);
+        statusBar()->showMessage(msg, 5000);
+    } catch (const std::exception& e) {
+        QMessageBox::critical(this, "Compact Table",
+                              QString("Could not compact \"%1\":\n%2").arg(tableName, e.what()));
+    }
+    if (reopen) openFromDockDatasheet(base);
+    for (const auto& f : forms) ensureFormRunnerTab(f.first, f.second);
+}
+
 void MainWindow::openReportSimple() {
     if (currentProjectPath_.isEmpty()) {
         QMessageBox::information(this, "Report", "Open or create a Project first.");
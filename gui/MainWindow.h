@@ -37,6 +37,7 @@ private slots:
     void deleteCurrentProject();
     void deleteTableByBase(const QString& base);
     void deleteSelectedTable();
+    void compactSelectedTable();
     void openReportSimple();
 
     void newFormFromTable();
@@ -79,8 +79,19 @@ DatasheetPage::DatasheetPage(const QString& basePath, QWidget* parent)
     connect(model_, &QAbstractItemModel::dataChanged, this,
             [this](const QModelIndex&, const QModelIndex&){ autoFitColumns(20); });
 
+    // While loading, fit once the first rows are in and again at the end.
     connect(model_, &QAbstractItemModel::rowsInserted, this,
-            [this](const QModelIndex&, int, int){ autoFitColumns(20); });
+            [this](const QModelIndex&, int first, int){
+                if (!model_->isLoading() || first == 0) autoFitColumns(20);
+            });
+
+    connect(model_, &TableModel::loadProgress, this,
+            [this](int rows){ info_->setText(QString("Rows: %1 (loading...)").arg(rows)); });
+
+    connect(model_, &TableModel::loadFinished, this, [this]{
+        autoFitColumns(20);
+        info_->setText(QString("Rows: %1").arg(model_->rowCount()));
+    });
 
     connect(model_, &QAbstractItemModel::rowsRemoved, this,
             [this](const QModelIndex&, int, int){ autoFitColumns(20); });
@@ -125,7 +136,8 @@ DatasheetPage::DatasheetPage(const QString& basePath, QWidget* parent)
     view_->horizontalHeader()->setHighlightSections(false);
 
     autoFitColumns(20);
-    info_->setText(QString("Rows: %1").arg(model_->rowCount()));
+    info_->setText(model_->isLoading() ? QString("Rows: (loading...)")
+                                       : QString("Rows: %1").arg(model_->rowCount()));
 }
 
 void DatasheetPage::setupUi() {
@@ -179,7 +191,8 @@ void DatasheetPage::refresh() {
     if (!model_) return;
     model_->reload();
     autoFitColumns(20);
-    info_->setText(QString("Rows: %1").arg(model_->rowCount()));
+    info_->setText(model_->isLoading() ? QString("Rows: (loading...)")
+                                       : QString("Rows: %1").arg(model_->rowCount()));
 
     const QString pkOnDisk = loadPrimaryKeyNameForBase(basePath_);
     model_->setPrimaryKeyName(pkOnDisk);
@@ -218,6 +231,7 @@ void DatasheetPage::prepareForClose() {
     if (view_) view_->setModel(nullptr);
 
     if (model_) {
+        model_->cancelLoad();
         model_->disconnect();
         model_->deleteLater();
         model_ = nullptr;
@@ -429,8 +429,7 @@ static bool loadSchemaForTableBase(const QString& projectDir,
 {
     try {
         const QString base = QDir(projectDir).filePath(tableName);
-        ma::Table t; t.open(base.toStdString());
-        out = t.getSchema();
+        out = ma::Table::readSchema(base.toStdString());
         return true;
     } catch (...) {
         return false;
@@ -499,8 +498,7 @@ void DesignPage::setupUi() {
 
 void DesignPage::loadSchema() {
     try {
-        Table t; t.open(basePath_.toStdString());
-        setSchema(t.getSchema());
+        setSchema(Table::readSchema(basePath_.toStdString()));
         banner_->setText("Editing design for: " + QFileInfo(basePath_).fileName());
         banner_->show();
         updateLastNamesBuffer();
@@ -949,10 +947,12 @@ void DesignPage::saveDesign() {
 
     QFile::remove(tmpMeta);
     QFile::remove(tmpMad);
+    QFile::remove(tmpBase + ".ovf");
 
     try {
         ma::Table told; told.open(base.toStdString());
         ma::Table tnew; tnew.create(tmpBase.toStdString(), newS);
+        tnew.setDurability(ma::Durability::FlushOnCommit);
 
         auto fmap = buildFieldMap(oldS, newS);
 
@@ -1001,6 +1001,11 @@ void DesignPage::saveDesign() {
             return;
         }
 
+        QFile::remove(base + ".alc");
+        QFile::rename(tmpBase + ".alc", base + ".alc");
+        QFile::remove(base + ".ovf");
+        QFile::rename(tmpBase + ".ovf", base + ".ovf");
+
         banner_->setText("Design saved");
         banner_->show();
 
@@ -14,6 +14,7 @@
 #include <QDate>
 #include <QDir>
 #include <QFileInfo>
+#include <algorithm>
 #include "../core/forms_io.h"
 #include "../core/Table.h"
 #include "../core/DisplayFmt.h"
@@ -49,11 +50,42 @@ FormRunnerPage::FormRunnerPage(const QString& projectDir,
     schema_ = std::make_unique<ma::Schema>(table_->getSchema());
 
     model_  = std::make_unique<TableModel>(table_.get(), basePath_, this);
+    connect(model_.get(), &QAbstractItemModel::rowsInserted, this, [this]{ showPendingRow(false); });
+    connect(model_.get(), &TableModel::loadFinished, this, [this]{ showPendingRow(true); });
 
     rebuildControls();
 
-    if (rowCount() > 0) { current_ = 0; bindRowToUi(current_); }
-    else { onAdd(); }
+    pendingRow_ = 0;
+    addWhenEmpty_ = true;
+    if (!model_->isLoading()) showPendingRow(true);
+}
+
+// Rows arrive from the model in chunks; the record to show is bound as soon
+// as it is loaded. An empty table gets a new record on first open only.
+void FormRunnerPage::showPendingRow(bool loadEnded) {
+    if (pendingRow_ < 0) return;
+    if (pendingRow_ < rowCount() || (loadEnded && rowCount() > 0)) {
+        current_ = std::min(pendingRow_, rowCount() - 1);
+        pendingRow_ = -1;
+        addWhenEmpty_ = false;
+        bindRowToUi(current_);
+        return;
+    }
+    if (!loadEnded) return;
+    pendingRow_ = -1;
+    current_ = -1;
+    if (addWhenEmpty_) {
+        addWhenEmpty_ = false;
+        onAdd();
+    } else {
+        infoLabel_->setText("No records");
+    }
+}
+
+void FormRunnerPage::reloadAt(int row) {
+    pendingRow_ = std::max(row, 0);
+    if (model_) model_->reload();
+    if (!model_ || !model_->isLoading()) showPendingRow(true);
 }
 
 void FormRunnerPage::buildUi() {
@@ -284,13 +316,7 @@ void FormRunnerPage::onDelete() {
 
 void FormRunnerPage::onSave() {
     dirty_ = false;
-    if (model_) model_->reload();
-    if (rowCount() == 0) { current_ = -1; infoLabel_->setText("No records"); }
-    else {
-        if (current_ < 0) current_ = 0;
-        if (current_ >= rowCount()) current_ = rowCount()-1;
-        bindRowToUi(current_);
-    }
+    reloadAt(current_);
     infoLabel_->setText("Saved.");
 }
 
@@ -308,11 +334,7 @@ void FormRunnerPage::onClose() {
 bool FormRunnerPage::insertRow()  { onAdd();    return true; }
 bool FormRunnerPage::deleteRows() { onDelete(); return true; }
 bool FormRunnerPage::refresh()    {
-    if (model_) model_->reload();
-    if (rowCount()==0) { current_=-1; infoLabel_->setText("No records"); return true; }
-    if (current_ < 0) current_ = 0;
-    if (current_ >= rowCount()) current_ = rowCount()-1;
-    bindRowToUi(current_);
+    reloadAt(current_);
     return true;
 }
 bool FormRunnerPage::zoomInView()  { return true; }
@@ -25,6 +25,9 @@ public:
                             const QJsonObject& formDef,
                             QWidget* parent=nullptr);
 
+    const QString& basePath() const { return basePath_; }
+    const QJsonObject& formDef() const { return formDef_; }
+
 signals:
     void requestClose(QWidget* page);
 
@@ -53,6 +56,8 @@ private:
     void rebuildControls();
 
     void bindRowToUi(int row);
+    void showPendingRow(bool loadEnded);
+    void reloadAt(int row);
     void commitField(const QString& fieldName);
 
     int  rowCount() const;
@@ -69,6 +74,8 @@ private:
     std::unique_ptr<ma::Schema> schema_;
 
     int  current_{-1};
+    int  pendingRow_{-1};     // row to bind once the model has loaded it
+    bool addWhenEmpty_{false};
     bool dirty_{false};
 
     QMap<QString, QWidget*> editors_;
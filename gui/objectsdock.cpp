@@ -155,6 +155,7 @@ void ObjectsDock::newTable() {
         if (ans != QMessageBox::Yes) return;
         QFile::remove(meta);
         QFile::remove(mad);
+        QFile::remove(base + ".ovf");
     }
 
     try {
@@ -17,13 +17,18 @@
 #include <QSpinBox>
 #include <QSet>
 #include <QItemSelectionModel>
+#include <QSignalBlocker>
+#include <QJsonObject>
 #include "../core/Table.h"
 #include "../core/Schema.h"
 #include "../core/DisplayFmt.h"
+#include "../core/relations_io.h"
 #include "QueryModel.h"
 
 using namespace ma;
 
+static constexpr int InnerFieldRole = Qt::UserRole + 1;
+
 static QString baseFromMeta(const QString& metaPath) {
     QString p = metaPath;
     if (p.endsWith(".meta")) p.chop(5);
@@ -50,6 +55,10 @@ void QueryBuilderPage::setupUi() {
     cbTable_ = new QComboBox(row1);
     h1->addWidget(cbTable_, 1);
 
+    h1->addWidget(new QLabel("Join:", row1));
+    cbJoin_ = new QComboBox(row1);
+    h1->addWidget(cbJoin_, 1);
+
     auto* btnClear = new QPushButton("Clear", row1);
     auto* btnRun   = new QPushButton("Run", row1);
     h1->addWidget(btnClear);
@@ -110,10 +119,19 @@ void QueryBuilderPage::setupUi() {
     tvResult_->setModel(model_);
 
     connect(cbTable_, &QComboBox::currentIndexChanged, this, &QueryBuilderPage::onTableChanged);
+    connect(cbJoin_,  &QComboBox::currentIndexChanged, this, &QueryBuilderPage::onJoinChanged);
     connect(btnAdd,   &QPushButton::clicked,            this, &QueryBuilderPage::onAddCondition);
     connect(btnRemove_, &QPushButton::clicked,          this, &QueryBuilderPage::onRemoveCondition);
     connect(btnRun,   &QPushButton::clicked,            this, &QueryBuilderPage::onRun);
     connect(btnClear, &QPushButton::clicked,            this, &QueryBuilderPage::onClear);
+    connect(model_, &QueryModel::progress, this, [this](int rows) {
+        labInfo_->setText(QString("Rows: %1 (loading...)").arg(rows));
+    });
+    connect(model_, &QueryModel::finished, this, [this](bool ok, const QString& err) {
+        if (!ok)
+            QMessageBox::warning(this, "Query Builder", QString("Query failed:\n%1").arg(err));
+        labInfo_->setText(QString("Rows: %1").arg(model_->rowCount()));
+    });
 
     btnRemove_->setEnabled(false);
 
@@ -137,6 +155,75 @@ void QueryBuilderPage::loadTables() {
 void QueryBuilderPage::onTableChanged(int) {
     currentBasePath_ = cbTable_->currentData().toString();
     loadFieldsForCurrent();
+    loadJoinsForCurrent();
+}
+
+void QueryBuilderPage::onJoinChanged(int) {
+    loadJoinFields();
+}
+
+void QueryBuilderPage::loadJoinsForCurrent() {
+    QSignalBlocker block(cbJoin_);
+    cbJoin_->clear();
+    joins_.clear();
+    cbJoin_->addItem("(none)");
+
+    const QString me = cbTable_->currentText();
+    QDir d(projectDir_.isEmpty()? QDir::currentPath() : projectDir_);
+    const QString path = d.filePath("relations.json");
+    migrateRelationsToV2(path);
+
+    for (const auto& v : loadRelationsArrayFlexible(path)) {
+        const auto o  = v.toObject();
+        const auto lt = o.value("leftTable").toString();
+        const auto lf = o.value("leftField").toString();
+        const auto rt = o.value("rightTable").toString();
+        const auto rf = o.value("rightField").toString();
+        const auto jt = o.value("joinType").toString("INNER").toUpper();
+        if (lt.isEmpty() || lf.isEmpty() || rt.isEmpty() || rf.isEmpty()) continue;
+
+        // The current table drives the join; LEFT/RIGHT keep its unmatched rows
+        // only when it is the preserved side.
+        auto add = [&](const QString& myField, const QString& other, const QString& otherField, bool preserved) {
+            const QString kind = preserved ? "LEFT" : "INNER";
+            joins_.push_back({d.absoluteFilePath(other), myField, otherField, preserved});
+            cbJoin_->addItem(QString("%1 %2 ON %3.%4 = %2.%5").arg(kind, other, me, myField, otherField));
+        };
+        if (lt.compare(me, Qt::CaseInsensitive) == 0) add(lf, rt, rf, jt == "LEFT");
+        if (rt.compare(me, Qt::CaseInsensitive) == 0) add(rf, lt, lf, jt == "RIGHT");
+    }
+    cbJoin_->setEnabled(!joins_.empty());
+    loadJoinFields();
+}
+
+// Replaces the inner-table entries at the end of the field list.
+void QueryBuilderPage::loadJoinFields() {
+    for (int i = lwFields_->count() - 1; i >= 0; --i) {
+        if (lwFields_->item(i)->data(InnerFieldRole).toBool()) delete lwFields_->takeItem(i);
+    }
+    joinOuterField_ = -1;
+    joinInnerField_ = -1;
+
+    const int sel = cbJoin_->currentIndex() - 1;
+    if (sel < 0 || sel >= (int)joins_.size()) return;
+    const auto& jo = joins_[(size_t)sel];
+    joinOuterField_ = currentFieldIndexByName(jo.outerField);
+
+    try {
+        const Schema s = Table::readSchema(jo.innerBase.toStdString());
+        const QString innerName = QFileInfo(jo.innerBase).fileName();
+        for (int i=0;i<(int)s.fields.size();++i) {
+            const QString fname = QString::fromStdString(s.fields[i].name);
+            if (fname.compare(jo.innerField, Qt::CaseInsensitive) == 0) joinInnerField_ = i;
+            auto* it = new QListWidgetItem(innerName + "." + fname, lwFields_);
+            it->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+            it->setCheckState(Qt::Checked);
+            it->setData(Qt::UserRole, i);
+            it->setData(InnerFieldRole, true);
+        }
+    } catch (const std::exception& ex) {
+        QMessageBox::warning(this, "Query Builder", QString("Cannot read joined table:\n%1").arg(ex.what()));
+    }
 }
 
 void QueryBuilderPage::loadFieldsForCurrent() {
@@ -149,8 +236,7 @@ void QueryBuilderPage::loadFieldsForCurrent() {
         return;
     }
     try {
-        Table t; t.open(currentBasePath_.toStdString());
-        const Schema s = t.getSchema();
+        const Schema s = Table::readSchema(currentBasePath_.toStdString());
 
         for (int i=0;i<(int)s.fields.size();++i) {
             const auto& f = s.fields[i];
@@ -288,9 +374,14 @@ void QueryBuilderPage::buildAndRun() {
     QueryModel::Spec s;
     s.basePath = currentBasePath_;
 
+    std::vector<int> innerColumns;
     for (int i=0;i<lwFields_->count();++i) {
         auto* it = lwFields_->item(i);
         if (it->checkState() == Qt::Checked) {
+            if (it->data(InnerFieldRole).toBool()) {
+                innerColumns.push_back(it->data(Qt::UserRole).toInt());
+                continue;
+            }
             const int src = currentFieldIndexByName(it->text());
             if (src >= 0) s.columns.push_back(src);
         }
@@ -299,6 +390,21 @@ void QueryBuilderPage::buildAndRun() {
         for (const auto& c : columns_) s.columns.push_back(c.index);
     }
 
+    const int sel = cbJoin_->currentIndex() - 1;
+    if (sel >= 0 && sel < (int)joins_.size()) {
+        if (joinOuterField_ < 0 || joinInnerField_ < 0) {
+            QMessageBox::warning(this, "Query Builder", "The selected relation refers to a field that no longer exists.");
+            return;
+        }
+        QueryModel::Join j;
+        j.basePath = joins_[(size_t)sel].innerBase;
+        j.outerField = joinOuterField_;
+        j.innerField = joinInnerField_;
+        j.keepUnmatched = joins_[(size_t)sel].keepUnmatched;
+        j.columns = innerColumns;
+        s.join = j;
+    }
+
     for (int r=0; r<twConds_->rowCount(); ++r) {
         auto* cbField = qobject_cast<QComboBox*>(twConds_->cellWidget(r, 0));
         auto* cbOp    = qobject_cast<QComboBox*>(twConds_->cellWidget(r, 1));
@@ -332,12 +438,14 @@ void QueryBuilderPage::buildAndRun() {
         s.conds.push_back(std::move(c));
     }
 
-    QString err;
-    if (!model_->run(s, &err)) {
-        QMessageBox::warning(this, "Query Builder", QString("Query failed:\n%1").arg(err));
-        return;
-    }
-    labInfo_->setText(QString("Rows: %1").arg(model_->rowCount()));
+    labInfo_->setText("Rows: 0 (loading...)");
+    model_->start(s);
+}
+
+void QueryBuilderPage::cancelQuery() {
+    if (!model_->isRunning()) return;
+    model_->cancel();
+    labInfo_->setText(QString("Rows: %1 (stopped)").arg(model_->rowCount()));
 }
 
 void QueryBuilderPage::updateRemoveEnabled() {
@@ -17,8 +17,12 @@ class QueryBuilderPage : public QWidget {
 public:
     explicit QueryBuilderPage(const QString& projectDir, QWidget* parent=nullptr);
 
+    // Stops a query still running; the rows it returned so far stay.
+    void cancelQuery();
+
 private slots:
     void onTableChanged(int);
+    void onJoinChanged(int);
     void onAddCondition();
     void onRemoveCondition();
     void onRun();
@@ -28,6 +32,8 @@ private:
     void setupUi();
     void loadTables();
     void loadFieldsForCurrent();
+    void loadJoinsForCurrent();
+    void loadJoinFields();
     void buildAndRun();
 
     int  currentFieldIndexByName(const QString& name) const;
@@ -38,6 +44,7 @@ private:
     QString projectDir_;
 
     QComboBox*    cbTable_ {nullptr};
+    QComboBox*    cbJoin_ {nullptr};
     QListWidget*  lwFields_ {nullptr};
     QTableWidget* twConds_ {nullptr};
     QTableView*   tvResult_ {nullptr};
@@ -47,4 +54,10 @@ private:
     QString       currentBasePath_;
     struct Col { QString name; int index; int type; uint16_t size; };
     std::vector<Col> columns_;
+
+    // Relations from relations.json that involve the current table.
+    struct JoinOpt { QString innerBase; QString outerField; QString innerField; bool keepUnmatched; };
+    std::vector<JoinOpt> joins_;
+    int joinOuterField_ = -1;
+    int joinInnerField_ = -1;
 };
@@ -4,6 +4,12 @@
 #include <algorithm>
 #include <variant>
 #include <limits>
+#include <unordered_map>
+#include <QFileInfo>
+#include <QThread>
+#include <functional>
+#include <iterator>
+#include <QByteArray>
 
 using namespace ma;
 
@@ -19,186 +25,278 @@ static QVariant valueToQVariant(const Value& var) {
     return {};
 }
 
-QueryModel::QueryModel(QObject* parent) : QAbstractTableModel(parent) {}
+// One evaluation of a Spec: the index probe or scan, the filter and the
+// join. It opens its own Table handles, so it can run on a worker thread,
+// and hands rows to the sink in batches; the sink returns false to stop.
+class QueryModel::Run {
+public:
+    using Sink = std::function<bool(std::vector<Record>&)>;
 
-bool QueryModel::run(const Spec& s, QString* err) {
-    try {
-        beginResetModel();
-        table_ = std::make_unique<Table>();
-        table_->open(s.basePath.toStdString());
-        schema_ = table_->getSchema();
-
-        proj_.clear();
-        if (s.columns.empty()) {
-            proj_.resize((int)schema_.fields.size());
-            for (int i=0;i<(int)schema_.fields.size();++i) proj_[i] = i;
-        } else {
-            proj_ = s.columns;
-        }
+    Run(const Spec& s, const std::vector<int>& proj, const std::vector<int>& innerProj,
+        int idxCond, Sink sink)
+        : spec_(s), conds_(s.conds), proj_(proj), innerProj_(innerProj), idxCond_(idxCond), sink_(std::move(sink)) {}
 
-        conds_ = s.conds;
+    JoinMethod execute();
 
-        rows_.clear();
-        rids_.clear();
-
-        auto isIndexableOp = [](Op op)->bool {
-            switch (op) { case Op::EQ: case Op::LT: case Op::LE: case Op::GT: case Op::GE: return true; default: return false; }
-        };
-        int idxCond = -1;
-        for (int i=0;i<(int)conds_.size();++i) {
-            if (conds_[i].fieldIndex>=0 && conds_[i].fieldIndex<(int)schema_.fields.size() && isIndexableOp(conds_[i].op)) {
-                const auto& f = schema_.fields[conds_[i].fieldIndex];
-                if (f.type == FieldType::Int32 || f.type == FieldType::String || f.type == FieldType::CharN) { idxCond = i; break; }
-            }
-        }
+private:
+    static constexpr size_t FIRST_BATCH = 256;
+    static constexpr size_t BATCH = 4096;
+    static constexpr uint32_t PAGES_PER_STEP = 64;
+
+    using Test = std::function<bool(const Value&)>;
+
+    // A condition compiled against the schema: the comparison is picked by
+    // column type and operator once per run instead of once per row.
+    struct Pred {
+        int  field = -1;          // -1: the condition never matches
+        bool ifNull = false;      // outcome when the field is NULL
+        bool andWithNext = true;
+        Test test;
+    };
+
+    void     compile();
+    static Test compileTest(const Field& f, const Cond& c);
+    bool     matchRecord(const Record& rec) const;
+    bool     matchOne(const Record& rec, const Pred& p) const;
+    std::vector<RID> probeIndex();
+    void     openJoin();
+    void     emitRow(const Record& rec);
+    void     addRow(const Record& o, const Record* in);
+    void     flush();
 
-        if (idxCond == -1) {
-            const auto all = table_->scanAll();
-            rows_.reserve(all.size());
-            for (const auto& rid : all) {
-                auto rec = table_->read(rid);
+    const Spec& spec_;
+    const std::vector<Cond>& conds_;
+    const std::vector<int>& proj_;
+    const std::vector<int>& innerProj_;
+    const int idxCond_;
+    const Sink sink_;
+    bool stopped_ = false;
+    std::vector<Pred> preds_;
+    std::vector<bool> columns_;      // outer fields the run reads
+    std::vector<bool> innerColumns_; // inner fields the join reads
+
+    Table table_;
+    Schema schema_;
+    std::vector<Record> batch_;
+    size_t batchTarget_ = FIRST_BATCH;
+
+    Table inner_;
+    JoinMethod joinMethod_ = JoinMethod::None;
+    std::unordered_map<Value, std::vector<Record>> build_;
+};
+
+QueryModel::JoinMethod QueryModel::Run::execute() {
+    table_.setBackend(StorageBackend::Mapped);
+    table_.setReadOnly(true);
+    table_.open(spec_.basePath.toStdString());
+    schema_ = table_.getSchema();
+    compile();
+
+    // Decode only what the projection, the conditions and the join touch.
+    columns_.assign(schema_.fields.size(), false);
+    auto need = [](std::vector<bool>& cols, int f) { if (f >= 0 && f < (int)cols.size()) cols[f] = true; };
+    for (int f : proj_) need(columns_, f);
+    for (const Pred& p : preds_) need(columns_, p.field);
+    if (spec_.join) need(columns_, spec_.join->outerField);
+
+    if (spec_.join) openJoin();
+
+    // A read-only handle leaves out an index it cannot open; scan instead.
+    const bool probe = idxCond_ != -1 && table_.hasIndex(conds_[idxCond_].fieldIndex);
+    if (!probe) {
+        for (uint32_t pid = 1; pid < table_.pageCount() && !stopped_; pid += PAGES_PER_STEP) {
+            for (const auto& rid : table_.scanPages(pid, PAGES_PER_STEP)) {
+                auto rec = table_.read(rid, columns_);
                 if (!rec) continue;
-                if (matchRecord(*rec)) {
-                    ma::Record row = ma::Record::withFieldCount((int)proj_.size());
-                    for (int c=0;c<(int)proj_.size();++c) row.values[c] = (*rec).values[proj_[c]];
-                    rows_.push_back(std::move(row));
-                }
+                if (matchRecord(*rec)) emitRow(*rec);
             }
-            endResetModel();
-            return true;
+            flush();
+        }
+    } else {
+        for (const auto& rid : probeIndex()) {
+            if (stopped_) break;
+            auto rec = table_.read(rid, columns_);
+            if (!rec) continue;
+            if (matchRecord(*rec)) emitRow(*rec);
         }
+    }
+    flush();
+    if (!batch_.empty() && !stopped_) sink_(batch_);
+    return joinMethod_;
+}
 
-        const Cond& c0 = conds_[idxCond];
-        const int   fi = c0.fieldIndex;
-        const auto& fld= schema_.fields[fi];
+std::vector<RID> QueryModel::Run::probeIndex() {
+    auto isIndexableOp = [](Op op)->bool {
+        switch (op) { case Op::EQ: case Op::LT: case Op::LE: case Op::GT: case Op::GE: return true; default: return false; }
+    };
 
-        int idxSecond = -1;
-        for (int i=0;i<(int)conds_.size();++i) {
-            if (i==idxCond) continue;
-            if (conds_[i].fieldIndex==fi && isIndexableOp(conds_[i].op)) { idxSecond = i; break; }
-        }
+    const Cond& c0 = conds_[idxCond_];
+    const int   fi = c0.fieldIndex;
+    const auto& fld= schema_.fields[fi];
 
-        std::vector<RID> candidates;
+    int idxSecond = -1;
+    for (int i=0;i<(int)conds_.size();++i) {
+        if (i==idxCond_) continue;
+        if (conds_[i].fieldIndex==fi && isIndexableOp(conds_[i].op)) { idxSecond = i; break; }
+    }
 
-        if (fld.type == FieldType::Int32) {
-            table_->createInt32Index(fi, "idx_" + schema_.fields[fi].name);
+    std::vector<RID> candidates;
 
-            auto toI32 = [](const QVariant& v)->int32_t { bool ok=false; int val = v.toInt(&ok); return ok?(int32_t)val:(int32_t)0; };
+    if (fld.type == FieldType::Int32) {
+        auto toI32 = [](const QVariant& v)->int32_t { bool ok=false; int val = v.toInt(&ok); return ok?(int32_t)val:(int32_t)0; };
 
-            if (idxSecond == -1) {
-                switch (c0.op) {
-                case Op::EQ: candidates = table_->findByInt32(fi, toI32(c0.value)); break;
-                case Op::LT: candidates = table_->rangeByInt32(fi, std::numeric_limits<int32_t>::min(), toI32(c0.value)-1); break;
-                case Op::LE: candidates = table_->rangeByInt32(fi, std::numeric_limits<int32_t>::min(), toI32(c0.value));   break;
-                case Op::GT: candidates = table_->rangeByInt32(fi, toI32(c0.value)+1, std::numeric_limits<int32_t>::max()); break;
-                case Op::GE: candidates = table_->rangeByInt32(fi, toI32(c0.value),   std::numeric_limits<int32_t>::max()); break;
+        if (idxSecond == -1) {
+            switch (c0.op) {
+            case Op::EQ: candidates = table_.findByInt32(fi, toI32(c0.value)); break;
+            case Op::LT: candidates = table_.rangeByInt32(fi, std::numeric_limits<int32_t>::min(), toI32(c0.value)-1); break;
+            case Op::LE: candidates = table_.rangeByInt32(fi, std::numeric_limits<int32_t>::min(), toI32(c0.value));   break;
+            case Op::GT: candidates = table_.rangeByInt32(fi, toI32(c0.value)+1, std::numeric_limits<int32_t>::max()); break;
+            case Op::GE: candidates = table_.rangeByInt32(fi, toI32(c0.value),   std::numeric_limits<int32_t>::max()); break;
+            default: break;
+            }
+        } else {
+            const Cond& c1 = conds_[idxSecond];
+            int32_t lo = std::numeric_limits<int32_t>::min();
+            int32_t hi = std::numeric_limits<int32_t>::max();
+            auto apply = [&](const Cond& c){
+                switch (c.op) {
+                case Op::LT: hi = std::min<int32_t>(hi, toI32(c.value)-1); break;
+                case Op::LE: hi = std::min<int32_t>(hi, toI32(c.value));   break;
+                case Op::GT: lo = std::max<int32_t>(lo, toI32(c.value)+1); break;
+                case Op::GE: lo = std::max<int32_t>(lo, toI32(c.value));   break;
+                case Op::EQ: lo = hi = toI32(c.value); break;
                 default: break;
                 }
-            } else {
-                const Cond& c1 = conds_[idxSecond];
-                int32_t lo = std::numeric_limits<int32_t>::min();
-                int32_t hi = std::numeric_limits<int32_t>::max();
-                auto apply = [&](const Cond& c){
-                    switch (c.op) {
-                    case Op::LT: hi = std::min<int32_t>(hi, toI32(c.value)-1); break;
-                    case Op::LE: hi = std::min<int32_t>(hi, toI32(c.value));   break;
-                    case Op::GT: lo = std::max<int32_t>(lo, toI32(c.value)+1); break;
-                    case Op::GE: lo = std::max<int32_t>(lo, toI32(c.value));   break;
-                    case Op::EQ: lo = hi = toI32(c.value); break;
-                    default: break;
-                    }
-                };
-                apply(c0); apply(c1);
-                candidates = table_->rangeByInt32(fi, lo, hi);
+            };
+            apply(c0); apply(c1);
+            candidates = table_.rangeByInt32(fi, lo, hi);
+        }
+    } else if (fld.type == FieldType::String || fld.type == FieldType::CharN) {
+        auto toStd = [](const QVariant& v)->std::string { return v.toString().toStdString(); };
+
+        if (idxSecond == -1) {
+            switch (c0.op) {
+            case Op::EQ: candidates = table_.findByString(fi, toStd(c0.value)); break;
+            case Op::LT: candidates = table_.rangeByString(fi, std::string(), toStd(c0.value)); break;
+            case Op::LE: candidates = table_.rangeByString(fi, std::string(), toStd(c0.value)); break;
+            case Op::GT: candidates = table_.rangeByString(fi, toStd(c0.value), std::string(1, char(0x7f))); break;
+            case Op::GE: candidates = table_.rangeByString(fi, toStd(c0.value), std::string(1, char(0x7f))); break;
+            default: break;
             }
-        } else if (fld.type == FieldType::String || fld.type == FieldType::CharN) {
-            table_->createStringIndex(fi, "idx_" + schema_.fields[fi].name);
-            auto toStd = [](const QVariant& v)->std::string { return v.toString().toStdString(); };
-
-            if (idxSecond == -1) {
-                switch (c0.op) {
-                case Op::EQ: candidates = table_->findByString(fi, toStd(c0.value)); break;
-                case Op::LT: candidates = table_->rangeByString(fi, std::string(), toStd(c0.value)); break;
-                case Op::LE: candidates = table_->rangeByString(fi, std::string(), toStd(c0.value)); break;
-                case Op::GT: candidates = table_->rangeByString(fi, toStd(c0.value), std::string(1, char(0x7f))); break;
-                case Op::GE: candidates = table_->rangeByString(fi, toStd(c0.value), std::string(1, char(0x7f))); break;
+        } else {
+            const Cond& c1 = conds_[idxSecond];
+            std::string lo = "";
+            std::string hi = std::string(1, char(0x7f));
+            auto apply = [&](const Cond& c){
+                switch (c.op) {
+                case Op::LT: hi = std::min(hi, toStd(c.value)); break;
+                case Op::LE: hi = std::min(hi, toStd(c.value)); break;
+                case Op::GT: lo = std::max(lo, toStd(c.value)); break;
+                case Op::GE: lo = std::max(lo, toStd(c.value)); break;
+                case Op::EQ: lo = hi = toStd(c.value); break;
                 default: break;
                 }
-            } else {
-                const Cond& c1 = conds_[idxSecond];
-                std::string lo = "";
-                std::string hi = std::string(1, char(0x7f));
-                auto apply = [&](const Cond& c){
-                    switch (c.op) {
-                    case Op::LT: hi = std::min(hi, toStd(c.value)); break;
-                    case Op::LE: hi = std::min(hi, toStd(c.value)); break;
-                    case Op::GT: lo = std::max(lo, toStd(c.value)); break;
-                    case Op::GE: lo = std::max(lo, toStd(c.value)); break;
-                    case Op::EQ: lo = hi = toStd(c.value); break;
-                    default: break;
-                    }
-                };
-                apply(c0); apply(c1);
-                candidates = table_->rangeByString(fi, lo, hi);
-            }
+            };
+            apply(c0); apply(c1);
+            candidates = table_.rangeByString(fi, lo, hi);
         }
+    }
 
-        std::sort(candidates.begin(), candidates.end(), [](const RID& a, const RID& b){
-            return (a.pageId<b.pageId) || (a.pageId==b.pageId && a.slotId<b.slotId);
-        });
-        candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const RID& a, const RID& b){
-                             return a.pageId==b.pageId && a.slotId==b.slotId;
-                         }), candidates.end());
+    std::sort(candidates.begin(), candidates.end(), [](const RID& a, const RID& b){
+        return (a.pageId<b.pageId) || (a.pageId==b.pageId && a.slotId<b.slotId);
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const RID& a, const RID& b){
+                         return a.pageId==b.pageId && a.slotId==b.slotId;
+                     }), candidates.end());
+    return candidates;
+}
 
-        rows_.reserve(candidates.size());
-        for (const auto& rid : candidates) {
-            auto rec = table_->read(rid);
-            if (!rec) continue;
-            if (matchRecord(*rec)) {
-                ma::Record row = ma::Record::withFieldCount((int)proj_.size());
-                for (int c=0;c<(int)proj_.size();++c) row.values[c] = (*rec).values[proj_[c]];
-                rows_.push_back(std::move(row));
-            }
-        }
+// Index-nested-loop when the inner join column is indexed, otherwise a hash
+// join with the inner table as build side. Rows keep the outer order.
+void QueryModel::Run::openJoin() {
+    const Join& j = *spec_.join;
+    inner_.setBackend(StorageBackend::Mapped);
+    inner_.setReadOnly(true);
+    inner_.open(j.basePath.toStdString());
+    const Schema& is = inner_.getSchema();
+    if (j.innerField < 0 || j.innerField >= (int)is.fields.size())
+        throw std::runtime_error("Join field out of range");
 
-        endResetModel();
-        return true;
-    } catch (const std::exception& ex) {
-        if (err) *err = QString::fromUtf8(ex.what());
-        return false;
+    innerColumns_.assign(is.fields.size(), false);
+    innerColumns_[j.innerField] = true;
+    for (int f : innerProj_)
+        if (f >= 0 && f < (int)is.fields.size()) innerColumns_[f] = true;
+
+    const FieldType kt = is.fields[j.innerField].type;
+    const bool keyed = kt == FieldType::Int32 || kt == FieldType::String || kt == FieldType::CharN;
+    if (keyed && inner_.hasIndex(j.innerField)) {
+        joinMethod_ = JoinMethod::IndexNestedLoop;
+        return;
+    }
+
+    joinMethod_ = JoinMethod::Hash;
+    for (const auto& rid : inner_.scanAll()) {
+        auto in = inner_.read(rid, innerColumns_);
+        if (!in) continue;
+        const auto& k = in->values[j.innerField];
+        if (!k.has_value()) continue;
+        Record row = Record::withFieldCount((int)innerProj_.size());
+        for (int c=0;c<(int)innerProj_.size();++c) row.values[c] = in->values[innerProj_[c]];
+        build_[*k].push_back(std::move(row));
     }
 }
 
-int QueryModel::rowCount(const QModelIndex&) const { return (int)rows_.size(); }
-int QueryModel::columnCount(const QModelIndex&) const { return (int)proj_.size(); }
+void QueryModel::Run::emitRow(const Record& rec) {
+    if (!spec_.join) {
+        addRow(rec, nullptr);
+        return;
+    }
 
-QVariant QueryModel::headerData(int section, Qt::Orientation o, int role) const {
-    if (role != Qt::DisplayRole) return {};
-    if (o == Qt::Horizontal) {
-        int src = proj_.empty() ? section : proj_[section];
-        if (src>=0 && src<(int)schema_.fields.size())
-            return QString::fromStdString(schema_.fields[src].name);
-        return QString("col%1").arg(section+1);
+    const Join& j = *spec_.join;
+    const auto& k = rec.values[j.outerField];
+    if (joinMethod_ == JoinMethod::Hash) {
+        auto it = k.has_value() ? build_.find(*k) : build_.end();
+        if (it == build_.end()) {
+            if (j.keepUnmatched) addRow(rec, nullptr);
+            return;
+        }
+        for (const auto& in : it->second) addRow(rec, &in);
+        return;
     }
-    return section+1;
-}
 
-QVariant QueryModel::data(const QModelIndex& idx, int role) const {
-    if (!idx.isValid() || role!=Qt::DisplayRole) return {};
-    const auto& rec = rows_[idx.row()];
-    const auto& ov = rec.values[idx.column()];
-    if (!ov.has_value()) return {};
-    return valueToQVariant(*ov);
+    const FieldType kt = inner_.getSchema().fields[j.innerField].type;
+    std::vector<RID> rids;
+    if (k.has_value() && kt == FieldType::Int32 && std::holds_alternative<int32_t>(*k))
+        rids = inner_.findByInt32(j.innerField, std::get<int32_t>(*k));
+    else if (k.has_value() && kt != FieldType::Int32 && std::holds_alternative<std::string>(*k))
+        rids = inner_.findByString(j.innerField, std::get<std::string>(*k));
+    bool matched = false;
+    for (const auto& rid : rids) {
+        auto in = inner_.read(rid, innerColumns_);
+        if (!in) continue;
+        Record ip = Record::withFieldCount((int)innerProj_.size());
+        for (int c=0;c<(int)innerProj_.size();++c) ip.values[c] = in->values[innerProj_[c]];
+        addRow(rec, &ip);
+        matched = true;
+    }
+    if (!matched && j.keepUnmatched) addRow(rec, nullptr);
 }
 
-Qt::ItemFlags QueryModel::flags(const QModelIndex& index) const {
-    if (!index.isValid()) return Qt::NoItemFlags;
-    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+// Projects the outer row and, if given, appends the projected inner row.
+void QueryModel::Run::addRow(const Record& o, const Record* in) {
+    const size_t innerCols = spec_.join ? innerProj_.size() : 0;
+    Record row = Record::withFieldCount((int)(proj_.size() + innerCols));
+    for (int c=0;c<(int)proj_.size();++c) row.values[c] = o.values[proj_[c]];
+    if (in) for (size_t c=0;c<innerCols;++c) row.values[proj_.size() + c] = in->values[c];
+    batch_.push_back(std::move(row));
+    if (batch_.size() >= batchTarget_) flush();
 }
 
-QVariant QueryModel::toVariant(const std::optional<Value>& ov) const {
-    if (!ov.has_value()) return {};
-    return valueToQVariant(*ov);
+void QueryModel::Run::flush() {
+    if (batch_.size() < batchTarget_ || stopped_) return;
+    if (!sink_(batch_)) stopped_ = true;
+    batch_.clear();
+    batchTarget_ = BATCH;
 }
 
 static int qCompare(const QVariant& a, const QVariant& b) {
@@ -209,13 +307,12 @@ static int qCompare(const QVariant& a, const QVariant& b) {
     return (r<0?-1:(r>0?1:0));
 }
 
-bool QueryModel::matchOne(const Record& rec, const Cond& c) const {
-    if (c.fieldIndex<0 || c.fieldIndex >= (int)schema_.fields.size()) return false;
-    const auto& ov = rec.values[c.fieldIndex];
-    const QVariant left = toVariant(ov);
-    const QVariant& right = c.value;
-
-    switch (c.op) {
+// The QVariant comparison used before conditions were compiled. It still
+// serves the rare cases the typed tests do not cover and decides what a
+// NULL field yields.
+static bool variantMatch(const QVariant& left, const QVariant& right, QueryModel::Op op) {
+    using Op = QueryModel::Op;
+    switch (op) {
     case Op::EQ:  return qCompare(left, right) == 0;
     case Op::NE:  return qCompare(left, right) != 0;
     case Op::LT:  return qCompare(left, right) < 0;
@@ -229,14 +326,322 @@ bool QueryModel::matchOne(const Record& rec, const Cond& c) const {
     return false;
 }
 
-bool QueryModel::matchRecord(const Record& rec) const {
-    if (conds_.empty()) return true;
-    bool acc = matchOne(rec, conds_[0]);
-    for (size_t i=1;i<conds_.size();++i) {
-        if (conds_[i-1].andWithNext)
-            acc = acc && matchOne(rec, conds_[i]);
-        else
-            acc = acc || matchOne(rec, conds_[i]);
+template<class T>
+static int threeWay(const T& a, const T& b) { return a < b ? -1 : (b < a ? 1 : 0); }
+
+// Binds a three-way comparison to op. Returns an empty test for the
+// substring operators.
+template<class Cmp>
+static std::function<bool(const Value&)> byOp(QueryModel::Op op, Cmp cmp) {
+    using Op = QueryModel::Op;
+    switch (op) {
+    case Op::EQ: return [cmp](const Value& v) { return cmp(v) == 0; };
+    case Op::NE: return [cmp](const Value& v) { return cmp(v) != 0; };
+    case Op::LT: return [cmp](const Value& v) { return cmp(v) <  0; };
+    case Op::LE: return [cmp](const Value& v) { return cmp(v) <= 0; };
+    case Op::GT: return [cmp](const Value& v) { return cmp(v) >  0; };
+    case Op::GE: return [cmp](const Value& v) { return cmp(v) >= 0; };
+    default: return {};
+    }
+}
+
+static inline char foldAscii(char c) { return (c >= 'A' && c <= 'Z') ? char(c | 0x20) : c; }
+
+QueryModel::Run::Test QueryModel::Run::compileTest(const Field& f, const Cond& c) {
+    const Op op = c.op;
+    bool rightIsNumber = false;
+    const double rd = c.value.toDouble(&rightIsNumber);
+    const bool textual = f.type == FieldType::String || f.type == FieldType::CharN;
+    const bool substring = op == Op::CONTAINS || op == Op::STARTS || op == Op::ENDS;
+
+    if (!textual && rightIsNumber && !substring) {
+        switch (f.type) {
+        case FieldType::Int32:
+        case FieldType::Date:
+            return byOp(op, [rd](const Value& v) { return threeWay((double)std::get<int32_t>(v), rd); });
+        case FieldType::Double:
+            return byOp(op, [rd](const Value& v) { return threeWay(std::get<double>(v), rd); });
+        case FieldType::Bool:
+            return byOp(op, [rd](const Value& v) { return threeWay(std::get<bool>(v) ? 1.0 : 0.0, rd); });
+        case FieldType::Currency:
+            return byOp(op, [rd](const Value& v) { return threeWay((double)std::get<int64_t>(v), rd); });
+        default: break;
+        }
+    }
+
+    const std::string rs = c.value.toString().toStdString();
+    if (textual && !substring) {
+        // Numeric text still compares numerically against a numeric operand;
+        // anything else compares bytewise, the order the string index uses.
+        if (rightIsNumber) {
+            return byOp(op, [rd, rs](const Value& v) {
+                const std::string& s = std::get<std::string>(v);
+                bool ok = false;
+                const double x = QByteArray::fromRawData(s.data(), (int)s.size()).toDouble(&ok);
+                return ok ? threeWay(x, rd) : threeWay(s.compare(rs), 0);
+            });
+        }
+        return byOp(op, [rs](const Value& v) { return threeWay(std::get<std::string>(v).compare(rs), 0); });
+    }
+
+    const bool asciiNeedle = std::all_of(rs.begin(), rs.end(), [](char ch) { return (unsigned char)ch < 0x80; });
+    if (textual && asciiNeedle) {
+        std::string needle = rs;
+        for (char& ch : needle) ch = foldAscii(ch);
+        auto eq = [](char a, char b) { return foldAscii(a) == b; };
+        switch (op) {
+        case Op::CONTAINS:
+            return [needle, eq](const Value& v) {
+                const std::string& s = std::get<std::string>(v);
+                return std::search(s.begin(), s.end(), needle.begin(), needle.end(), eq) != s.end();
+            };
+        case Op::STARTS:
+            return [needle, eq](const Value& v) {
+                const std::string& s = std::get<std::string>(v);
+                return s.size() >= needle.size() && std::equal(needle.begin(), needle.end(), s.begin(),
+                                                                [&eq](char n, char h) { return eq(h, n); });
+            };
+        case Op::ENDS:
+            return [needle, eq](const Value& v) {
+                const std::string& s = std::get<std::string>(v);
+                return s.size() >= needle.size() && std::equal(needle.begin(), needle.end(), s.end() - needle.size(),
+                                                                [&eq](char n, char h) { return eq(h, n); });
+            };
+        default: break;
+        }
+    }
+
+    const QVariant right = c.value;
+    return [right, op](const Value& v) { return variantMatch(valueToQVariant(v), right, op); };
+}
+
+void QueryModel::Run::compile() {
+    preds_.clear();
+    preds_.reserve(conds_.size());
+    for (const Cond& c : conds_) {
+        Pred p;
+        p.andWithNext = c.andWithNext;
+        if (c.fieldIndex >= 0 && c.fieldIndex < (int)schema_.fields.size()) {
+            p.field = c.fieldIndex;
+            p.ifNull = variantMatch(QVariant(), c.value, c.op);
+            p.test = compileTest(schema_.fields[c.fieldIndex], c);
+        }
+        preds_.push_back(std::move(p));
+    }
+}
+
+bool QueryModel::Run::matchOne(const Record& rec, const Pred& p) const {
+    if (p.field < 0) return false;
+    const auto& ov = rec.values[p.field];
+    return ov.has_value() ? p.test(*ov) : p.ifNull;
+}
+
+// Conditions fold left to right; a term is skipped once it can no longer
+// change the result (false before AND, true before OR).
+bool QueryModel::Run::matchRecord(const Record& rec) const {
+    if (preds_.empty()) return true;
+    bool acc = matchOne(rec, preds_[0]);
+    for (size_t i=1;i<preds_.size();++i) {
+        if (preds_[i-1].andWithNext ? !acc : acc) continue;
+        acc = matchOne(rec, preds_[i]);
     }
     return acc;
 }
+
+QueryModel::QueryModel(QObject* parent) : QAbstractTableModel(parent) {}
+
+QueryModel::~QueryModel() {
+    cancel();
+}
+
+// Clears the rows and sets up the result columns for s. Returns the
+// condition answered through an index (-1 for a full scan), creating that
+// index here on the calling thread so a worker only ever reads.
+int QueryModel::prepare(const Spec& s) {
+    rows_.clear();
+    proj_.clear();
+    innerProj_.clear();
+    innerName_.clear();
+    innerSchema_ = Schema{};
+    joinMethod_ = JoinMethod::None;
+
+    Table table;
+    table.setBackend(StorageBackend::Mapped);
+    table.open(s.basePath.toStdString());
+    schema_ = table.getSchema();
+
+    if (s.columns.empty()) {
+        proj_.resize((int)schema_.fields.size());
+        for (int i=0;i<(int)schema_.fields.size();++i) proj_[i] = i;
+    } else {
+        proj_ = s.columns;
+    }
+
+    if (s.join) {
+        const Join& j = *s.join;
+        innerSchema_ = Table::readSchema(j.basePath.toStdString());
+        innerName_ = QFileInfo(j.basePath).fileName();
+        if (j.outerField < 0 || j.outerField >= (int)schema_.fields.size() ||
+            j.innerField < 0 || j.innerField >= (int)innerSchema_.fields.size())
+            throw std::runtime_error("Join field out of range");
+        if (j.columns.empty()) {
+            innerProj_.resize(innerSchema_.fields.size());
+            for (int i=0;i<(int)innerSchema_.fields.size();++i) innerProj_[i] = i;
+        } else {
+            innerProj_ = j.columns;
+        }
+    }
+
+    auto isIndexableOp = [](Op op)->bool {
+        switch (op) { case Op::EQ: case Op::LT: case Op::LE: case Op::GT: case Op::GE: return true; default: return false; }
+    };
+    // Prefer a condition on a column that is already indexed (equality first),
+    // otherwise index the first indexable column.
+    const auto& conds = s.conds;
+    int idxCond = -1;
+    int idxRank = 0;
+    for (int i=0;i<(int)conds.size();++i) {
+        if (conds[i].fieldIndex>=0 && conds[i].fieldIndex<(int)schema_.fields.size() && isIndexableOp(conds[i].op)) {
+            const auto& f = schema_.fields[conds[i].fieldIndex];
+            if (f.type != FieldType::Int32 && f.type != FieldType::String && f.type != FieldType::CharN) continue;
+            int rank = 1;
+            if (table.hasIndex(conds[i].fieldIndex)) rank = (conds[i].op == Op::EQ) ? 3 : 2;
+            if (rank > idxRank) { idxCond = i; idxRank = rank; }
+        }
+    }
+
+    if (idxCond != -1) {
+        const int fi = conds[idxCond].fieldIndex;
+        const auto& fld = schema_.fields[fi];
+        if (fld.type == FieldType::Int32) table.createInt32Index(fi, "idx_" + fld.name);
+        else table.createStringIndex(fi, "idx_" + fld.name);
+    }
+    table.close();
+    return idxCond;
+}
+
+bool QueryModel::run(const Spec& s, QString* err) {
+    cancel();
+    beginResetModel();
+    try {
+        if (s.basePath.isEmpty()) {
+            rows_.clear();
+            proj_.clear();
+            innerProj_.clear();
+            schema_ = Schema{};
+            endResetModel();
+            return true;
+        }
+        const int idxCond = prepare(s);
+        Run r(s, proj_, innerProj_, idxCond, [this](std::vector<Record>& batch) {
+            std::move(batch.begin(), batch.end(), std::back_inserter(rows_));
+            return true;
+        });
+        joinMethod_ = r.execute();
+        endResetModel();
+        return true;
+    } catch (const std::exception& ex) {
+        rows_.clear();
+        endResetModel();
+        if (err) *err = QString::fromUtf8(ex.what());
+        return false;
+    }
+}
+
+void QueryModel::start(const Spec& s) {
+    cancel();
+    beginResetModel();
+    int idxCond = -1;
+    try {
+        idxCond = prepare(s);
+    } catch (const std::exception& ex) {
+        rows_.clear();
+        endResetModel();
+        emit finished(false, QString::fromUtf8(ex.what()));
+        return;
+    }
+    endResetModel();
+
+    auto job = std::make_shared<Job>();
+    job_ = job;
+    QThread* t = QThread::create([this, job, s, proj = proj_, innerProj = innerProj_, idxCond] {
+        bool ok = true;
+        QString err;
+        JoinMethod jm = JoinMethod::None;
+        try {
+            Run r(s, proj, innerProj, idxCond, [this, job](std::vector<Record>& batch) {
+                if (job->cancel) return false;
+                auto rows = std::make_shared<std::vector<Record>>(std::move(batch));
+                QMetaObject::invokeMethod(this, [this, job, rows] { appendRows(job, *rows); },
+                                          Qt::QueuedConnection);
+                return true;
+            });
+            jm = r.execute();
+        } catch (const std::exception& ex) {
+            ok = false;
+            err = QString::fromUtf8(ex.what());
+        }
+        if (job->cancel) return;
+        QMetaObject::invokeMethod(this, [this, job, ok, err, jm] { endJob(job, ok, err, jm); },
+                                  Qt::QueuedConnection);
+    });
+    connect(t, &QThread::finished, t, &QObject::deleteLater);
+    worker_ = t;
+    t->start();
+}
+
+void QueryModel::cancel() {
+    if (job_) job_->cancel = true;
+    if (worker_) worker_->wait();
+    job_.reset();
+}
+
+void QueryModel::appendRows(const std::shared_ptr<Job>& job, std::vector<Record>& rows) {
+    if (job != job_ || rows.empty()) return;
+    const int first = (int)rows_.size();
+    beginInsertRows(QModelIndex(), first, first + (int)rows.size() - 1);
+    std::move(rows.begin(), rows.end(), std::back_inserter(rows_));
+    endInsertRows();
+    emit progress((int)rows_.size());
+}
+
+void QueryModel::endJob(const std::shared_ptr<Job>& job, bool ok, const QString& err, JoinMethod jm) {
+    if (job != job_) return;
+    job_.reset();
+    joinMethod_ = jm;
+    emit finished(ok, err);
+}
+
+int QueryModel::rowCount(const QModelIndex&) const { return (int)rows_.size(); }
+int QueryModel::columnCount(const QModelIndex&) const { return (int)(proj_.size() + innerProj_.size()); }
+
+QVariant QueryModel::headerData(int section, Qt::Orientation o, int role) const {
+    if (role != Qt::DisplayRole) return {};
+    if (o == Qt::Horizontal && section >= (int)proj_.size()) {
+        const int c = section - (int)proj_.size();
+        if (c < (int)innerProj_.size() && innerProj_[c] >= 0 && innerProj_[c] < (int)innerSchema_.fields.size())
+            return innerName_ + "." + QString::fromStdString(innerSchema_.fields[innerProj_[c]].name);
+        return QString("col%1").arg(section+1);
+    }
+    if (o == Qt::Horizontal) {
+        int src = proj_.empty() ? section : proj_[section];
+        if (src>=0 && src<(int)schema_.fields.size())
+            return QString::fromStdString(schema_.fields[src].name);
+        return QString("col%1").arg(section+1);
+    }
+    return section+1;
+}
+
+QVariant QueryModel::data(const QModelIndex& idx, int role) const {
+    if (!idx.isValid() || role!=Qt::DisplayRole) return {};
+    const auto& rec = rows_[idx.row()];
+    const auto& ov = rec.values[idx.column()];
+    if (!ov.has_value()) return {};
+    return valueToQVariant(*ov);
+}
+
+Qt::ItemFlags QueryModel::flags(const QModelIndex& index) const {
+    if (!index.isValid()) return Qt::NoItemFlags;
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
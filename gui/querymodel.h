@@ -2,9 +2,12 @@
 #include <QAbstractTableModel>
 #include <QVariant>
 #include <QString>
+#include <QPointer>
+#include <QThread>
 #include <vector>
 #include <optional>
 #include <memory>
+#include <atomic>
 #include "../core/Schema.h"
 #include "../core/Table.h"
 
@@ -21,16 +24,37 @@ public:
         bool andWithNext = true;
     };
 
+    // Join of the Spec table (outer) with a second table on outerField = innerField.
+    struct Join {
+        QString basePath;
+        int outerField = -1;
+        int innerField = -1;
+        bool keepUnmatched = false;   // LEFT join: outer rows without a match get empty inner columns
+        std::vector<int> columns;     // inner columns appended to the result; empty = all
+    };
+
     struct Spec {
         QString basePath;
         std::vector<int> columns;
         std::vector<Cond> conds;
+        std::optional<Join> join;
     };
 
+    enum class JoinMethod { None, IndexNestedLoop, Hash };
+
     explicit QueryModel(QObject* parent=nullptr);
+    ~QueryModel() override;
 
+    // Evaluates the query on the calling thread. An empty basePath clears the model.
     bool run(const Spec& s, QString* err=nullptr);
 
+    // Evaluates the query on a worker thread. Matching rows are appended in
+    // chunks as they are found and finished() reports the outcome. Starting
+    // another query, or calling run(), cancels one still in flight.
+    void start(const Spec& s);
+    void cancel();
+    bool isRunning() const { return job_ != nullptr; }
+
     // QAbstractTableModel
     int rowCount(const QModelIndex& = QModelIndex()) const override;
     int columnCount(const QModelIndex& = QModelIndex()) const override;
@@ -39,17 +63,33 @@ public:
     Qt::ItemFlags flags(const QModelIndex& index) const override;
 
     const ma::Schema& schema() const { return schema_; }
+    JoinMethod lastJoinMethod() const { return joinMethod_; }
+
+signals:
+    void progress(int rows);
+    void finished(bool ok, const QString& error);
 
 private:
-    QVariant toVariant(const std::optional<ma::Value>& ov) const;
-    bool     matchRecord(const ma::Record& rec) const;
-    bool     matchOne(const ma::Record& rec, const Cond& c) const;
+    class Run; // one evaluation of a Spec; owns its own Table handles
+
+    struct Job {
+        std::atomic<bool> cancel{false};
+    };
+
+    int  prepare(const Spec& s);
+    void appendRows(const std::shared_ptr<Job>& job, std::vector<ma::Record>& rows);
+    void endJob(const std::shared_ptr<Job>& job, bool ok, const QString& err, JoinMethod jm);
 
 private:
-    std::unique_ptr<ma::Table> table_;
     ma::Schema schema_;
     std::vector<int> proj_;
-    std::vector<Cond> conds_;
-    std::vector<ma::RID> rids_;
     std::vector<ma::Record> rows_;
+
+    ma::Schema innerSchema_;
+    std::vector<int> innerProj_;
+    QString innerName_;
+    JoinMethod joinMethod_ = JoinMethod::None;
+
+    std::shared_ptr<Job> job_;
+    QPointer<QThread> worker_;
 };
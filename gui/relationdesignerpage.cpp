@@ -1373,10 +1373,8 @@ bool RelationDesignerPage::ensureJunctionTable(const QString& lt, const QString&
 
     ma::Schema sL, sR;
     try {
-        ma::Table tL; tL.open(basePathForTableName(projectDir_, lt).toStdString());
-        sL = tL.getSchema();
-        ma::Table tR; tR.open(basePathForTableName(projectDir_, rt).toStdString());
-        sR = tR.getSchema();
+        sL = ma::Table::readSchema(basePathForTableName(projectDir_, lt).toStdString());
+        sR = ma::Table::readSchema(basePathForTableName(projectDir_, rt).toStdString());
     } catch (...) {
         return false;
     }
@@ -137,8 +137,7 @@ QString ReportQuickDialog::baseForTable(const QString& projectDir, const QString
 bool ReportQuickDialog::readSchema(const QString& tableName, QVector<ColInfo>& cols) {
     cols.clear();
     try {
-        Table t; t.open(baseForTable(projectDir_, tableName).toStdString());
-        const Schema s = t.getSchema();
+        const Schema s = Table::readSchema(baseForTable(projectDir_, tableName).toStdString());
         int idx = 0;
         for (const auto& f : s.fields) {
             ColInfo ci;
@@ -180,7 +179,9 @@ bool ReportQuickDialog::readAllRows(const QString& tableName,
     outRows.clear();
     totalRows = 0;
     try {
-        Table t; t.open(baseForTable(projectDir_, tableName).toStdString());
+        Table t;
+        t.setBackend(StorageBackend::Mapped);
+        t.open(baseForTable(projectDir_, tableName).toStdString());
         const auto rids = t.scanAll();
         totalRows = static_cast<qsizetype>(rids.size());
         outRows.reserve(static_cast<int>(rids.size()));
@@ -19,6 +19,7 @@
 #include <QJsonArray>
 #include <QFileInfo>
 #include <QDir>
+#include <QThread>
 
 using namespace ma;
 
@@ -128,15 +129,14 @@ static bool valueExistsInParent(const QString& basePathOfThis,
     try {
         const QString pd    = projectDirFromBase(basePathOfThis);
         const QString pbase = basePathForTableName(pd, rel.parentName);
-        ma::Table pt; pt.open(pbase.toStdString());
+        ma::Table pt;
+        pt.setBackend(ma::StorageBackend::Mapped);
+        pt.setReadOnly(true);
+        pt.open(pbase.toStdString());
         const auto ps = pt.getSchema();
         const int col = fieldIndexByName(ps, rel.parentField);
         if (col < 0) return false;
-        for (const auto& rid : pt.scanAll()) {
-            auto rec = pt.read(rid);
-            if (rec && valuesEqual(rec->values[col], fkVal)) return true;
-        }
-        return false;
+        return pt.containsValue(col, fkVal);
     } catch (...) { return false; }
 }
 
@@ -150,13 +150,7 @@ static void cascadeDeleteChildren(const QString& basePathOfThis,
         const auto cs = ct.getSchema();
         const int col = fieldIndexByName(cs, rel.childField);
         if (col < 0) return;
-        auto rids = ct.scanAll();
-        for (auto it = rids.rbegin(); it != rids.rend(); ++it) {
-            auto rec = ct.read(*it);
-            if (rec && valuesEqual(rec->values[col], parentKeyVal)) {
-                ct.erase(*it);
-            }
-        }
+        for (const auto& rid : ct.findEqual(col, parentKeyVal)) ct.erase(rid);
         ct.close();
     } catch (...) {}
 }
@@ -172,13 +166,11 @@ static void cascadeUpdateChildren(const QString& basePathOfThis,
         const auto cs = ct.getSchema();
         const int col = fieldIndexByName(cs, rel.childField);
         if (col < 0) return;
-        auto rids = ct.scanAll();
-        for (const auto& rid : rids) {
+        for (const auto& rid : ct.findEqual(col, oldParentKey)) {
             auto rec = ct.read(rid);
-            if (rec && valuesEqual(rec->values[col], oldParentKey)) {
-                rec->values[col] = newParentKey;
-                ct.update(rid, *rec);
-            }
+            if (!rec) continue;
+            rec->values[col] = newParentKey;
+            ct.update(rid, *rec);
         }
         ct.close();
     } catch (...) {}
@@ -192,6 +184,10 @@ static QString relationsPathForProject(const QString& basePath) {
     return QDir(projectDirFromBase(basePath)).filePath("relations.json");
 }
 
+static inline quint64 packRid(uint32_t p, uint16_t s) {
+    return (static_cast<quint64>(p) << 16) | s;
+}
+
 static inline void setUtf8(QTextStream& ts) {
     #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
         ts.setEncoding(QStringConverter::Utf8);
@@ -220,15 +216,14 @@ static inline QString boolLabel(bool v, uint16_t fmt) {
     }
 }
 
-static bool columnValueWouldBeUnique(const std::vector<ma::Record>& cache, int col,
-                                     const std::optional<ma::Value>& candidate, int skipRow)
+static bool columnValueWouldBeUnique(ma::Table& table, int col,
+                                     const std::optional<ma::Value>& candidate,
+                                     const std::optional<ma::RID>& self)
 {
     if (!candidate.has_value()) return false;
-    for (int r=0; r<(int)cache.size(); ++r) {
-        if (r == skipRow) continue;
-        if (valuesEqual(cache[r].values[col], candidate)) return false;
-    }
-    return true;
+    ma::Record probe = ma::Record::withFieldCount(table.getSchema().fields.size());
+    probe.values[col] = candidate;
+    return table.keyIsFree({col}, probe, self);
 }
 
 static bool detectJunctionForThisTable(const QString& basePath, QString& fkAField, QString& fkBField) {
@@ -245,40 +240,145 @@ static bool detectJunctionForThisTable(const QString& basePath, QString& fkAFiel
     return false;
 }
 
-static bool pairExistsInCache(const std::vector<ma::Record>& cache,
-                              int colA, const std::optional<ma::Value>& aVal,
-                              int colB, const std::optional<ma::Value>& bVal,
-                              int skipRow)
+static bool pairExists(ma::Table& table,
+                       int colA, const std::optional<ma::Value>& aVal,
+                       int colB, const std::optional<ma::Value>& bVal,
+                       const std::optional<ma::RID>& self)
 {
     if (!aVal.has_value() || !bVal.has_value()) return false;
-    for (int r=0; r<(int)cache.size(); ++r) {
-        if (r == skipRow) continue;
-        if (valuesEqual(cache[r].values[colA], aVal) &&
-            valuesEqual(cache[r].values[colB], bVal)) {
-            return true;
-        }
-    }
-    return false;
+    ma::Record probe = ma::Record::withFieldCount(table.getSchema().fields.size());
+    probe.values[colA] = aVal;
+    probe.values[colB] = bVal;
+    return !table.keyIsFree({colA, colB}, probe, self);
 }
 
+static const char* const kPkConstraint = "pk";
+static const char* const kJunctionConstraint = "junction";
+
 TableModel::TableModel(Table* table, QObject* parent)
     : TableModel(table, QString(), parent) {}
 
 TableModel::TableModel(Table* table, const QString& basePath, QObject* parent)
     : QAbstractTableModel(parent), table_(table), schema_(table->getSchema()), basePath_(basePath)
 {
-    std::vector<ma::RID> scanned = table_->scanAll();
-    rids_ = mergeWithOrder(scanned);
-    rebuildCacheFromRids();
+    if (basePath_.isEmpty()) rids_ = table_->scanAll();
+    else startLoad(false);
+
+    if (!basePath_.isEmpty()) {
+        QString fkA, fkB;
+        if (detectJunctionForThisTable(basePath_, fkA, fkB)) {
+            const int colA = fieldIndexByName(schema_, fkA);
+            const int colB = fieldIndexByName(schema_, fkB);
+            if (colA >= 0 && colB >= 0) table_->addUniqueConstraint(kJunctionConstraint, {colA, colB});
+        }
+    }
+}
+
+TableModel::~TableModel() {
+    cancelLoad();
 }
 
 void TableModel::reload() {
+    cancelLoad();
     beginResetModel();
-    std::vector<ma::RID> scanned = table_->scanAll();
-    rids_ = mergeWithOrder(scanned);
-    rebuildCacheFromRids();
+    rids_.clear();
+    dropWindows();
+    if (basePath_.isEmpty()) rids_ = table_->scanAll();
     endResetModel();
-    saveOrder();
+    if (!basePath_.isEmpty()) startLoad(true);
+}
+
+void TableModel::cancelLoad() {
+    if (job_) job_->cancel = true;
+    if (loader_) loader_->wait();
+    job_.reset();
+}
+
+// The worker reads through its own handle: rows named in the .ord file that
+// still exist come first, in that order, then every other row in page order,
+// the same order mergeWithOrder() produces. The first chunk is kept small
+// so the view fills right away.
+void TableModel::startLoad(bool saveWhenDone) {
+    auto job = std::make_shared<LoadJob>();
+    job->saveOrder = saveWhenDone;
+    job_ = job;
+    const std::string base = basePath_.toStdString();
+    const QString ordPath = orderFilePath();
+
+    QThread* t = QThread::create([this, job, base, ordPath] {
+        constexpr size_t FIRST_CHUNK = 256;
+        constexpr size_t CHUNK = 8192;
+        constexpr uint32_t PAGES_PER_STEP = 64;
+        std::vector<ma::RID> chunk;
+        size_t target = FIRST_CHUNK;
+        auto post = [&] {
+            auto batch = std::make_shared<std::vector<ma::RID>>(std::move(chunk));
+            chunk.clear();
+            target = CHUNK;
+            QMetaObject::invokeMethod(this, [this, job, batch] { appendLoaded(job, *batch); },
+                                      Qt::QueuedConnection);
+        };
+
+        bool ok = true;
+        try {
+            ma::Table reader;
+            reader.setBackend(ma::StorageBackend::Mapped);
+            reader.setReadOnly(true);
+            reader.open(base);
+
+            const auto ord = loadOrder(ordPath);
+            std::unordered_set<quint64> emitted;
+            emitted.reserve(ord.size());
+            for (const auto& r : ord) {
+                if (job->cancel) return;
+                if (!reader.exists(r) || !emitted.insert(packRid(r.pageId, r.slotId)).second) continue;
+                chunk.push_back(r);
+                if (chunk.size() >= target) post();
+            }
+            for (uint32_t pid = 1; pid < reader.pageCount(); pid += PAGES_PER_STEP) {
+                if (job->cancel) return;
+                for (const auto& r : reader.scanPages(pid, PAGES_PER_STEP)) {
+                    if (!emitted.empty() && emitted.count(packRid(r.pageId, r.slotId))) continue;
+                    chunk.push_back(r);
+                }
+                if (chunk.size() >= target) post();
+            }
+            reader.close();
+        } catch (...) {
+            ok = false;
+        }
+        if (!chunk.empty()) post();
+        QMetaObject::invokeMethod(this, [this, job, ok] { finishLoad(job, ok); }, Qt::QueuedConnection);
+    });
+    connect(t, &QThread::finished, t, &QObject::deleteLater);
+    loader_ = t;
+    t->start();
+}
+
+void TableModel::appendLoaded(const std::shared_ptr<LoadJob>& job, std::vector<ma::RID>& chunk) {
+    if (job != job_ || chunk.empty()) return;
+    const int first = static_cast<int>(rids_.size());
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(chunk.size()) - 1);
+    rids_.insert(rids_.end(), chunk.begin(), chunk.end());
+    // Chunks do not end on window boundaries; a window cached short of the
+    // old end would not cover the rows just appended to it.
+    if (first % WINDOW_ROWS) windows_.erase(first / WINDOW_ROWS);
+    endInsertRows();
+    emit loadProgress(static_cast<int>(rids_.size()));
+}
+
+void TableModel::finishLoad(const std::shared_ptr<LoadJob>& job, bool ok) {
+    if (job != job_) return;
+    job_.reset();
+    if (!ok) {
+        // The worker could not read the file; fall back to this thread's handle.
+        beginResetModel();
+        rids_ = mergeWithOrder(table_->scanAll());
+        dropWindows();
+        endResetModel();
+    }
+    if (job->saveOrder) saveOrder();
+    emit loadFinished();
 }
 
 int TableModel::rowCount(const QModelIndex&) const { return (int)rids_.size(); }
@@ -397,11 +497,11 @@ QVariant TableModel::data(const QModelIndex& idx, int role) const {
 
     const int row = idx.row();
     const int col = idx.column();
-    if (row < 0 || row >= static_cast<int>(cache_.size())) return {};
+    if (row < 0 || row >= static_cast<int>(rids_.size())) return {};
     if (col < 0 || col >= static_cast<int>(schema_.fields.size())) return {};
 
     const auto& f = schema_.fields[col];
-    const auto& opt = cache_[row].values[col];
+    const auto& opt = recordAt(row).values[col];
 
     if (f.type == ma::FieldType::Bool) {
         if (role == Qt::CheckStateRole) {
@@ -558,7 +658,7 @@ static bool coerceValueForField(const ma::Field& f, const QVariant& in, ma::Valu
 }
 
 bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
-    if (!idx.isValid() || !table_) return false;
+    if (!idx.isValid() || !table_ || isLoading()) return false;
 
     const int row = idx.row();
     const int col = idx.column();
@@ -567,17 +667,19 @@ bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
     if (f.type == ma::FieldType::Bool && role == Qt::CheckStateRole) {
         const bool newB = (v.toInt() == Qt::Checked);
 
-        ma::Record rec = cache_[row];
+        ma::Record rec = recordAt(row);
         rec.values[col] = newB;
 
-        auto maybeNewRid = table_->update(rids_[row], rec);
+        std::optional<ma::RID> maybeNewRid;
+        try { maybeNewRid = table_->update(rids_[row], col, rec.values[col]); } catch (...) { return false; }
         if (!maybeNewRid) return false;
 
-        rids_[row]  = *maybeNewRid;
-        cache_[row] = rec;
+        const bool moved = packRid(maybeNewRid->pageId, maybeNewRid->slotId) != packRid(rids_[row].pageId, rids_[row].slotId);
+        rids_[row] = *maybeNewRid;
+        storeRecord(row, rec);
 
         emit dataChanged(idx, idx, {Qt::CheckStateRole, Qt::DisplayRole});
-        saveOrder();
+        if (moved) saveOrder();
         return true;
     }
 
@@ -621,7 +723,7 @@ bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
                 }
                 const QString t = rel.relType.isEmpty() ? "1:N" : rel.relType;
                 if (t == "1:1") {
-                    if (!columnValueWouldBeUnique(cache_, fkCol, std::optional<ma::Value>(newVal), row)) {
+                    if (!columnValueWouldBeUnique(*table_, fkCol, std::optional<ma::Value>(newVal), rids_[row])) {
                         return false;
                     }
                 }
@@ -635,12 +737,13 @@ bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
             const int colA = fieldIndexByName(schema_, fkA);
             const int colB = fieldIndexByName(schema_, fkB);
             if (colA >= 0 && colB >= 0) {
-                std::optional<ma::Value> aVal = cache_[row].values[colA];
-                std::optional<ma::Value> bVal = cache_[row].values[colB];
+                const ma::Record& cur = recordAt(row);
+                std::optional<ma::Value> aVal = cur.values[colA];
+                std::optional<ma::Value> bVal = cur.values[colB];
                 if (col == colA) aVal = std::optional<ma::Value>(newVal);
                 if (col == colB) bVal = std::optional<ma::Value>(newVal);
                 if (aVal.has_value() && bVal.has_value()) {
-                    if (pairExistsInCache(cache_, colA, aVal, colB, bVal, row)) {
+                    if (pairExists(*table_, colA, aVal, colB, bVal, rids_[row])) {
                         return false;
                     }
                 }
@@ -679,17 +782,18 @@ bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
         }
     }
 
-    ma::Record rec = cache_[row];
+    ma::Record rec = recordAt(row);
+    std::optional<ma::Value> oldPkVal = (pkCol >= 0) ? rec.values[pkCol] : std::optional<ma::Value>();
     if (setNull) rec.values[col].reset();
     else         rec.values[col] = newVal;
 
-    std::optional<ma::Value> oldPkVal = (pkCol >= 0) ? cache_[row].values[pkCol] : std::optional<ma::Value>();
-
-    auto maybeNewRid = table_->update(rids_[row], rec);
+    std::optional<ma::RID> maybeNewRid;
+    try { maybeNewRid = table_->update(rids_[row], col, rec.values[col]); } catch (...) { return false; }
     if (!maybeNewRid) return false;
 
-    rids_[row]  = *maybeNewRid;
-    cache_[row] = rec;
+    const bool moved = packRid(maybeNewRid->pageId, maybeNewRid->slotId) != packRid(rids_[row].pageId, rids_[row].slotId);
+    rids_[row] = *maybeNewRid;
+    storeRecord(row, rec);
 
     if (editingPK && oldPkVal.has_value()) {
         for (const auto& rel : relationsWhereBaseIsParent(basePath_)) {
@@ -701,22 +805,20 @@ bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
                     try {
                         const QString pd    = projectDirFromBase(basePath_);
                         const QString cbase = basePathForTableName(pd, rel.childName);
-                        ma::Table ct; ct.open(cbase.toStdString());
+                        ma::Table ct;
+                        ct.setBackend(ma::StorageBackend::Mapped);
+                        ct.setReadOnly(true);
+                        ct.open(cbase.toStdString());
                         const int cCol = fieldIndexByName(ct.getSchema(), rel.childField);
-                        for (const auto& crid : ct.scanAll()) {
-                            auto childRec = ct.read(crid);
-                            if (childRec && valuesEqual(childRec->values[cCol], oldPkVal)) {
-                                hasChild = true; break;
-                            }
-                        }
+                        hasChild = cCol >= 0 && ct.containsValue(cCol, *oldPkVal);
                         ct.close();
                     } catch (...) {}
 
                     if (hasChild) {
-                        ma::Record revert = cache_[row];
+                        ma::Record revert = rec;
                         revert.values[pkCol] = oldPkVal;
                         table_->update(rids_[row], revert);
-                        cache_[row] = revert;
+                        storeRecord(row, revert);
                         emit dataChanged(idx, idx, {Qt::DisplayRole, Qt::EditRole});
                         return false;
                     }
@@ -726,18 +828,21 @@ bool TableModel::setData(const QModelIndex& idx, const QVariant& v, int role) {
     }
 
     emit dataChanged(idx, idx, {Qt::DisplayRole, Qt::EditRole});
-    saveOrder();
+    if (moved) saveOrder();
     return true;
 }
 
 bool TableModel::insertRows(int row, int count, const QModelIndex& parent) {
     Q_UNUSED(parent);
-    if (!table_ || count <= 0) return false;
+    if (!table_ || count <= 0 || isLoading()) return false;
 
-    const int insertPos = (row < 0 || row > (int)cache_.size()) ? (int)cache_.size() : row;
+    const int insertPos = (row < 0 || row > (int)rids_.size()) ? (int)rids_.size() : row;
 
     beginInsertRows(QModelIndex(), insertPos, insertPos + count - 1);
 
+    const ma::Durability prevDurability = table_->durability();
+    table_->setDurability(ma::Durability::FlushOnCommit);
+
     bool okAll = true;
     for (int i = 0; i < count; ++i) {
         ma::Record rec;
@@ -760,7 +865,7 @@ bool TableModel::insertRows(int row, int count, const QModelIndex& parent) {
             if (rec.values[fkCol].has_value()) {
                 if (rel.enforceRI && !valueExistsInParent(basePath_, rel, *rec.values[fkCol])) { okAll = false; break; }
                 if (t == "1:1") {
-                    if (!columnValueWouldBeUnique(cache_, fkCol, rec.values[fkCol], -1)) { okAll = false; break; }
+                    if (!columnValueWouldBeUnique(*table_, fkCol, rec.values[fkCol], std::nullopt)) { okAll = false; break; }
                 }
             }
         }
@@ -775,7 +880,7 @@ bool TableModel::insertRows(int row, int count, const QModelIndex& parent) {
                     const auto& aVal = rec.values[colA];
                     const auto& bVal = rec.values[colB];
                     if (aVal.has_value() && bVal.has_value()) {
-                        if (pairExistsInCache(cache_, colA, aVal, colB, bVal, -1)) { okAll = false; }
+                        if (pairExists(*table_, colA, aVal, colB, bVal, std::nullopt)) { okAll = false; }
                     }
                 }
             }
@@ -792,8 +897,15 @@ bool TableModel::insertRows(int row, int count, const QModelIndex& parent) {
 
         const int finalPos = insertPos + i;
         rids_.insert(rids_.begin() + finalPos, rid);
-        cache_.insert(cache_.begin() + finalPos, rec);
     }
+    dropWindows();
+
+    try {
+        table_->flush();
+    } catch (...) {
+        okAll = false;
+    }
+    table_->setDurability(prevDurability);
 
     endInsertRows();
 
@@ -808,33 +920,32 @@ bool TableModel::insertRows(int row, int count, const QModelIndex& parent) {
 
 bool TableModel::removeRows(int row, int count, const QModelIndex& parent) {
     Q_UNUSED(parent);
-    if (!table_ || count <= 0) return false;
-    if (row < 0 || row + count > (int)cache_.size()) return false;
+    if (!table_ || count <= 0 || isLoading()) return false;
+    if (row < 0 || row + count > (int)rids_.size()) return false;
 
-    for (int i = 0; i < count; ++i) {
-        const int r = row + i;
+    std::vector<ma::Record> doomed;
+    doomed.reserve(count);
+    for (int i = 0; i < count; ++i) doomed.push_back(recordAt(row + i));
 
+    for (int i = 0; i < count; ++i) {
         for (const auto& rel : relationsWhereBaseIsParent(basePath_)) {
             const QString pkName = loadPrimaryKeyNameForBase(basePath_);
             if (pkName.isEmpty()) continue;
             if (rel.parentField.compare(pkName, Qt::CaseInsensitive) != 0) continue;
 
-            const auto& pkValOpt = cache_[r].values[fieldIndexByName(schema_, pkName)];
+            const auto& pkValOpt = doomed[i].values[fieldIndexByName(schema_, pkName)];
             if (!pkValOpt.has_value()) continue;
 
             bool hasChild = false;
             try {
                 const QString pd    = projectDirFromBase(basePath_);
                 const QString cbase = basePathForTableName(pd, rel.childName);
-                ma::Table ct; ct.open(cbase.toStdString());
+                ma::Table ct;
+                ct.setBackend(ma::StorageBackend::Mapped);
+                ct.setReadOnly(true);
+                ct.open(cbase.toStdString());
                 const int cCol = fieldIndexByName(ct.getSchema(), rel.childField);
-
-                for (const auto& crid : ct.scanAll()) {
-                    auto childRec = ct.read(crid);
-                    if (childRec && valuesEqual(childRec->values[cCol], pkValOpt)) {
-                        hasChild = true; break;
-                    }
-                }
+                hasChild = cCol >= 0 && ct.containsValue(cCol, *pkValOpt);
                 ct.close();
             } catch (...) {}
 
@@ -851,7 +962,7 @@ bool TableModel::removeRows(int row, int count, const QModelIndex& parent) {
 
         const QString pkName = loadPrimaryKeyNameForBase(basePath_);
         std::optional<ma::Value> pkVal = (pkName.isEmpty()) ? std::optional<ma::Value>()
-                                                            : cache_[r].values[fieldIndexByName(schema_, pkName)];
+                                                            : doomed[i].values[fieldIndexByName(schema_, pkName)];
 
         if (pkVal.has_value()) {
             for (const auto& rel : relationsWhereBaseIsParent(basePath_)) {
@@ -865,8 +976,8 @@ bool TableModel::removeRows(int row, int count, const QModelIndex& parent) {
         table_->erase(rids_[r]);
 
         rids_.erase(rids_.begin() + r);
-        cache_.erase(cache_.begin() + r);
     }
+    dropWindows();
 
     endRemoveRows();
     saveOrder();
@@ -892,9 +1003,8 @@ QString TableModel::orderFilePath() const {
     return basePath_.isEmpty() ? QString() : (basePath_ + ".ord");
 }
 
-std::vector<ma::RID> TableModel::loadOrder() const {
+std::vector<ma::RID> TableModel::loadOrder(const QString& fn) {
     std::vector<ma::RID> out;
-    const QString fn = orderFilePath();
     if (fn.isEmpty() || !QFile::exists(fn)) return out;
 
     QFile f(fn);
@@ -933,10 +1043,6 @@ void TableModel::saveOrder() const {
     }
 }
 
-static inline quint64 packRid(uint32_t p, uint16_t s) {
-    return (static_cast<quint64>(p) << 16) | s;
-}
-
 std::vector<ma::RID> TableModel::mergeWithOrder(const std::vector<ma::RID>& scanned) const {
     if (basePath_.isEmpty()) return scanned;
 
@@ -945,7 +1051,7 @@ std::vector<ma::RID> TableModel::mergeWithOrder(const std::vector<ma::RID>& scan
     for (const auto& r : scanned) present.insert(packRid(r.pageId, r.slotId));
 
     std::vector<ma::RID> out;
-    auto ord = loadOrder();
+    auto ord = loadOrder(orderFilePath());
     out.reserve(scanned.size());
     std::unordered_set<quint64> emitted;
     emitted.reserve(scanned.size());
@@ -962,13 +1068,60 @@ std::vector<ma::RID> TableModel::mergeWithOrder(const std::vector<ma::RID>& scan
     return out;
 }
 
-void TableModel::rebuildCacheFromRids() {
-    cache_.clear();
-    cache_.reserve(rids_.size());
-    for (const auto& rid : rids_) {
-        auto rec = table_->read(rid);
-        cache_.push_back(rec.value_or(Record::withFieldCount((int)schema_.fields.size())));
+const ma::Record& TableModel::recordAt(int row) const {
+    const int w = row / WINDOW_ROWS;
+    // Read ahead into the neighbouring window once the view nears its edge.
+    const int inWindow = row % WINDOW_ROWS;
+    const int neighbour = inWindow >= WINDOW_ROWS * 3 / 4 ? w + 1
+                        : inWindow < WINDOW_ROWS / 4 ? w - 1 : -1;
+    if (neighbour >= 0 && static_cast<size_t>(neighbour) * WINDOW_ROWS < rids_.size()
+        && !windows_.count(neighbour)) {
+        loadWindow(w);
+        loadWindow(neighbour);
     }
+    Window* win = &loadWindow(w);
+    if (static_cast<size_t>(inWindow) >= win->rows.size()) {
+        // Cached before rows were appended to it.
+        windows_.erase(w);
+        win = &loadWindow(w);
+    }
+    return win->rows[inWindow];
+}
+
+TableModel::Window& TableModel::loadWindow(int w) const {
+    auto it = windows_.find(w);
+    if (it != windows_.end()) {
+        it->second.lastUse = ++useClock_;
+        return it->second;
+    }
+
+    if (windows_.size() >= MAX_WINDOWS) {
+        auto lru = std::min_element(windows_.begin(), windows_.end(),
+                                    [](const auto& a, const auto& b){ return a.second.lastUse < b.second.lastUse; });
+        windows_.erase(lru);
+    }
+
+    Window& win = windows_[w];
+    win.lastUse = ++useClock_;
+    const size_t first = static_cast<size_t>(w) * WINDOW_ROWS;
+    const size_t last = std::min(rids_.size(), first + WINDOW_ROWS);
+    win.rows.reserve(last - first);
+    for (size_t i = first; i < last; ++i) {
+        auto rec = table_->read(rids_[i]);
+        win.rows.push_back(rec.value_or(Record::withFieldCount((int)schema_.fields.size())));
+    }
+    return win;
+}
+
+void TableModel::storeRecord(int row, const ma::Record& rec) {
+    auto it = windows_.find(row / WINDOW_ROWS);
+    if (it == windows_.end()) return;
+    if (static_cast<size_t>(row % WINDOW_ROWS) < it->second.rows.size()) it->second.rows[row % WINDOW_ROWS] = rec;
+    else windows_.erase(it);
+}
+
+void TableModel::dropWindows() {
+    windows_.clear();
 }
 
 QString TableModel::loadPrimaryKeyNameForThisTable() const {
@@ -981,18 +1134,20 @@ QString TableModel::loadPrimaryKeyNameForThisTable() const {
 
 bool TableModel::pkWouldBeUnique(int pkCol, const std::optional<ma::Value>& candidate, int skipRow) const {
     if (pkCol < 0) return true;
-    for (int r=0; r<(int)cache_.size(); ++r) {
-        if (r == skipRow) continue;
-        if (valuesEqual(cache_[r].values[pkCol], candidate)) return false;
-    }
-    return true;
+    ma::Record probe = ma::Record::withFieldCount(schema_.fields.size());
+    probe.values[pkCol] = candidate;
+    std::optional<ma::RID> self;
+    if (skipRow >= 0 && skipRow < (int)rids_.size()) self = rids_[skipRow];
+    return table_->keyIsFree({pkCol}, probe, self);
 }
 
 bool TableModel::columnIsUniqueNonNull(int col) const {
     if (col < 0 || col >= (int)schema_.fields.size()) return false;
     QSet<QString> seen;
-    for (const auto& rec : cache_) {
-        const auto& ov = rec.values[col];
+    for (const auto& rid : rids_) {
+        const auto r = table_->read(rid);
+        if (!r) continue;
+        const auto& ov = r->values[col];
         if (!ov.has_value()) return false;
         const ma::Value& v = ov.value();
         QString key;
@@ -1031,5 +1186,17 @@ QString TableModel::primaryKeyName() const {
 
 void TableModel::setPrimaryKeyName(const QString& name) {
     pkName_ = name;
+    syncPrimaryKeyConstraint();
     emit headerDataChanged(Qt::Horizontal, 0, columnCount() - 1);
 }
+
+// Mirrors the .keys.json primary key into the table's unique constraints so
+// that every writer, not just this model, rejects duplicate keys.
+void TableModel::syncPrimaryKeyConstraint() {
+    if (!table_) return;
+    const int pkCol = pkName_.isEmpty() ? -1 : fieldIndexByName(schema_, pkName_);
+    try {
+        if (pkCol < 0) table_->dropUniqueConstraint(kPkConstraint);
+        else table_->addUniqueConstraint(kPkConstraint, {pkCol});
+    } catch (...) {}
+}
@@ -2,7 +2,12 @@
 #include <QAbstractTableModel>
 #include <vector>
 #include <optional>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
 #include <QString>
+#include <QPointer>
+#include <QThread>
 #include "../core/Table.h"
 
 class TableModel : public QAbstractTableModel {
@@ -10,6 +15,7 @@ class TableModel : public QAbstractTableModel {
 public:
     explicit TableModel(ma::Table* table, QObject* parent=nullptr);
     explicit TableModel(ma::Table* table, const QString& basePath, QObject* parent=nullptr);
+    ~TableModel() override;
     int rowCount(const QModelIndex& parent = QModelIndex()) const override;
     int columnCount(const QModelIndex& parent = QModelIndex()) const override;
     QVariant data(const QModelIndex& index, int role) const override;
@@ -18,28 +24,60 @@ public:
     bool setData(const QModelIndex& index, const QVariant& value, int role) override;
     bool insertRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
     bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+    // With a base path, rows are found on a worker thread and arrive in
+    // chunks (rowsInserted); edits are refused until loadFinished().
     void reload();
+    bool isLoading() const { return job_ != nullptr; }
+    void cancelLoad();
     QString primaryKeyName() const;
     bool columnIsUniqueNonNull(int col) const;
     void notifyPrimaryKeyChanged();;
     void setPrimaryKeyName(const QString& name);
 
+signals:
+    void loadProgress(int rowsLoaded);
+    void loadFinished();
+
 private:
+    struct LoadJob {
+        std::atomic<bool> cancel{false};
+        bool saveOrder = false; // write the .ord file once loaded (reload())
+    };
+    void startLoad(bool saveWhenDone);
+    void appendLoaded(const std::shared_ptr<LoadJob>& job, std::vector<ma::RID>& chunk);
+    void finishLoad(const std::shared_ptr<LoadJob>& job, bool ok);
+    std::shared_ptr<LoadJob> job_;
+    QPointer<QThread> loader_;
+
     ma::Record makeDefaultRecord() const;
     QVariant toVariant(const std::optional<ma::Value>& ov) const;
     ma::Value fromVariant(int col, const QVariant& qv) const;
     QString orderFilePath() const;
-    std::vector<ma::RID> loadOrder() const;
+    static std::vector<ma::RID> loadOrder(const QString& fn);
     void saveOrder() const;
     std::vector<ma::RID> mergeWithOrder(const std::vector<ma::RID>& scanned) const;
-    void rebuildCacheFromRids();
+    // Rows are decoded on demand in windows of WINDOW_ROWS consecutive rows;
+    // at most MAX_WINDOWS are kept, the least recently used going first.
+    static constexpr int WINDOW_ROWS = 256;
+    static constexpr size_t MAX_WINDOWS = 16;
+    struct Window {
+        std::vector<ma::Record> rows;
+        uint64_t lastUse = 0;
+    };
+    // The reference stays valid until the next call that may load a window.
+    const ma::Record& recordAt(int row) const;
+    Window& loadWindow(int w) const;
+    void storeRecord(int row, const ma::Record& rec);
+    void dropWindows();
     ma::Table* table_{nullptr};
     ma::Schema schema_{};
     std::vector<ma::RID> rids_;
-    std::vector<ma::Record> cache_;
+    mutable std::unordered_map<int, Window> windows_;
+    mutable uint64_t useClock_ = 0;
     QString basePath_;
     QString loadPrimaryKeyNameForThisTable() const;
     bool pkWouldBeUnique(int pkCol, const std::optional<ma::Value>& candidate, int skipRow) const;
+    void syncPrimaryKeyConstraint();
     int primaryKeyColumn() const;
     QString pkName_;
 };